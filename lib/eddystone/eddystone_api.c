@@ -10,248 +10,44 @@
  */
 
 #include "eddystone_api.h"
+#include "eddystone_registry.h"
+#include "eddystone_ring.h"
 
-uint8_t eddy_common_received = 0;
-uint8_t eddy_url_received = 0;
-uint8_t eddy_tlm_received = 0;
+static TaskHandle_t eddy_decoder_task = NULL;
 
-/**
- * @brief Decode and store received UID 
-    ****************** Eddystone-UID **************
-    Byte offset	    Field	       Description
-    0	      Frame Type	   Value = 0x00
-    1	     Ranging Data	   Calibrated Tx power at 0 m
-    2	       NID[0]	       10-byte Namespace
-    3	       NID[1]	
-    4	       NID[2]	
-    5	       NID[3]	
-    6	       NID[4]	
-    7	       NID[5]	
-    8	       NID[6]	
-    9	       NID[7]	
-    10	       NID[8]	
-    11	       NID[9]	
-    12	       BID[0]	       6-byte Instance
-    13	       BID[1]	
-    14	       BID[2]	
-    15	       BID[3]	
-    16	       BID[4]	
-    17	       BID[5]	
-    18	        RFU	           Reserved for future use, must be0x00
-    19	        RFU	           Reserved for future use, must be0x00
-    ********************************************
- * @param buf 
- * @param len 
- * @param res 
- * @return esp_err_t 
- */
-static esp_err_t esp_eddystone_uid_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
-{
-    uint8_t pos = 0;
-    //1-byte Ranging Data + 10-byte Namespace + 6-byte Instance
-    if((len != EDDYSTONE_UID_DATA_LEN) && (len != (EDDYSTONE_UID_RFU_LEN+EDDYSTONE_UID_DATA_LEN))) {
-        //ERROR:uid len wrong
-        return -1;
-    }
-    res->inform.uid.ranging_data = buf[pos++];
-    for(int i=0; i<EDDYSTONE_UID_NAMESPACE_LEN; i++) {
-        res->inform.uid.namespace_id[i] = buf[pos++];
-    }
-    for(int i=0; i<EDDYSTONE_UID_INSTANCE_LEN; i++) {
-        res->inform.uid.instance_id[i] = buf[pos++];
-    }
-    return 0;
-}
+static struct {
+    esp_eddystone_listener_t  cb;
+    void*                     ctx;
+} eddy_listeners[EDDY_MAX_LISTENERS];
+static int eddy_listener_count = 0;
 
-/**
- * @brief Resolve received URL to url_res pointer
- * 
- * @param url_start 
- * @param url_end 
- * @return char* 
- */
-static char* esp_eddystone_resolve_url_scheme(const uint8_t *url_start, const uint8_t *url_end)
-{
-    int pos = 0;
-    static char url_buf[100] = {0};
-    const uint8_t *p = url_start;
-
-    pos += sprintf(&url_buf[pos], "%s", eddystone_url_prefix[*p++]);
-
-    for (; p <= url_end; p++) {
-        if (esp_eddystone_is_char_invalid((*p))) {
-            pos += sprintf(&url_buf[pos], "%s", eddystone_url_encoding[*p]);
-        } else {
-            pos += sprintf(&url_buf[pos], "%c", *p);
-        }
-    }
-    return url_buf;
-}
-
-
-/**
- * @brief decode and store received URL, the pointer url_res points to the resolved url
- *  ************************** Eddystone-URL *************
-    Frame Specification
-    Byte offset	 Field	       Description
-        0	       Frame Type	    Value = 0x10
-        1	        TX Power	 Calibrated Tx power at 0 m
-        2	       URL Scheme	   Encoded Scheme Prefix
-        3+	       Encoded URL	    Length 1-17
-    *******************************************************
- * @param buf 
- * @param len 
- * @param res 
- * @return esp_err_t 
- */
-static esp_err_t esp_eddystone_url_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
-{
-    char *url_res = NULL;
-    uint8_t pos = 0;
-    if(len-EDDYSTONE_URL_TX_POWER_LEN > EDDYSTONE_URL_MAX_LEN) {
-        //ERROR:too long url
-        return -1;
-    }
-    res->inform.url.tx_power = buf[pos++];   
-    url_res = esp_eddystone_resolve_url_scheme(buf+pos, buf+len-1);
-    memcpy(&res->inform.url.url, url_res, strlen(url_res));
-    res->inform.url.url[strlen(url_res)] = '\0';
-    return 0;
-}
-
-
-/**
- * @brief decode and store received TLM 
- *  ****************** eddystone-tlm ***************
- *  Unencrypted TLM Frame Specification
-    Byte offset	       Field	     Description
-        0	          Frame Type	 Value = 0x20
-        1	           Version	     TLM version, value = 0x00
-        2	           VBATT[0]	     Battery voltage, 1 mV/bit
-        3	           VBATT[1]	
-        4	           TEMP[0]	     Beacon temperature
-        5	           TEMP[1]	
-        6	          ADV_CNT[0]	 Advertising PDU count
-        7	          ADV_CNT[1]	
-        8	          ADV_CNT[2]	
-        9	          ADV_CNT[3]	
-        10	          SEC_CNT[0]	 Time since power-on or reboot
-        11	          SEC_CNT[1]	
-        12	          SEC_CNT[2]	
-        13	          SEC_CNT[3]	
-    ************************************************
- * @param buf 
- * @param len 
- * @param res 
- * @return esp_err_t 
- */
-static esp_err_t esp_eddystone_tlm_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
-{
-    uint8_t pos = 0;
-    if(len > EDDYSTONE_TLM_DATA_LEN) {
-        //ERROR:TLM too long
-        return -1;
-    }
-    res->inform.tlm.version = buf[pos++];
-    res->inform.tlm.battery_voltage = big_endian_read_16(buf, pos);
-    pos += 2;
-    uint16_t temp = big_endian_read_16(buf, pos);
-    int8_t temp_integral = (int8_t)((temp >> 8) & 0xff);
-    float temp_decimal = (temp & 0xff) / 256.0;
-    res->inform.tlm.temperature = temp_integral + temp_decimal;
-    pos += 2;
-    res->inform.tlm.adv_count = big_endian_read_32(buf, pos);
-    pos += 4;
-    res->inform.tlm.time = big_endian_read_32(buf, pos);
-    return 0;
-}
+static esp_eddystone_decode_stats_t eddy_decode_stats;
+static portMUX_TYPE eddy_decode_stats_lock = portMUX_INITIALIZER_UNLOCKED;     /*<! busy_us is 64 bits, read by other tasks */
 
-/**
- * @brief Read the Eddystone information on the main struct
- * 
- * @param buf 
- * @param len 
- * @param res 
- * @return esp_err_t 
- */
-static esp_err_t esp_eddystone_get_inform(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
-{
-    static esp_err_t ret=-1;
-    switch(res->common.frame_type)
-    {
-        case EDDYSTONE_FRAME_TYPE_UID: {
-            ret = esp_eddystone_uid_received(buf, len, res);
-            break;
-        }
-        case EDDYSTONE_FRAME_TYPE_URL: {
-            ret = esp_eddystone_url_received(buf, len, res);
-            break;
-        }
-        case EDDYSTONE_FRAME_TYPE_TLM: {
-            ret = esp_eddystone_tlm_received(buf, len, res);
-            break;
-        }
-        default:
-            break;
-    }
-    return ret;
-}
+/* Per frame type counters are indexed by esp_eddystone_metrics_frame() */
+static const char* const eddy_metrics_frame_labels[EDDY_METRICS_FRAMES] = {
+    "frame=\"uid\"", "frame=\"url\"", "frame=\"tlm\"", "frame=\"other\""
+};
+static const uint32_t eddy_decode_bounds[] = {    /* ns */
+    2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000
+};
+static struct {
+    metrics_counter_t   adv_reports;                    /*<! reports received in esp_gap_cb */
+    metrics_counter_t   ignored;                        /*<! advertisements without eddystone service data */
+    metrics_counter_t   decoded[EDDY_METRICS_FRAMES];
+    metrics_counter_t   invalid[EDDY_METRICS_FRAMES];   /*<! eddystone service data the decoder rejected */
+    metrics_histogram_t decode_latency;
+} eddy_metrics = {
+    .decode_latency = METRICS_HISTOGRAM_INIT(eddy_decode_bounds),
+};
 
-/**
- * @brief This function is called to decode eddystone information from adv_data. 
- *        The res points to the result struct.
- * @param buf 
- * @param len 
- * @param res 
- * @return esp_err_t 
- */
-static esp_err_t esp_eddystone_decode(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
+static inline int esp_eddystone_metrics_frame(uint8_t frame_type)
 {
-    if (len == 0 || buf == NULL || res == NULL) {
-        return -1;
-    }
-    uint8_t pos=0;
-    while(res->common.srv_data_type != EDDYSTONE_SERVICE_UUID) 
-    {
-        pos++;
-        if(pos >= len ) { 
-            return -1;
-        }
-        uint8_t ad_type = buf[pos++];
-        switch(ad_type) 
-        {
-            case ESP_BLE_AD_TYPE_FLAG: {
-                res->common.flags = buf[pos++];
-                break;
-            }
-            case ESP_BLE_AD_TYPE_16SRV_CMPL: {
-                uint16_t uuid = little_endian_read_16(buf, pos);
-                if(uuid != EDDYSTONE_SERVICE_UUID) {
-                    return -1; 
-                }
-                res->common.srv_uuid = uuid;
-                pos += 2;
-                break;
-            }
-            case ESP_BLE_AD_TYPE_SERVICE_DATA: {
-                uint16_t type = little_endian_read_16(buf, pos);
-                pos += 2;
-                uint8_t frame_type = buf[pos++];
-                if(type != EDDYSTONE_SERVICE_UUID || !(frame_type == EDDYSTONE_FRAME_TYPE_UID || frame_type == EDDYSTONE_FRAME_TYPE_URL || 
-                   frame_type == EDDYSTONE_FRAME_TYPE_TLM)) {
-                    return -1;
-                }
-                res->common.srv_data_type = type;
-                res->common.frame_type = frame_type;
-                break;
-            }
-            default:
-                break;
-        }
-    }
-    return esp_eddystone_get_inform(buf+pos, len-pos, res);
+    return (frame_type & 0x0f) || (frame_type >> 4) >= EDDY_METRICS_FRAMES - 1 ?
+           EDDY_METRICS_FRAMES - 1 : frame_type >> 4;
 }
 
+#if EDDY_LOG_FRAMES
 /**
  * @brief Log the result stuct
  * 
@@ -262,52 +58,43 @@ static void esp_eddystone_show_inform(const esp_eddystone_result_t* res)
     switch(res->common.frame_type)
     {
         case EDDYSTONE_FRAME_TYPE_UID: {
-            eddy_common_received = 1;
-            sprintf(eddy_namespace_id, "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X", 
-            res->inform.uid.namespace_id[0], res->inform.uid.namespace_id[1], res->inform.uid.namespace_id[2],
-            res->inform.uid.namespace_id[3], res->inform.uid.namespace_id[4], res->inform.uid.namespace_id[5],
-            res->inform.uid.namespace_id[6], res->inform.uid.namespace_id[7], res->inform.uid.namespace_id[8], 
-            res->inform.uid.namespace_id[9]);
-            sprintf(eddy_instance_id, "%02X:%02X:%02X:%02X:%02X:%02X", 
-            res->inform.uid.instance_id[0], res->inform.uid.instance_id[1], res->inform.uid.instance_id[2],
-            res->inform.uid.instance_id[3], res->inform.uid.instance_id[4],res->inform.uid.instance_id[5]);
+            char namespace_id[MAX_STRING_SIZE];
+            char instance_id[MAX_STRING_SIZE];
+            fmt_hex(namespace_id, res->inform.uid.namespace_id, EDDYSTONE_UID_NAMESPACE_LEN, ':');
+            fmt_hex(instance_id, res->inform.uid.instance_id, EDDYSTONE_UID_INSTANCE_LEN, ':');
 
             ESP_LOGI(EDDY_TAG, "Eddystone UID inform:");
             ESP_LOGI(EDDY_TAG, "Measured power(RSSI at 0m distance):%d dbm", res->inform.uid.ranging_data);
-            ESP_LOGI(EDDY_TAG, "Namespace ID: %s", eddy_namespace_id);
-            ESP_LOGI(EDDY_TAG, "Instance ID: %s", eddy_instance_id);
+            ESP_LOGI(EDDY_TAG, "Namespace ID: %s", namespace_id);
+            ESP_LOGI(EDDY_TAG, "Instance ID: %s", instance_id);
             break;
         }
         case EDDYSTONE_FRAME_TYPE_URL: {
-            eddy_url_received = 1;
-            sprintf(eddy_tx_power, "%d dbm", res->inform.url.tx_power);
-            sprintf(eddy_url, "%s", res->inform.url.url);
+            char url[EDDYSTONE_URL_DECODED_MAX_LEN];
+            esp_eddystone_url_expand(res->inform.url.encoded, res->inform.url.len, url);
 
             ESP_LOGI(EDDY_TAG, "Eddystone URL inform:");
-            ESP_LOGI(EDDY_TAG, "Measured power(RSSI at 0m distance):%s", eddy_tx_power);
-            ESP_LOGI(EDDY_TAG, "URL: %s", eddy_url);
+            ESP_LOGI(EDDY_TAG, "Measured power(RSSI at 0m distance):%d dbm", res->inform.url.tx_power);
+            ESP_LOGI(EDDY_TAG, "URL: %s", url);
             break;
         }
         case EDDYSTONE_FRAME_TYPE_TLM: {
-            eddy_tlm_received = 1;
-            sprintf(eddy_tlm_version, "%d", res->inform.tlm.version);
-            sprintf(eddy_tlm_battery_voltage, "%d mV", res->inform.tlm.battery_voltage);
-            sprintf(eddy_tlm_temperature, "%3.2f C", res->inform.tlm.temperature);
-            sprintf(eddy_tlm_adv_count, "%d", res->inform.tlm.adv_count);
-            sprintf(eddy_tlm_time, "%d s", (res->inform.tlm.time)/10);
+            char temperature[FMT_FIXED_MAX_LEN];
+            fmt_fixed(temperature, res->inform.tlm.temperature, 8);
 
             ESP_LOGI(EDDY_TAG, "Eddystone TLM inform:");
-            ESP_LOGI(EDDY_TAG, "version: %s", eddy_tlm_version);
-            ESP_LOGI(EDDY_TAG, "battery voltage: %s", eddy_tlm_battery_voltage);
-            ESP_LOGI(EDDY_TAG, "beacon temperature in degrees Celsius: %s", eddy_tlm_temperature);
-            ESP_LOGI(EDDY_TAG, "adv pdu count since power-up: %s", eddy_tlm_adv_count);
-            ESP_LOGI(EDDY_TAG, "time since power-up: %s", eddy_tlm_time);
+            ESP_LOGI(EDDY_TAG, "version: %d", res->inform.tlm.version);
+            ESP_LOGI(EDDY_TAG, "battery voltage: %d mV", res->inform.tlm.battery_voltage);
+            ESP_LOGI(EDDY_TAG, "beacon temperature in degrees Celsius: %s C", temperature);
+            ESP_LOGI(EDDY_TAG, "adv pdu count since power-up: %d", res->inform.tlm.adv_count);
+            ESP_LOGI(EDDY_TAG, "time since power-up: %d s", (res->inform.tlm.time)/10);
             break;
         }
         default:
             break;
     }
 }
+#endif /* EDDY_LOG_FRAMES */
 
 /**
  * @brief Handles BLE Scan events
@@ -317,22 +104,13 @@ static void esp_eddystone_show_inform(const esp_eddystone_result_t* res)
  */
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param)
 {
-    esp_err_t err;
-
     switch(event)
     {
-        case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT: {
-            uint32_t duration = 0;
-            esp_ble_gap_start_scanning(duration);
-            break;
-        }
-        case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT: {
-            if((err = param->scan_start_cmpl.status) != ESP_BT_STATUS_SUCCESS) {
-                ESP_LOGE(EDDY_TAG,"Scan start failed: %s", esp_err_to_name(err));
-            }
-            else {
-                ESP_LOGI(EDDY_TAG,"Start scanning...");
-            }
+        case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+        case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
+        case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
+        case ESP_GAP_BLE_UPDATE_WHITELIST_COMPLETE_EVT: {
+            esp_eddystone_scan_gap_event(event, param);
             break;
         }
         case ESP_GAP_BLE_SCAN_RESULT_EVT: {
@@ -340,25 +118,16 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* par
             switch(scan_result->scan_rst.search_evt)
             {
                 case ESP_GAP_SEARCH_INQ_RES_EVT: {
-                    esp_eddystone_result_t eddystone_res;
-                    memset(&eddystone_res, 0, sizeof(eddystone_res));
-                    esp_err_t ret = esp_eddystone_decode(scan_result->scan_rst.ble_adv, scan_result->scan_rst.adv_data_len, &eddystone_res);
-                    if (ret) {
-                        // error:The received data is not an eddystone frame packet or a correct eddystone frame packet.
-                        // just return
-                        return;
-                    } else {   
-                        // The received adv data is a correct eddystone frame packet.
-                        // Here, we get the eddystone infomation in eddystone_res, we can use the data in res to do other things.
-                        // For example, just print them:
-                        sprintf(eddy_mac, "%02X:%02X:%02X:%02X:%02X:%02X", 
-                        (uint8_t)scan_result->scan_rst.bda[0], (uint8_t)scan_result->scan_rst.bda[1], (uint8_t)scan_result->scan_rst.bda[2],
-                        (uint8_t)scan_result->scan_rst.bda[3], (uint8_t)scan_result->scan_rst.bda[4], (uint8_t)scan_result->scan_rst.bda[5]);
-
-                        ESP_LOGI(EDDY_TAG, "--------Eddystone Found----------");
-                        ESP_LOGI(EDDY_TAG,"Device address: %s", eddy_mac);
-                        ESP_LOGI(EDDY_TAG, "RSSI of packet:%d dbm", scan_result->scan_rst.rssi);
-                        esp_eddystone_show_inform(&eddystone_res);
+                    metrics_inc(&eddy_metrics.adv_reports);
+                    metrics_boot_mark(METRICS_BOOT_FIRST_ADV);
+                    esp_eddystone_scan_count_report();
+                    // Only copy the raw packet here, decoding runs on the decoder task
+                    // so the Bluedroid task is never held up by dense advertising
+                    esp_eddystone_ring_push(scan_result->scan_rst.bda, scan_result->scan_rst.rssi,
+                                            scan_result->scan_rst.ble_adv, scan_result->scan_rst.adv_data_len,
+                                            (uint32_t)(esp_timer_get_time() / 1000));
+                    if (eddy_decoder_task) {
+                        xTaskNotifyGive(eddy_decoder_task);
                     }
                     break;
                 }
@@ -367,20 +136,189 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* par
             }
             break;
         }
-        case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:{
-            if((err = param->scan_stop_cmpl.status) != ESP_BT_STATUS_SUCCESS) {
-                ESP_LOGE(EDDY_TAG,"Scan stop failed: %s", esp_err_to_name(err));
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Decode one queued advertisement and merge it into the registry
+ * 
+ * @param adv 
+ */
+static void esp_eddystone_process_adv(const esp_eddystone_adv_t* adv)
+{
+    esp_eddystone_result_t eddystone_res;
+    metrics_stopwatch_t sw;
+    uint32_t ns;
+    memset(&eddystone_res, 0, sizeof(eddystone_res));
+    metrics_stopwatch_start(&sw);
+    esp_err_t ret = esp_eddystone_decode(adv->adv, adv->adv_len, &eddystone_res);
+    if (metrics_stopwatch_ns(&sw, &ns)) {
+        metrics_observe(&eddy_metrics.decode_latency, ns);
+    }
+    eddy_decode_stats.advs++;
+    if (ret) {
+        // error:The received data is not an eddystone frame packet or a correct eddystone frame packet.
+        // count it and return
+        if (eddystone_res.common.srv_data_type == EDDYSTONE_SERVICE_UUID) {
+            metrics_inc(&eddy_metrics.invalid[esp_eddystone_metrics_frame(eddystone_res.common.frame_type)]);
+        } else {
+            metrics_inc(&eddy_metrics.ignored);
+        }
+        return;
+    }
+    // The received adv data is a correct eddystone frame packet.
+    // Merge it into the entry of its device, then print it (EDDY_LOG_FRAMES builds only)
+    eddy_decode_stats.frames++;
+    metrics_boot_mark(METRICS_BOOT_FIRST_BEACON);
+    metrics_inc(&eddy_metrics.decoded[esp_eddystone_metrics_frame(eddystone_res.common.frame_type)]);
+    esp_eddystone_scan_count_frame();
+    const esp_eddystone_beacon_t* beacon = esp_eddystone_registry_update(adv->bda, adv->rssi, &eddystone_res);
+    if (beacon->frame_count == 1) {
+        esp_eddystone_scan_count_new_beacon();
+    }
+
+#if EDDY_LOG_FRAMES
+    char bda[3 * ESP_BD_ADDR_LEN];
+    fmt_hex(bda, adv->bda, ESP_BD_ADDR_LEN, ':');
+    ESP_LOGI(EDDY_TAG, "--------Eddystone Found----------");
+    ESP_LOGI(EDDY_TAG,"Device address: %s", bda);
+    ESP_LOGI(EDDY_TAG, "RSSI of packet:%d dbm", adv->rssi);
+    esp_eddystone_show_inform(&eddystone_res);
+#endif
+
+    for (int i = 0; i < eddy_listener_count; i++) {
+        eddy_listeners[i].cb(adv->bda, adv->rssi, &eddystone_res, eddy_listeners[i].ctx);
+    }
+}
+
+/**
+ * @brief Drain the advertisement ring in batches. The registry is only written
+ *        from this task.
+ * 
+ * @param pvParameters 
+ */
+static void esp_eddystone_decoder_task(void *pvParameters)
+{
+    esp_eddystone_ring_stats_t stats;
+    uint32_t reported_high_water = 0;
+    esp_eddystone_decode_stats_t period = eddy_decode_stats;
+    int64_t period_start = esp_timer_get_time();
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(EDDY_RING_STATS_PERIOD_MS));
+
+        uint32_t count;
+        while ((count = esp_eddystone_ring_available()) > 0) {
+            int64_t start = esp_timer_get_time();
+            for (uint32_t i = 0; i < count; i++) {
+                esp_eddystone_process_adv(esp_eddystone_ring_at(i));
             }
-            else {
-                ESP_LOGI(EDDY_TAG,"Stop scan successfully");
+            esp_eddystone_ring_release(count);
+            int64_t busy_us = esp_timer_get_time() - start;
+            portENTER_CRITICAL(&eddy_decode_stats_lock);
+            eddy_decode_stats.busy_us += busy_us;
+            eddy_decode_stats.batches++;
+            portEXIT_CRITICAL(&eddy_decode_stats_lock);
+        }
+
+        esp_eddystone_ring_get_stats(&stats);
+        if (stats.high_water != reported_high_water) {
+            reported_high_water = stats.high_water;
+            ESP_LOGI(EDDY_TAG, "Adv ring: %u/%u high water, %u queued, %u dropped",
+                     stats.high_water, stats.size, stats.pushed, stats.dropped);
+        }
+
+        /* Throughput of the last period: busy time per advertisement tells how many
+           advertisements per second the decoder could keep up with */
+        int64_t now = esp_timer_get_time();
+        if (now - period_start >= EDDY_RING_STATS_PERIOD_MS * 1000LL) {
+            uint32_t advs = eddy_decode_stats.advs - period.advs;
+            uint32_t frames = eddy_decode_stats.frames - period.frames;
+            uint64_t busy_us = eddy_decode_stats.busy_us - period.busy_us;
+            if (advs) {
+                uint32_t ns_per_adv = (uint32_t)(busy_us * 1000 / advs);
+                ESP_LOGI(EDDY_TAG, "Decoder: %u advs/s (%u eddystone), %u ns/adv, max %u advs/s",
+                         (uint32_t)(advs * 1000000LL / (now - period_start)), frames, ns_per_adv,
+                         ns_per_adv ? 1000000000u / ns_per_adv : 0);
             }
-            break;
+            period = eddy_decode_stats;
+            period_start = now;
         }
-        default:
-            break;
     }
 }
 
+/**
+ * @brief Read the decoder counters. The cost per frame on the host is measured
+ *        by tools/eddystone_decoder_bench.c, these tell the load on the device.
+ * 
+ * @param stats 
+ */
+void esp_eddystone_get_decode_stats(esp_eddystone_decode_stats_t* stats)
+{
+    portENTER_CRITICAL(&eddy_decode_stats_lock);
+    *stats = eddy_decode_stats;
+    portEXIT_CRITICAL(&eddy_decode_stats_lock);
+}
+
+/**
+ * @brief Write the scan and decoder metrics
+ * 
+ * @param w 
+ */
+void esp_eddystone_write_metrics(metrics_writer_t* w)
+{
+    esp_eddystone_ring_stats_t ring;
+
+    metrics_write_help(w, "eddy_adv_reports_total", "counter", "Advertising reports received from the controller");
+    metrics_write_value(w, "eddy_adv_reports_total", NULL, metrics_counter_read(&eddy_metrics.adv_reports));
+    metrics_write_help(w, "eddy_adv_ignored_total", "counter", "Advertisements without eddystone service data");
+    metrics_write_value(w, "eddy_adv_ignored_total", NULL, metrics_counter_read(&eddy_metrics.ignored));
+
+    metrics_write_help(w, "eddy_frames_decoded_total", "counter", "Eddystone frames decoded");
+    for (int i = 0; i < EDDY_METRICS_FRAMES; i++) {
+        metrics_write_value(w, "eddy_frames_decoded_total", eddy_metrics_frame_labels[i],
+                            metrics_counter_read(&eddy_metrics.decoded[i]));
+    }
+    metrics_write_help(w, "eddy_frames_invalid_total", "counter", "Eddystone frames rejected by the decoder");
+    for (int i = 0; i < EDDY_METRICS_FRAMES; i++) {
+        metrics_write_value(w, "eddy_frames_invalid_total", eddy_metrics_frame_labels[i],
+                            metrics_counter_read(&eddy_metrics.invalid[i]));
+    }
+
+    metrics_write_help(w, "eddy_decode_duration_seconds", "histogram", "Time to decode one advertisement");
+    metrics_write_histogram(w, "eddy_decode_duration_seconds", NULL, &eddy_metrics.decode_latency);
+
+    esp_eddystone_ring_get_stats(&ring);
+    metrics_write_help(w, "eddy_ring_dropped_total", "counter", "Advertisements lost because the decoder fell behind");
+    metrics_write_value(w, "eddy_ring_dropped_total", NULL, ring.dropped);
+    metrics_write_help(w, "eddy_ring_high_water", "gauge", "Most advertisements queued at once");
+    metrics_write_value(w, "eddy_ring_high_water", NULL, ring.high_water);
+
+    metrics_write_help(w, "eddy_beacons", "gauge", "Beacons tracked");
+    metrics_write_value(w, "eddy_beacons", NULL, esp_eddystone_registry_count());
+}
+
+/**
+ * @brief Register a function called for every decoded eddystone frame.
+ *        Listeners must be added before esp_eddystone_init().
+ * 
+ * @param cb 
+ * @param ctx - Passed to cb
+ * @return esp_err_t - ESP_ERR_NO_MEM when EDDY_MAX_LISTENERS are already registered
+ */
+esp_err_t esp_eddystone_add_listener(esp_eddystone_listener_t cb, void* ctx)
+{
+    if (eddy_listener_count >= EDDY_MAX_LISTENERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    eddy_listeners[eddy_listener_count].cb = cb;
+    eddy_listeners[eddy_listener_count].ctx = ctx;
+    eddy_listener_count++;
+    return ESP_OK;
+}
+
 /**
  * @brief Register the BLE callback function
  * 
@@ -409,10 +347,14 @@ void esp_eddystone_init(void)
     esp_bt_controller_init(&bt_cfg);
     esp_bt_controller_enable(ESP_BT_MODE_BLE);
 
+    esp_eddystone_registry_init();
+    xTaskCreate(&esp_eddystone_decoder_task, "esp_eddystone_decoder", 4096, NULL, 6, &eddy_decoder_task);
+    metrics_register_task(eddy_decoder_task);
+
     esp_bluedroid_init();
     esp_bluedroid_enable();
     esp_eddystone_appRegister();
 
-    /* set scan parameters */
-    esp_ble_gap_set_scan_params(&ble_scan_params);
+    /* set scan parameters, scanning starts once they are set */
+    esp_eddystone_scan_init();
 }
@@ -27,126 +27,53 @@
 #include "esp_gap_ble_api.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
 
 #include "esp_err.h"
 #include "esp_gap_ble_api.h"
 #include "eddystone_protocol.h"
-
-#include "esp_log.h"
+#include "eddystone_decoder.h"
+#include "eddystone_scan.h"
+#include "format.h"
+#include "metrics.h"
 
 #define MAX_STRING_SIZE 50
 
+/* Log every decoded frame. Formatting and printing each frame costs more than
+   decoding it, so production builds leave it off; enable with
+   build_flags = -DEDDY_LOG_FRAMES=1 in platformio.ini */
+#ifndef EDDY_LOG_FRAMES
+#define EDDY_LOG_FRAMES 0
+#endif
+#define EDDY_RING_STATS_PERIOD_MS   60000   /* decoder task wakes up at least this often */
+#define EDDY_MAX_LISTENERS          4
+#define EDDY_METRICS_FRAMES         4       /* uid, url, tlm and other frame types */
+
+/* Decoder task counters, since boot */
 typedef struct {
-    struct {
-        uint8_t   flags;          /*<! AD flags data */
-        uint16_t  srv_uuid;       /*<! complete list of 16-bit service uuid*/
-        uint16_t  srv_data_type;  /*<! service data type */
-        uint8_t   frame_type;     /*<! Eddystone UID, URL or TLM */
-    } common;
-    union {
-        struct {
-            /*<! Eddystone-UID */
-            int8_t  ranging_data;     /*<! calibrated Tx power at 0m */
-            uint8_t namespace_id[10];
-            uint8_t instance_id[6];
-        } uid;
-        struct {
-            /*<! Eddystone-URL */
-            int8_t  tx_power;                    /*<! calibrated Tx power at 0m */
-            char    url[EDDYSTONE_URL_MAX_LEN];  /*<! the decoded URL */
-        } url;
-        struct {
-            /*<! Eddystone-TLM */
-            uint8_t   version;           /*<! TLM version,0x00 for now */
-            uint16_t  battery_voltage;   /*<! battery voltage in mV */
-            float     temperature;       /*<! beacon temperature in degrees Celsius */
-            uint32_t  adv_count;         /*<! adv pdu count since power-up */
-            uint32_t  time;              /*<! time since power-up, a 0.1 second resolution counter */
-        } tlm;
-    } inform;
-} esp_eddystone_result_t;
+    uint32_t  advs;         /*<! advertisements taken from the ring */
+    uint32_t  frames;       /*<! advertisements decoded as eddystone frames */
+    uint32_t  batches;      /*<! ring drains */
+    uint64_t  busy_us;      /*<! time spent decoding, updating and publishing */
+} esp_eddystone_decode_stats_t;
 
 /* Static variables */ 
 static const char* EDDY_TAG = "EDDYSTONE";
 
-/* BLE Scan params */
-static esp_ble_scan_params_t ble_scan_params = {
-    .scan_type              = BLE_SCAN_TYPE_ACTIVE,
-    .own_addr_type          = BLE_ADDR_TYPE_PUBLIC,
-    .scan_filter_policy     = BLE_SCAN_FILTER_ALLOW_ALL,
-    .scan_interval          = 0x50,
-    .scan_window            = 0x40,
-    .scan_duplicate         = BLE_SCAN_DUPLICATE_DISABLE
-};
-
-/* Eddystone-URL scheme prefixes */
-static const char* eddystone_url_prefix[4] = {
-    "http://www.",
-    "https://www.",
-    "http://",
-    "https://"
-};
-
-/* Eddystone-URL HTTP URL encoding */
-static const char* eddystone_url_encoding[14] = {
-    ".com/",
-    ".org/",
-    ".edu/",
-    ".net/",
-    ".info/",
-    ".biz/",
-    ".gov/",
-    ".com",
-    ".org",
-    ".edu",
-    ".net",
-    ".info",
-    ".biz",
-    ".gov"
- };
-
-/* Public Global Variables */
-uint8_t eddy_common_received;       /* flag to common eddystone frame received */
-uint8_t eddy_url_received;          /* flag to url eddystone frame received */
-uint8_t eddy_tlm_received;          /* flag to tlm eddystone frame received */
-char eddy_mac[MAX_STRING_SIZE];                  /* device uuid mac */
-char eddy_namespace_id[MAX_STRING_SIZE];         /* device uuid name */
-char eddy_instance_id[MAX_STRING_SIZE];          /* device uuid instance */
-char eddy_tx_power[MAX_STRING_SIZE];             /* calibrated Tx power at 0m */
-char eddy_url[MAX_STRING_SIZE];                  /* the decoded URL */
-char eddy_tlm_version[MAX_STRING_SIZE];          /* TLM version,0x00 for now */
-char eddy_tlm_battery_voltage[MAX_STRING_SIZE];  /* battery voltage in mV */
-char eddy_tlm_temperature[MAX_STRING_SIZE];      /* beacon temperature in degrees Celsius */
-char eddy_tlm_adv_count[MAX_STRING_SIZE];        /* adv pdu count since power-up */
-char eddy_tlm_time[MAX_STRING_SIZE];             /* time since power-up, a 0.1 second resolution counter */
-
-/* Utils */
-static inline uint16_t little_endian_read_16(const uint8_t *buffer, uint8_t pos)
-{
-    return ((uint16_t)buffer[pos]) | (((uint16_t)buffer[(pos)+1]) << 8);
-}
-
-static inline uint16_t big_endian_read_16(const uint8_t *buffer, uint8_t pos)
-{
-    return (((uint16_t)buffer[pos]) << 8) | ((uint16_t)buffer[(pos)+1]);
-}
-
-static inline uint32_t big_endian_read_32(const uint8_t *buffer, uint8_t pos)
-{
-    return (((uint32_t)buffer[pos]) << 24) | (((uint32_t)buffer[(pos)+1]) << 16) | (((uint32_t)buffer[(pos)+2]) << 8) | ((uint32_t)buffer[(pos)+3]);
-}
-
 /* Static functions */
-static esp_err_t esp_eddystone_decode(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res);
-static esp_err_t esp_eddystone_uid_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res);
-static esp_err_t esp_eddystone_url_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res);
-static char* esp_eddystone_resolve_url_scheme(const uint8_t* url_start, const uint8_t* url_end);
-static esp_err_t esp_eddystone_tlm_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res);
-static esp_err_t esp_eddystone_get_inform(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res);
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+#if EDDY_LOG_FRAMES
 static void esp_eddystone_show_inform(const esp_eddystone_result_t* res);
+#endif
+static void esp_eddystone_decoder_task(void *pvParameters);
+
+/* Called from the decoder task for every decoded frame, must not block */
+typedef void (*esp_eddystone_listener_t)(const uint8_t* bda, int8_t rssi, const esp_eddystone_result_t* res, void* ctx);
 
 /* Public funtions */ 
 void esp_eddystone_init(void);
+esp_err_t esp_eddystone_add_listener(esp_eddystone_listener_t cb, void* ctx);
+void esp_eddystone_get_decode_stats(esp_eddystone_decode_stats_t* stats);
+void esp_eddystone_write_metrics(metrics_writer_t* w);
 
 #endif /* __EDDYSTONE_API_H__ */
\ No newline at end of file
@@ -0,0 +1,311 @@
+/**
+ * @file eddystone_decoder.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the eddystone frame decoder.
+ * @version 1.0
+ * @date 2020-03-30
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#include "eddystone_decoder.h"
+
+/* Eddystone-URL scheme prefixes */
+static const char* eddystone_url_prefix[EDDYSTONE_URL_PREFIX_COUNT] = {
+    "http://www.",
+    "https://www.",
+    "http://",
+    "https://"
+};
+
+/* Eddystone-URL HTTP URL encoding */
+static const char* eddystone_url_encoding[EDDYSTONE_URL_ENCODING_COUNT] = {
+    ".com/",
+    ".org/",
+    ".edu/",
+    ".net/",
+    ".info/",
+    ".biz/",
+    ".gov/",
+    ".com",
+    ".org",
+    ".edu",
+    ".net",
+    ".info",
+    ".biz",
+    ".gov"
+ };
+
+/**
+ * @brief Decode and store received UID 
+    ****************** Eddystone-UID **************
+    Byte offset	    Field	       Description
+    0	      Frame Type	   Value = 0x00
+    1	     Ranging Data	   Calibrated Tx power at 0 m
+    2	       NID[0]	       10-byte Namespace
+    3	       NID[1]	
+    4	       NID[2]	
+    5	       NID[3]	
+    6	       NID[4]	
+    7	       NID[5]	
+    8	       NID[6]	
+    9	       NID[7]	
+    10	       NID[8]	
+    11	       NID[9]	
+    12	       BID[0]	       6-byte Instance
+    13	       BID[1]	
+    14	       BID[2]	
+    15	       BID[3]	
+    16	       BID[4]	
+    17	       BID[5]	
+    18	        RFU	           Reserved for future use, must be0x00
+    19	        RFU	           Reserved for future use, must be0x00
+    ********************************************
+ * @param buf 
+ * @param len 
+ * @param res 
+ * @return esp_err_t 
+ */
+static esp_err_t esp_eddystone_uid_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
+{
+    uint8_t pos = 0;
+    //1-byte Ranging Data + 10-byte Namespace + 6-byte Instance
+    if((len != EDDYSTONE_UID_DATA_LEN) && (len != (EDDYSTONE_UID_RFU_LEN+EDDYSTONE_UID_DATA_LEN))) {
+        //ERROR:uid len wrong
+        return -1;
+    }
+    res->inform.uid.ranging_data = buf[pos++];
+    for(int i=0; i<EDDYSTONE_UID_NAMESPACE_LEN; i++) {
+        res->inform.uid.namespace_id[i] = buf[pos++];
+    }
+    for(int i=0; i<EDDYSTONE_UID_INSTANCE_LEN; i++) {
+        res->inform.uid.instance_id[i] = buf[pos++];
+    }
+    return 0;
+}
+
+/**
+ * @brief decode and store received URL, validated but kept encoded
+ *  ************************** Eddystone-URL *************
+    Frame Specification
+    Byte offset	 Field	       Description
+        0	       Frame Type	    Value = 0x10
+        1	        TX Power	 Calibrated Tx power at 0 m
+        2	       URL Scheme	   Encoded Scheme Prefix
+        3+	       Encoded URL	    Length 1-17
+    *******************************************************
+ * @param buf 
+ * @param len 
+ * @param res 
+ * @return esp_err_t 
+ */
+static esp_err_t esp_eddystone_url_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
+{
+    uint8_t pos = 0;
+    if(len < EDDYSTONE_URL_TX_POWER_LEN + EDDYSTONE_URL_SCHEME_LEN) {
+        //ERROR:url too short
+        return -1;
+    }
+    if(len-EDDYSTONE_URL_TX_POWER_LEN > EDDYSTONE_URL_MAX_LEN) {
+        //ERROR:too long url
+        return -1;
+    }
+    res->inform.url.tx_power = buf[pos++];
+    // Only validated here, the URL is expanded when somebody needs the text
+    if(buf[pos] >= EDDYSTONE_URL_PREFIX_COUNT) {
+        return -1;
+    }
+    for(uint8_t i = pos + 1; i < len; i++) {
+        if(buf[i] >= EDDYSTONE_URL_ENCODING_COUNT && esp_eddystone_is_char_invalid(buf[i])) {
+            return -1;
+        }
+    }
+    res->inform.url.len = len - pos;
+    memcpy(res->inform.url.encoded, buf + pos, len - pos);
+    return 0;
+}
+
+
+/**
+ * @brief decode and store received TLM 
+ *  ****************** eddystone-tlm ***************
+ *  Unencrypted TLM Frame Specification
+    Byte offset	       Field	     Description
+        0	          Frame Type	 Value = 0x20
+        1	           Version	     TLM version, value = 0x00
+        2	           VBATT[0]	     Battery voltage, 1 mV/bit
+        3	           VBATT[1]	
+        4	           TEMP[0]	     Beacon temperature
+        5	           TEMP[1]	
+        6	          ADV_CNT[0]	 Advertising PDU count
+        7	          ADV_CNT[1]	
+        8	          ADV_CNT[2]	
+        9	          ADV_CNT[3]	
+        10	          SEC_CNT[0]	 Time since power-on or reboot
+        11	          SEC_CNT[1]	
+        12	          SEC_CNT[2]	
+        13	          SEC_CNT[3]	
+    ************************************************
+ * @param buf 
+ * @param len 
+ * @param res 
+ * @return esp_err_t 
+ */
+static esp_err_t esp_eddystone_tlm_received(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
+{
+    uint8_t pos = 0;
+    if(len != EDDYSTONE_TLM_DATA_LEN) {
+        //ERROR:TLM len wrong
+        return -1;
+    }
+    res->inform.tlm.version = buf[pos++];
+    res->inform.tlm.battery_voltage = big_endian_read_16(buf, pos);
+    pos += 2;
+    // 8.8 signed fixed point, kept as it is
+    res->inform.tlm.temperature = (int16_t)big_endian_read_16(buf, pos);
+    pos += 2;
+    res->inform.tlm.adv_count = big_endian_read_32(buf, pos);
+    pos += 4;
+    res->inform.tlm.time = big_endian_read_32(buf, pos);
+    return 0;
+}
+
+/* Frame decoder, called with the bytes following the frame type */
+typedef esp_err_t (*esp_eddystone_frame_handler_t)(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res);
+
+/* Frame types are multiples of 0x10, the table is indexed by the high nibble */
+#define EDDYSTONE_FRAME_HANDLER_COUNT   16
+
+static const esp_eddystone_frame_handler_t eddystone_frame_handlers[EDDYSTONE_FRAME_HANDLER_COUNT] = {
+    [EDDYSTONE_FRAME_TYPE_UID >> 4] = esp_eddystone_uid_received,
+    [EDDYSTONE_FRAME_TYPE_URL >> 4] = esp_eddystone_url_received,
+    [EDDYSTONE_FRAME_TYPE_TLM >> 4] = esp_eddystone_tlm_received,
+};
+
+/**
+ * @brief Check a complete list of 16-bit service UUIDs for the eddystone UUID
+ * 
+ * @param buf - First UUID
+ * @param len - Length of the list
+ * @return true if the list holds 0xFEAA
+ */
+static inline bool esp_eddystone_has_service_uuid(const uint8_t* buf, uint8_t len)
+{
+    for (uint8_t i = 0; i + 1 < len; i += 2) {
+        if (buf[i] == (EDDYSTONE_SERVICE_UUID & 0xff) && buf[i+1] == (EDDYSTONE_SERVICE_UUID >> 8)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief This function is called to decode eddystone information from adv_data. 
+ *        The res points to the result struct.
+ *
+ *        The advertisement is walked once as a list of AD structures
+ *        (length, type, data), each length checked against the packet. The walk
+ *        stops at the first byte that rules the packet out: a 16-bit UUID list
+ *        without 0xFEAA, or service data of an unknown frame type. Other
+ *        AD types and service data of other UUIDs are skipped.
+ * @param buf 
+ * @param len 
+ * @param res 
+ * @return esp_err_t - -1 if the packet is not a valid eddystone frame
+ */
+esp_err_t esp_eddystone_decode(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res)
+{
+    if (len == 0 || buf == NULL || res == NULL) {
+        return -1;
+    }
+    for (uint8_t pos = 0; pos < len; ) {
+        uint8_t ad_len = buf[pos];
+        if (ad_len == 0) {
+            // zero length marks the end of the significant part
+            return -1;
+        }
+        if (ad_len > len - pos - 1) {
+            return -1;
+        }
+        uint8_t ad_type = buf[pos+1];
+        const uint8_t* data = &buf[pos+2];
+        uint8_t data_len = ad_len - 1;
+        pos += ad_len + 1;
+
+        switch (ad_type)
+        {
+            case EDDYSTONE_AD_TYPE_FLAG: {
+                if (data_len < 1) {
+                    return -1;
+                }
+                res->common.flags = data[0];
+                break;
+            }
+            case EDDYSTONE_AD_TYPE_16SRV_CMPL: {
+                if (!esp_eddystone_has_service_uuid(data, data_len)) {
+                    return -1;
+                }
+                res->common.srv_uuid = EDDYSTONE_SERVICE_UUID;
+                break;
+            }
+            case EDDYSTONE_AD_TYPE_SERVICE_DATA: {
+                // 16-bit UUID, frame type
+                if (data_len < 3) {
+                    return -1;
+                }
+                if (data[0] != (EDDYSTONE_SERVICE_UUID & 0xff) || data[1] != (EDDYSTONE_SERVICE_UUID >> 8)) {
+                    break;
+                }
+                uint8_t frame_type = data[2];
+                esp_eddystone_frame_handler_t handler = (frame_type & 0x0f) ? NULL : eddystone_frame_handlers[frame_type >> 4];
+                // set before the handler runs, a rejected frame still tells its type
+                res->common.srv_data_type = EDDYSTONE_SERVICE_UUID;
+                res->common.frame_type = frame_type;
+                if (handler == NULL) {
+                    return -1;
+                }
+                return handler(data + 3, data_len - 3, res);
+            }
+            default:
+                break;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Expand an encoded URL (scheme byte followed by the encoded characters)
+ * 
+ * @param encoded - As stored by esp_eddystone_decode()
+ * @param len - Length of encoded
+ * @param url - Destination, EDDYSTONE_URL_DECODED_MAX_LEN bytes
+ * @return size_t - Length of the URL, 0 if encoded is not a valid URL
+ */
+size_t esp_eddystone_url_expand(const uint8_t* encoded, uint8_t len, char* url)
+{
+    size_t pos = 0;
+
+    url[0] = '\0';
+    if (len == 0 || len > EDDYSTONE_URL_MAX_LEN || encoded[0] >= EDDYSTONE_URL_PREFIX_COUNT) {
+        return 0;
+    }
+    size_t n = strlen(eddystone_url_prefix[encoded[0]]);
+    memcpy(url, eddystone_url_prefix[encoded[0]], n);
+    pos += n;
+
+    for (uint8_t i = 1; i < len; i++) {
+        if (encoded[i] < EDDYSTONE_URL_ENCODING_COUNT) {
+            n = strlen(eddystone_url_encoding[encoded[i]]);
+            memcpy(&url[pos], eddystone_url_encoding[encoded[i]], n);
+            pos += n;
+        } else if (esp_eddystone_is_char_invalid(encoded[i])) {
+            url[0] = '\0';
+            return 0;
+        } else {
+            url[pos++] = encoded[i];
+        }
+    }
+    url[pos] = '\0';
+    return pos;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file eddystone_decoder.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the eddystone frame decoder.
+ *
+ *        Plain C with no ESP-IDF or Bluedroid dependency, so the decoder also
+ *        builds on a host compiler. test/host builds it with its unit tests and
+ *        fuzz harness.
+ * @version 1.0
+ * @date 2020-03-30
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef __EDDYSTONE_DECODER_H__
+#define __EDDYSTONE_DECODER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#else
+typedef int esp_err_t;
+#endif
+
+#include "eddystone_protocol.h"
+
+typedef struct {
+    struct {
+        uint8_t   flags;          /*<! AD flags data */
+        uint16_t  srv_uuid;       /*<! complete list of 16-bit service uuid*/
+        uint16_t  srv_data_type;  /*<! service data type */
+        uint8_t   frame_type;     /*<! Eddystone UID, URL or TLM */
+    } common;
+    union {
+        struct {
+            /*<! Eddystone-UID */
+            int8_t  ranging_data;     /*<! calibrated Tx power at 0m */
+            uint8_t namespace_id[10];
+            uint8_t instance_id[6];
+        } uid;
+        struct {
+            /*<! Eddystone-URL */
+            int8_t  tx_power;                    /*<! calibrated Tx power at 0m */
+            uint8_t len;                         /*<! length of encoded */
+            uint8_t encoded[EDDYSTONE_URL_MAX_LEN];  /*<! scheme byte then the encoded URL, see esp_eddystone_url_expand() */
+        } url;
+        struct {
+            /*<! Eddystone-TLM */
+            uint8_t   version;           /*<! TLM version,0x00 for now */
+            uint16_t  battery_voltage;   /*<! battery voltage in mV */
+            int16_t   temperature;       /*<! beacon temperature in degrees Celsius, 8.8 fixed point */
+            uint32_t  adv_count;         /*<! adv pdu count since power-up */
+            uint32_t  time;              /*<! time since power-up, a 0.1 second resolution counter */
+        } tlm;
+    } inform;
+} esp_eddystone_result_t;
+
+/* Utils */
+static inline uint16_t little_endian_read_16(const uint8_t *buffer, uint8_t pos)
+{
+    return ((uint16_t)buffer[pos]) | (((uint16_t)buffer[(pos)+1]) << 8);
+}
+
+static inline uint16_t big_endian_read_16(const uint8_t *buffer, uint8_t pos)
+{
+    return (((uint16_t)buffer[pos]) << 8) | ((uint16_t)buffer[(pos)+1]);
+}
+
+static inline uint32_t big_endian_read_32(const uint8_t *buffer, uint8_t pos)
+{
+    return (((uint32_t)buffer[pos]) << 24) | (((uint32_t)buffer[(pos)+1]) << 16) | (((uint32_t)buffer[(pos)+2]) << 8) | ((uint32_t)buffer[(pos)+3]);
+}
+
+/* Public funtions */ 
+esp_err_t esp_eddystone_decode(const uint8_t* buf, uint8_t len, esp_eddystone_result_t* res);
+size_t esp_eddystone_url_expand(const uint8_t* encoded, uint8_t len, char* url);
+
+#endif /* __EDDYSTONE_DECODER_H__ */
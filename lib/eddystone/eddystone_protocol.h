@@ -18,6 +18,11 @@
 /* Eddystone definitions */
 #define EDDYSTONE_SERVICE_UUID          0xFEAA
 
+/* AD structure types, as in the Bluetooth assigned numbers */
+#define EDDYSTONE_AD_TYPE_FLAG          0x01
+#define EDDYSTONE_AD_TYPE_16SRV_CMPL    0x03
+#define EDDYSTONE_AD_TYPE_SERVICE_DATA  0x16
+
 #define EDDYSTONE_FRAME_TYPE_UID        0x00
 #define EDDYSTONE_FRAME_TYPE_URL        0x10
 #define EDDYSTONE_FRAME_TYPE_TLM        0x20
@@ -34,6 +39,7 @@
 #define EDDYSTONE_TLM_TEMPERATURE_LEN      2
 #define EDDYSTONE_TLM_ADV_COUNT_LEN        4
 #define EDDYSTONE_TLM_TIME_LEN             4
+#define EDDYSTONE_TLM_TEMP_UNSUPPORTED     ((int16_t)0x8000)   /* -128 C, the beacon has no temperature sensor */
 #define EDDYSTONE_TLM_DATA_LEN             (EDDYSTONE_TLM_VERSION_LEN + EDDYSTONE_TLM_BATTERY_VOLTAGE_LEN + \
 EDDYSTONE_TLM_TEMPERATURE_LEN + EDDYSTONE_TLM_ADV_COUNT_LEN + EDDYSTONE_TLM_TIME_LEN)           
 //URL
@@ -41,6 +47,12 @@ EDDYSTONE_TLM_TEMPERATURE_LEN + EDDYSTONE_TLM_ADV_COUNT_LEN + EDDYSTONE_TLM_TIME
 #define EDDYSTONE_URL_ENCODED_MAX_LEN   17
 #define EDDYSTONE_URL_MAX_LEN           (EDDYSTONE_URL_SCHEME_LEN + EDDYSTONE_URL_ENCODED_MAX_LEN)
 #define EDDYSTONE_URL_TX_POWER_LEN      1
+#define EDDYSTONE_URL_PREFIX_COUNT      4
+#define EDDYSTONE_URL_ENCODING_COUNT    14
+#define EDDYSTONE_URL_PREFIX_MAX_LEN    12      /* "https://www." */
+#define EDDYSTONE_URL_EXPANSION_MAX_LEN 6       /* ".info/" */
+#define EDDYSTONE_URL_DECODED_MAX_LEN   (EDDYSTONE_URL_PREFIX_MAX_LEN + \
+EDDYSTONE_URL_ENCODED_MAX_LEN * EDDYSTONE_URL_EXPANSION_MAX_LEN + 1)
 
 
 /* Eddystone UID frame */
@@ -0,0 +1,410 @@
+/**
+ * @file eddystone_registry.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the table of tracked eddystone beacons.
+ *
+ *        Beacons live in a fixed pool of EDDY_REGISTRY_SIZE entries. A separate
+ *        open addressing index (linear probing, twice the pool size) maps a BDA
+ *        to its pool entry, and a doubly linked list threaded through the pool
+ *        keeps the entries ordered by last reception so the least recently seen
+ *        beacon can be expired or evicted in O(1). Nothing is allocated after boot.
+ *
+ *        The index and the list are only used by the writer. Readers walk the
+ *        pool itself and copy each entry under its seqlock (write_seq is odd
+ *        while the writer is changing the entry).
+ * @version 1.0
+ * @date 2020-03-20
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "eddystone_registry.h"
+
+static esp_eddystone_beacon_t registry_pool[EDDY_REGISTRY_SIZE];
+static uint16_t registry_index[EDDY_REGISTRY_INDEX_SIZE];
+static uint16_t registry_head = EDDY_REGISTRY_NONE;    /* most recently seen */
+static uint16_t registry_tail = EDDY_REGISTRY_NONE;    /* least recently seen */
+static uint16_t registry_free = EDDY_REGISTRY_NONE;
+static uint16_t registry_count = 0;
+static uint32_t registry_seq = 0;           /* bumped on every change */
+static uint32_t registry_removed_seq = 0;   /* registry_seq at the last expiry or eviction */
+
+static inline void esp_eddystone_registry_write_begin(esp_eddystone_beacon_t* b)
+{
+    __atomic_store_n(&b->write_seq, b->write_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void esp_eddystone_registry_write_end(esp_eddystone_beacon_t* b)
+{
+    __atomic_store_n(&b->write_seq, b->write_seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief FNV-1a hash of a BDA, reduced to an index slot
+ *
+ * @param bda
+ * @return uint16_t
+ */
+static inline uint16_t esp_eddystone_registry_hash(const uint8_t* bda)
+{
+    uint32_t h = 2166136261u;
+    for(int i=0; i<ESP_BD_ADDR_LEN; i++) {
+        h = (h ^ bda[i]) * 16777619u;
+    }
+    return (uint16_t)((h ^ (h >> 16)) & (EDDY_REGISTRY_INDEX_SIZE - 1));
+}
+
+/**
+ * @brief Find the index slot holding a BDA
+ *
+ * @param bda
+ * @return uint16_t - The index slot, or EDDY_REGISTRY_NONE
+ */
+static uint16_t esp_eddystone_registry_lookup(const uint8_t* bda)
+{
+    uint16_t pos = esp_eddystone_registry_hash(bda);
+    while(registry_index[pos] != EDDY_REGISTRY_NONE) {
+        if(!memcmp(registry_pool[registry_index[pos]].bda, bda, ESP_BD_ADDR_LEN)) {
+            return pos;
+        }
+        pos = (pos + 1) & (EDDY_REGISTRY_INDEX_SIZE - 1);
+    }
+    return EDDY_REGISTRY_NONE;
+}
+
+/**
+ * @brief Remove an index slot, shifting back the following entries of the probe
+ *        sequence so lookups never need tombstones
+ *
+ * @param pos
+ */
+static void esp_eddystone_registry_index_remove(uint16_t pos)
+{
+    uint16_t next = pos;
+    registry_index[pos] = EDDY_REGISTRY_NONE;
+    for(;;) {
+        next = (next + 1) & (EDDY_REGISTRY_INDEX_SIZE - 1);
+        if(registry_index[next] == EDDY_REGISTRY_NONE) {
+            return;
+        }
+        uint16_t home = esp_eddystone_registry_hash(registry_pool[registry_index[next]].bda);
+        /* keep the entry in place when its home lies cyclically in (pos, next] */
+        bool in_place = (pos <= next) ? (home > pos && home <= next) : (home > pos || home <= next);
+        if(!in_place) {
+            registry_index[pos] = registry_index[next];
+            registry_index[next] = EDDY_REGISTRY_NONE;
+            pos = next;
+        }
+    }
+}
+
+static void esp_eddystone_registry_unlink(uint16_t entry)
+{
+    esp_eddystone_beacon_t* b = &registry_pool[entry];
+    if(b->lru_prev != EDDY_REGISTRY_NONE) {
+        registry_pool[b->lru_prev].lru_next = b->lru_next;
+    } else {
+        registry_head = b->lru_next;
+    }
+    if(b->lru_next != EDDY_REGISTRY_NONE) {
+        registry_pool[b->lru_next].lru_prev = b->lru_prev;
+    } else {
+        registry_tail = b->lru_prev;
+    }
+}
+
+static void esp_eddystone_registry_push_front(uint16_t entry)
+{
+    esp_eddystone_beacon_t* b = &registry_pool[entry];
+    b->lru_prev = EDDY_REGISTRY_NONE;
+    b->lru_next = registry_head;
+    if(registry_head != EDDY_REGISTRY_NONE) {
+        registry_pool[registry_head].lru_prev = entry;
+    }
+    registry_head = entry;
+    if(registry_tail == EDDY_REGISTRY_NONE) {
+        registry_tail = entry;
+    }
+}
+
+/**
+ * @brief Drop an entry from the index and the LRU list and return it to the free list
+ *
+ * @param entry
+ */
+static void esp_eddystone_registry_remove(uint16_t entry)
+{
+    uint16_t pos = esp_eddystone_registry_lookup(registry_pool[entry].bda);
+    if(pos != EDDY_REGISTRY_NONE) {
+        esp_eddystone_registry_index_remove(pos);
+    }
+    esp_eddystone_registry_unlink(entry);
+    esp_eddystone_registry_write_begin(&registry_pool[entry]);
+    registry_pool[entry].frame_count = 0;   /* marks the entry free */
+    esp_eddystone_registry_write_end(&registry_pool[entry]);
+    registry_pool[entry].lru_next = registry_free;
+    registry_free = entry;
+    registry_count--;
+    registry_removed_seq = ++registry_seq;
+}
+
+/**
+ * @brief Reset the registry, must be called before scanning starts
+ *
+ */
+void esp_eddystone_registry_init(void)
+{
+    memset(registry_pool, 0, sizeof(registry_pool));
+    for(int i=0; i<EDDY_REGISTRY_INDEX_SIZE; i++) {
+        registry_index[i] = EDDY_REGISTRY_NONE;
+    }
+    for(int i=0; i<EDDY_REGISTRY_SIZE; i++) {
+        registry_pool[i].lru_next = (i + 1 < EDDY_REGISTRY_SIZE) ? i + 1 : EDDY_REGISTRY_NONE;
+    }
+    registry_free = 0;
+    registry_head = EDDY_REGISTRY_NONE;
+    registry_tail = EDDY_REGISTRY_NONE;
+    registry_count = 0;
+    registry_seq = 0;
+    registry_removed_seq = 0;
+}
+
+/**
+ * @brief Drop every beacon not heard for EDDY_REGISTRY_EXPIRE_MS
+ *
+ * @param now - ms since boot
+ */
+void esp_eddystone_registry_expire(uint32_t now)
+{
+    while(registry_tail != EDDY_REGISTRY_NONE &&
+          (now - registry_pool[registry_tail].last_seen) > EDDY_REGISTRY_EXPIRE_MS) {
+        esp_eddystone_registry_remove(registry_tail);
+    }
+}
+
+/**
+ * @brief Merge a decoded frame into the entry of its device, creating the entry
+ *        (and evicting the least recently seen beacon when full) if needed
+ *
+ * @param bda - Device address
+ * @param rssi - RSSI of the packet
+ * @param res - Decoded eddystone frame
+ * @return const esp_eddystone_beacon_t* - The updated entry
+ */
+const esp_eddystone_beacon_t* esp_eddystone_registry_update(const uint8_t* bda, int8_t rssi, const esp_eddystone_result_t* res)
+{
+    uint32_t now = esp_eddystone_registry_now();
+    uint16_t entry;
+
+    esp_eddystone_registry_expire(now);
+
+    uint16_t pos = esp_eddystone_registry_lookup(bda);
+    if(pos != EDDY_REGISTRY_NONE) {
+        entry = registry_index[pos];
+        esp_eddystone_registry_unlink(entry);
+    } else {
+        if(registry_free == EDDY_REGISTRY_NONE) {
+            esp_eddystone_registry_remove(registry_tail);
+        }
+        entry = registry_free;
+        registry_free = registry_pool[entry].lru_next;
+        esp_eddystone_beacon_t* b = &registry_pool[entry];
+        esp_eddystone_registry_write_begin(b);
+        memset(b, 0, offsetof(esp_eddystone_beacon_t, write_seq));   /* keeps the seqlock */
+        memcpy(b->bda, bda, ESP_BD_ADDR_LEN);
+        b->first_seen = now;
+        esp_eddystone_registry_write_end(b);
+
+        pos = esp_eddystone_registry_hash(bda);
+        while(registry_index[pos] != EDDY_REGISTRY_NONE) {
+            pos = (pos + 1) & (EDDY_REGISTRY_INDEX_SIZE - 1);
+        }
+        registry_index[pos] = entry;
+        registry_count++;
+    }
+    esp_eddystone_registry_push_front(entry);
+
+    esp_eddystone_beacon_t* b = &registry_pool[entry];
+    esp_eddystone_registry_write_begin(b);
+    b->rssi = rssi;
+    b->last_seen = now;
+    b->frame_count++;
+    b->seq = ++registry_seq;
+    switch(res->common.frame_type)
+    {
+        case EDDYSTONE_FRAME_TYPE_UID: {
+            b->frames |= EDDY_FRAME_UID_SEEN;
+            b->uid.ranging_data = res->inform.uid.ranging_data;
+            memcpy(b->uid.namespace_id, res->inform.uid.namespace_id, EDDYSTONE_UID_NAMESPACE_LEN);
+            memcpy(b->uid.instance_id, res->inform.uid.instance_id, EDDYSTONE_UID_INSTANCE_LEN);
+            break;
+        }
+        case EDDYSTONE_FRAME_TYPE_URL: {
+            b->frames |= EDDY_FRAME_URL_SEEN;
+            b->url.tx_power = res->inform.url.tx_power;
+            b->url.len = res->inform.url.len;
+            memcpy(b->url.encoded, res->inform.url.encoded, res->inform.url.len);
+            break;
+        }
+        case EDDYSTONE_FRAME_TYPE_TLM: {
+            b->frames |= EDDY_FRAME_TLM_SEEN;
+            b->tlm.version = res->inform.tlm.version;
+            b->tlm.battery_voltage = res->inform.tlm.battery_voltage;
+            b->tlm.temperature = res->inform.tlm.temperature;
+            b->tlm.adv_count = res->inform.tlm.adv_count;
+            b->tlm.time = res->inform.tlm.time;
+            break;
+        }
+        default:
+            break;
+    }
+
+    /* both frames carry the calibrated power at 0 m, UID ranging data is preferred */
+    esp_eddystone_rssi_update(&b->rssi_filter, rssi);
+    if(b->frames & EDDY_FRAME_UID_SEEN) {
+        b->distance = esp_eddystone_rssi_distance(b->rssi_filter.rssi, b->uid.ranging_data);
+    } else if(b->frames & EDDY_FRAME_URL_SEEN) {
+        b->distance = esp_eddystone_rssi_distance(b->rssi_filter.rssi, b->url.tx_power);
+    } else {
+        b->distance = EDDY_RSSI_DISTANCE_NONE;
+    }
+    esp_eddystone_registry_write_end(b);
+    return b;
+}
+
+/**
+ * @brief Get the entry of a device
+ *
+ * @param bda
+ * @return const esp_eddystone_beacon_t* - The entry, or NULL if the device is not tracked
+ */
+const esp_eddystone_beacon_t* esp_eddystone_registry_find(const uint8_t* bda)
+{
+    uint16_t pos = esp_eddystone_registry_lookup(bda);
+    return (pos == EDDY_REGISTRY_NONE) ? NULL : &registry_pool[registry_index[pos]];
+}
+
+/**
+ * @brief Get the most recently seen beacon
+ *
+ * @return const esp_eddystone_beacon_t* - The entry, or NULL if the registry is empty
+ */
+const esp_eddystone_beacon_t* esp_eddystone_registry_latest(void)
+{
+    return (registry_head == EDDY_REGISTRY_NONE) ? NULL : &registry_pool[registry_head];
+}
+
+/**
+ * @brief Copy an entry by its position in the pool, consistent even while the
+ *        decoder task is updating it
+ *
+ * @param index - 0 to EDDY_REGISTRY_SIZE - 1
+ * @param copy
+ * @return bool - false if the position is free
+ */
+bool esp_eddystone_registry_read(uint16_t index, esp_eddystone_beacon_t* copy)
+{
+    if(index >= EDDY_REGISTRY_SIZE) {
+        return false;
+    }
+    const esp_eddystone_beacon_t* b = &registry_pool[index];
+    uint32_t before, after;
+    do {
+        before = __atomic_load_n(&b->write_seq, __ATOMIC_ACQUIRE);
+        if(before & 1) {
+            continue;
+        }
+        memcpy(copy, b, sizeof(esp_eddystone_beacon_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&b->write_seq, __ATOMIC_RELAXED);
+        if(before == after) {
+            break;
+        }
+    } while(1);
+    return copy->frame_count != 0;
+}
+
+/**
+ * @brief Copy the entry of a device
+ *
+ * @param bda
+ * @param copy
+ * @return bool - false if the device is not tracked
+ */
+bool esp_eddystone_registry_read_bda(const uint8_t* bda, esp_eddystone_beacon_t* copy)
+{
+    for(uint16_t i=0; i<EDDY_REGISTRY_SIZE; i++) {
+        if(esp_eddystone_registry_read(i, copy) && !memcmp(copy->bda, bda, ESP_BD_ADDR_LEN)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Copy the most recently seen beacon
+ *
+ * @param copy
+ * @return bool - false if the registry is empty
+ */
+bool esp_eddystone_registry_read_latest(esp_eddystone_beacon_t* copy)
+{
+    uint16_t head = __atomic_load_n(&registry_head, __ATOMIC_ACQUIRE);
+    return head != EDDY_REGISTRY_NONE && esp_eddystone_registry_read(head, copy);
+}
+
+/**
+ * @brief Get the sequence number of the last change, entries with a greater
+ *        seq than a previous value of it changed since
+ *
+ * @return uint32_t
+ */
+uint32_t esp_eddystone_registry_seq(void)
+{
+    return registry_seq;
+}
+
+/**
+ * @brief Get the sequence number of the last beacon removal, a client that
+ *        synced before it needs the whole table again
+ *
+ * @return uint32_t
+ */
+uint32_t esp_eddystone_registry_removed_seq(void)
+{
+    return registry_removed_seq;
+}
+
+uint16_t esp_eddystone_registry_count(void)
+{
+    return registry_count;
+}
+
+/**
+ * @brief Get the position of an entry in the pool, stable while the beacon is tracked
+ *
+ * @param beacon
+ * @return uint16_t
+ */
+uint16_t esp_eddystone_registry_index(const esp_eddystone_beacon_t* beacon)
+{
+    return (uint16_t)(beacon - registry_pool);
+}
+
+/**
+ * @brief Call cb with a copy of every tracked beacon, in pool order
+ *
+ * @param cb
+ * @param ctx - Passed to cb
+ */
+void esp_eddystone_registry_foreach(esp_eddystone_registry_cb_t cb, void* ctx)
+{
+    esp_eddystone_beacon_t copy;
+    for(uint16_t i=0; i<EDDY_REGISTRY_SIZE; i++) {
+        if(esp_eddystone_registry_read(i, &copy)) {
+            cb(&copy, ctx);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+/**
+ * @file eddystone_registry.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the table of tracked eddystone beacons.
+ *
+ *        Only the decoder task writes the table. Other tasks read it through the
+ *        esp_eddystone_registry_read*() and foreach functions, which copy entries
+ *        under a per entry seqlock: the writer never waits, a reader that raced
+ *        with it retries the copy. tools/eddystone_registry_stress.c checks
+ *        that on Linux with concurrent writer and reader threads.
+ * @version 1.0
+ * @date 2020-03-20
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __EDDYSTONE_REGISTRY_H__
+#define __EDDYSTONE_REGISTRY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "esp_bt_defs.h"
+#include "eddystone_decoder.h"
+#include "eddystone_rssi.h"
+
+#define EDDY_REGISTRY_SIZE          256                         /* max tracked beacons */
+#define EDDY_REGISTRY_INDEX_SIZE    (EDDY_REGISTRY_SIZE * 2)    /* hash index slots, power of two */
+#define EDDY_REGISTRY_EXPIRE_MS     (5 * 60 * 1000)             /* drop beacons not heard for 5 min */
+#define EDDY_REGISTRY_NONE          0xFFFF
+
+/* Bits of esp_eddystone_beacon_t.frames */
+#define EDDY_FRAME_UID_SEEN         (1 << 0)
+#define EDDY_FRAME_URL_SEEN         (1 << 1)
+#define EDDY_FRAME_TLM_SEEN         (1 << 2)
+
+/* Merged state of every frame received from one device */
+typedef struct {
+    uint8_t   bda[ESP_BD_ADDR_LEN];   /*<! device address, table key */
+    uint8_t   frames;                 /*<! EDDY_FRAME_*_SEEN bitmask */
+    int8_t    rssi;                   /*<! RSSI of the last received packet */
+    esp_eddystone_rssi_filter_t rssi_filter;    /*<! filtered RSSI */
+    uint32_t  distance;               /*<! meters 8.8, EDDY_RSSI_DISTANCE_NONE until a calibrated power is known */
+    uint32_t  first_seen;             /*<! ms since boot of the first frame */
+    uint32_t  last_seen;              /*<! ms since boot of the last frame */
+    uint32_t  frame_count;            /*<! eddystone frames received */
+    uint32_t  seq;                    /*<! registry sequence number of the last change */
+    struct {
+        int8_t  ranging_data;         /*<! calibrated Tx power at 0m */
+        uint8_t namespace_id[EDDYSTONE_UID_NAMESPACE_LEN];
+        uint8_t instance_id[EDDYSTONE_UID_INSTANCE_LEN];
+    } uid;
+    struct {
+        int8_t  tx_power;             /*<! calibrated Tx power at 0m */
+        uint8_t len;
+        uint8_t encoded[EDDYSTONE_URL_MAX_LEN];   /*<! see esp_eddystone_url_expand() */
+    } url;
+    struct {
+        uint8_t   version;
+        uint16_t  battery_voltage;    /*<! mV */
+        int16_t   temperature;        /*<! degrees Celsius, 8.8 fixed point */
+        uint32_t  adv_count;
+        uint32_t  time;               /*<! 0.1 s resolution */
+    } tlm;
+    uint32_t  write_seq;              /*<! seqlock over the fields above, odd while they are being written */
+    uint16_t  lru_prev;               /*<! more recently seen entry */
+    uint16_t  lru_next;               /*<! less recently seen entry, or next free entry */
+} esp_eddystone_beacon_t;
+
+typedef void (*esp_eddystone_registry_cb_t)(const esp_eddystone_beacon_t* beacon, void* ctx);
+
+/* Public funtions, writer side (decoder task only) */
+void esp_eddystone_registry_init(void);
+const esp_eddystone_beacon_t* esp_eddystone_registry_update(const uint8_t* bda, int8_t rssi, const esp_eddystone_result_t* res);
+const esp_eddystone_beacon_t* esp_eddystone_registry_find(const uint8_t* bda);
+const esp_eddystone_beacon_t* esp_eddystone_registry_latest(void);
+uint16_t esp_eddystone_registry_index(const esp_eddystone_beacon_t* beacon);
+void esp_eddystone_registry_expire(uint32_t now);
+
+/* Public funtions, reader side (any task) */
+bool esp_eddystone_registry_read(uint16_t index, esp_eddystone_beacon_t* copy);
+bool esp_eddystone_registry_read_bda(const uint8_t* bda, esp_eddystone_beacon_t* copy);
+bool esp_eddystone_registry_read_latest(esp_eddystone_beacon_t* copy);
+void esp_eddystone_registry_foreach(esp_eddystone_registry_cb_t cb, void* ctx);
+uint16_t esp_eddystone_registry_count(void);
+uint32_t esp_eddystone_registry_seq(void);
+uint32_t esp_eddystone_registry_removed_seq(void);
+
+static inline uint32_t esp_eddystone_registry_now(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+#endif /* __EDDYSTONE_REGISTRY_H__ */
@@ -0,0 +1,104 @@
+/**
+ * @file eddystone_ring.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the ring of raw advertisements waiting to be decoded.
+ * @version 1.0
+ * @date 2020-03-22
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "eddystone_ring.h"
+
+static esp_eddystone_adv_t ring_buf[EDDY_RING_SIZE];
+static uint32_t ring_head = 0;     /* next slot to write, producer owned */
+static uint32_t ring_tail = 0;     /* next slot to read, consumer owned */
+static uint32_t ring_pushed = 0;
+static uint32_t ring_dropped = 0;
+static uint32_t ring_high_water = 0;
+
+/**
+ * @brief Copy an advertisement into the ring. Producer side, never blocks.
+ *
+ * @param bda - Device address
+ * @param rssi
+ * @param adv - Advertising data
+ * @param adv_len - Bytes in adv, truncated to EDDY_RING_ADV_MAX
+ * @param timestamp - ms since boot
+ * @return true - The advertisement was queued
+ * @return false - The ring was full and the advertisement was dropped
+ */
+bool esp_eddystone_ring_push(const uint8_t* bda, int8_t rssi, const uint8_t* adv, uint8_t adv_len, uint32_t timestamp)
+{
+    uint32_t head = ring_head;
+    uint32_t used = head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+
+    if (used >= EDDY_RING_SIZE) {
+        ring_dropped++;
+        return false;
+    }
+
+    esp_eddystone_adv_t* slot = &ring_buf[head & (EDDY_RING_SIZE - 1)];
+    if (adv_len > EDDY_RING_ADV_MAX) {
+        adv_len = EDDY_RING_ADV_MAX;
+    }
+    slot->timestamp = timestamp;
+    memcpy(slot->bda, bda, ESP_BD_ADDR_LEN);
+    slot->rssi = rssi;
+    slot->adv_len = adv_len;
+    memcpy(slot->adv, adv, adv_len);
+
+    /* publish the slot only once it is completely written */
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+
+    ring_pushed++;
+    if (used + 1 > ring_high_water) {
+        ring_high_water = used + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Number of advertisements ready for the consumer
+ *
+ * @return uint32_t
+ */
+uint32_t esp_eddystone_ring_available(void)
+{
+    return __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) - ring_tail;
+}
+
+/**
+ * @brief Get a queued advertisement without removing it. Consumer side.
+ *
+ * @param i - Position from the oldest queued advertisement, below esp_eddystone_ring_available()
+ * @return const esp_eddystone_adv_t*
+ */
+const esp_eddystone_adv_t* esp_eddystone_ring_at(uint32_t i)
+{
+    return &ring_buf[(ring_tail + i) & (EDDY_RING_SIZE - 1)];
+}
+
+/**
+ * @brief Give the oldest count advertisements back to the producer. Consumer side.
+ *
+ * @param count
+ */
+void esp_eddystone_ring_release(uint32_t count)
+{
+    __atomic_store_n(&ring_tail, ring_tail + count, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Read the ring counters, used to size EDDY_RING_SIZE
+ *
+ * @param stats
+ */
+void esp_eddystone_ring_get_stats(esp_eddystone_ring_stats_t* stats)
+{
+    stats->pushed = ring_pushed;
+    stats->dropped = ring_dropped;
+    stats->high_water = ring_high_water;
+    stats->size = EDDY_RING_SIZE;
+}
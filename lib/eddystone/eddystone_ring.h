@@ -0,0 +1,51 @@
+/**
+ * @file eddystone_ring.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the ring of raw advertisements waiting to be decoded.
+ *
+ *        Single producer (the GAP callback) / single consumer (the decoder task),
+ *        lock free. The producer only moves head and the consumer only moves tail,
+ *        so no lock is needed as long as each side stays on its own task.
+ * @version 1.0
+ * @date 2020-03-22
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __EDDYSTONE_RING_H__
+#define __EDDYSTONE_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_gap_ble_api.h"
+
+#define EDDY_RING_SIZE      64      /* queued advertisements, power of two */
+#define EDDY_RING_ADV_MAX   ESP_BLE_ADV_DATA_LEN_MAX
+
+/* Raw advertisement as copied from the scan result */
+typedef struct {
+    uint32_t  timestamp;                /*<! ms since boot at reception */
+    uint8_t   bda[ESP_BD_ADDR_LEN];
+    int8_t    rssi;
+    uint8_t   adv_len;
+    uint8_t   adv[EDDY_RING_ADV_MAX];
+} esp_eddystone_adv_t;
+
+typedef struct {
+    uint32_t  pushed;       /*<! advertisements queued */
+    uint32_t  dropped;      /*<! advertisements lost because the ring was full */
+    uint32_t  high_water;   /*<! max advertisements queued at once */
+    uint32_t  size;         /*<! ring capacity */
+} esp_eddystone_ring_stats_t;
+
+/* Public funtions */
+bool esp_eddystone_ring_push(const uint8_t* bda, int8_t rssi, const uint8_t* adv, uint8_t adv_len, uint32_t timestamp);
+uint32_t esp_eddystone_ring_available(void);
+const esp_eddystone_adv_t* esp_eddystone_ring_at(uint32_t i);
+void esp_eddystone_ring_release(uint32_t count);
+void esp_eddystone_ring_get_stats(esp_eddystone_ring_stats_t* stats);
+
+#endif /* __EDDYSTONE_RING_H__ */
@@ -0,0 +1,85 @@
+/**
+ * @file eddystone_rssi.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the RSSI filter and distance estimation.
+ * @version 1.0
+ * @date 2020-04-06
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "eddystone_rssi.h"
+
+#define EDDY_RSSI_LOG2_10_Q12   13607       /* log2(10) in 4.12 */
+
+/* 2^(i/16) for i = 0..16, 16.16 fixed point */
+static const uint32_t eddy_rssi_exp2_table[17] = {
+    65536, 68438, 71468, 74632, 77936, 81386, 84990, 88752, 92682,
+    96785, 101070, 105545, 110218, 115098, 120194, 125515, 131072
+};
+
+/**
+ * @brief Feed one RSSI reading to the filter
+ *
+ * @param filter
+ * @param rssi - dBm
+ */
+void esp_eddystone_rssi_update(esp_eddystone_rssi_filter_t* filter, int8_t rssi)
+{
+    int32_t z = (int32_t)rssi * (1 << EDDY_RSSI_Q);
+
+    if (filter->variance == 0) {
+        filter->rssi = z;
+        filter->variance = EDDY_RSSI_MEASURE_NOISE;
+        return;
+    }
+    /* predict: the beacon may have moved */
+    int32_t p = filter->variance + EDDY_RSSI_PROCESS_NOISE;
+    /* update: gain in 4.12 */
+    int32_t k = (p << 12) / (p + EDDY_RSSI_MEASURE_NOISE);
+    filter->rssi += (k * (z - filter->rssi)) >> 12;
+    filter->variance = ((4096 - k) * p) >> 12;
+    if (filter->variance == 0) {
+        filter->variance = 1;
+    }
+}
+
+/**
+ * @brief 2^x
+ *
+ * @param x - 8.8 fixed point
+ * @return uint32_t - 8.8 fixed point, saturated
+ */
+static uint32_t esp_eddystone_rssi_exp2(int32_t x)
+{
+    int32_t i = x >> 8;                 /* floor, also for negative x */
+    uint32_t f = x & 0xff;
+    uint32_t lo = eddy_rssi_exp2_table[f >> 4];
+    uint32_t hi = eddy_rssi_exp2_table[(f >> 4) + 1];
+    uint32_t mantissa = lo + (((hi - lo) * (f & 0xf)) >> 4);   /* 16.16, 1.0 to 2.0 */
+
+    /* mantissa * 2^i, from 16.16 to 8.8 */
+    i -= 8;
+    if (i >= 0) {
+        return (i > 15) ? UINT32_MAX : mantissa << i;
+    }
+    return (i < -31) ? 0 : mantissa >> -i;
+}
+
+/**
+ * @brief Estimate the distance of a beacon
+ *
+ * @param rssi - Filtered RSSI, dBm 8.8
+ * @param power_0m - Calibrated power at 0 m, dBm
+ * @return uint32_t - meters 8.8, at most EDDY_RSSI_DISTANCE_MAX
+ */
+uint32_t esp_eddystone_rssi_distance(int32_t rssi, int8_t power_0m)
+{
+    int32_t loss = ((int32_t)power_0m - EDDY_RSSI_LOSS_AT_1M) * (1 << EDDY_RSSI_Q) - rssi;   /* dB 8.8 */
+    int32_t exp10 = loss * (1 << EDDY_RSSI_Q) / (10 * EDDY_RSSI_PATH_LOSS_EXP);            /* 8.8 */
+    int32_t exp2 = (exp10 * EDDY_RSSI_LOG2_10_Q12) >> 12;                                  /* 8.8 */
+    uint32_t distance = esp_eddystone_rssi_exp2(exp2);
+
+    return (distance > EDDY_RSSI_DISTANCE_MAX) ? EDDY_RSSI_DISTANCE_MAX : distance;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file eddystone_rssi.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the RSSI filter and distance estimation.
+ *
+ *        Each beacon keeps a scalar Kalman filter over its RSSI, and its
+ *        distance follows from the log-distance path loss model:
+ *            d = 10 ^ ((P1m - RSSI) / (10 * n))
+ *        with P1m the calibrated power at 0 m (UID ranging data or URL
+ *        Tx power) minus 41 dB. Integer math only, values are 8.8 fixed point.
+ *        Plain C with no ESP-IDF dependency.
+ * @version 1.0
+ * @date 2020-04-06
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __EDDYSTONE_RSSI_H__
+#define __EDDYSTONE_RSSI_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EDDY_RSSI_Q                 8                   /* fractional bits of the fixed point values */
+#define EDDY_RSSI_PROCESS_NOISE     (1 << EDDY_RSSI_Q)  /* dB^2 added per sample, how fast the filter follows movement */
+#define EDDY_RSSI_MEASURE_NOISE     (16 << EDDY_RSSI_Q) /* dB^2, variance of a single RSSI reading */
+#define EDDY_RSSI_LOSS_AT_1M        41                  /* dB between the 0 m calibration and 1 m */
+#define EDDY_RSSI_PATH_LOSS_EXP     (2 << EDDY_RSSI_Q)  /* n, 2.0 in free space, 2.7 to 4 indoors */
+#define EDDY_RSSI_DISTANCE_MAX      (1000 << EDDY_RSSI_Q) /* estimates are clamped to 1 km */
+#define EDDY_RSSI_DISTANCE_NONE     UINT32_MAX          /* no calibrated power received yet */
+
+/* Filter state, fixed size per beacon */
+typedef struct {
+    int32_t   rssi;         /*<! filtered RSSI, dBm 8.8 */
+    int32_t   variance;     /*<! estimate variance, dB^2 8.8, 0 before the first sample */
+} esp_eddystone_rssi_filter_t;
+
+/* Public funtions */
+void esp_eddystone_rssi_update(esp_eddystone_rssi_filter_t* filter, int8_t rssi);
+uint32_t esp_eddystone_rssi_distance(int32_t rssi, int8_t power_0m);
+
+#endif /* __EDDYSTONE_RSSI_H__ */
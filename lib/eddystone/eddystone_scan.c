@@ -0,0 +1,506 @@
+/**
+ * @file eddystone_scan.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the BLE scan profiles.
+ *
+ *        Scan parameters can only change while the controller is not scanning,
+ *        so a profile change (or a duplicate cache reset) stops the scan and the
+ *        GAP events drive the rest: stop complete -> set params -> params set ->
+ *        start scanning. Duty cycle changes take the same path.
+ * @version 1.0
+ * @date 2020-04-01
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "eddystone_scan.h"
+
+static const esp_eddystone_scan_config_t eddy_scan_configs[EDDY_SCAN_PROFILE_COUNT] = {
+    [EDDY_SCAN_PROFILE_ALL] = {
+        .name           = "all",
+        .scan_type      = BLE_SCAN_TYPE_ACTIVE,
+        .filter_policy  = BLE_SCAN_FILTER_ALLOW_ALL,
+        .duplicate      = BLE_SCAN_DUPLICATE_DISABLE,
+        .dup_reset_ms   = 0
+    },
+    [EDDY_SCAN_PROFILE_PASSIVE] = {
+        .name           = "passive",
+        .scan_type      = BLE_SCAN_TYPE_PASSIVE,
+        .filter_policy  = BLE_SCAN_FILTER_ALLOW_ALL,
+        .duplicate      = BLE_SCAN_DUPLICATE_DISABLE,
+        .dup_reset_ms   = 0
+    },
+    [EDDY_SCAN_PROFILE_DEDUP] = {
+        .name           = "dedup",
+        .scan_type      = BLE_SCAN_TYPE_PASSIVE,
+        .filter_policy  = BLE_SCAN_FILTER_ALLOW_ALL,
+        .duplicate      = BLE_SCAN_DUPLICATE_ENABLE,
+        .dup_reset_ms   = 10000
+    },
+    [EDDY_SCAN_PROFILE_WHITELIST] = {
+        .name           = "whitelist",
+        .scan_type      = BLE_SCAN_TYPE_PASSIVE,
+        .filter_policy  = BLE_SCAN_FILTER_ALLOW_ONLY_WLST,
+        .duplicate      = BLE_SCAN_DUPLICATE_DISABLE,
+        .dup_reset_ms   = 0
+    }
+};
+
+static portMUX_TYPE eddy_scan_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_eddystone_scan_profile_t eddy_scan_profile = EDDY_SCAN_DEFAULT_PROFILE;  /* requested */
+static esp_eddystone_scan_profile_t eddy_scan_applied = EDDY_SCAN_DEFAULT_PROFILE;  /* set in the controller */
+static esp_eddystone_scan_counters_t eddy_scan_counters[EDDY_SCAN_PROFILE_COUNT];
+static uint8_t eddy_scan_whitelist[EDDY_SCAN_WHITELIST_SIZE][ESP_BD_ADDR_LEN];
+static int eddy_scan_whitelist_count = 0;
+static bool eddy_scan_ready = false;        /* bluedroid is up */
+static bool eddy_scan_running = false;
+static bool eddy_scan_restart = false;      /* stop pending, apply eddy_scan_profile once stopped */
+static int64_t eddy_scan_since = 0;         /* us, start of the current scan */
+static TimerHandle_t eddy_scan_reset_timer = NULL;
+static TimerHandle_t eddy_scan_adapt_timer = NULL;
+static esp_eddystone_scan_duty_t eddy_scan_duty = {
+    .adaptive   = true,
+    .duty       = EDDY_SCAN_DUTY_MAX,
+    .duty_min   = EDDY_SCAN_DUTY_MIN,
+    .duty_max   = EDDY_SCAN_DUTY_MAX
+};
+static uint16_t eddy_scan_window = 0;           /* set in the controller, 0.625 ms units */
+static uint32_t eddy_scan_new_beacons = 0;      /* since the last adapt period */
+static uint32_t eddy_scan_stable_periods = 0;
+
+/**
+ * @brief Scan window giving a duty cycle of the interval
+ *
+ * @param duty - %
+ * @return uint16_t - 0.625 ms units
+ */
+static inline uint16_t esp_eddystone_scan_duty_window(uint8_t duty)
+{
+    uint16_t window = (uint16_t)((uint32_t)EDDY_SCAN_INTERVAL * duty / 100);
+    return (window < EDDY_SCAN_WINDOW_MIN) ? EDDY_SCAN_WINDOW_MIN : window;
+}
+
+/**
+ * @brief Set the requested profile in the controller, scanning starts once the
+ *        parameters are set
+ *
+ */
+static void esp_eddystone_scan_apply(void)
+{
+    portENTER_CRITICAL(&eddy_scan_lock);
+    eddy_scan_restart = false;
+    eddy_scan_applied = eddy_scan_profile;
+    eddy_scan_window = esp_eddystone_scan_duty_window(eddy_scan_duty.duty);
+    eddy_scan_counters[eddy_scan_applied].restarts++;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+
+    const esp_eddystone_scan_config_t* cfg = &eddy_scan_configs[eddy_scan_applied];
+    esp_ble_scan_params_t params = {
+        .scan_type              = cfg->scan_type,
+        .own_addr_type          = BLE_ADDR_TYPE_PUBLIC,
+        .scan_filter_policy     = cfg->filter_policy,
+        .scan_interval          = EDDY_SCAN_INTERVAL,
+        .scan_window            = eddy_scan_window,
+        .scan_duplicate         = cfg->duplicate
+    };
+    esp_ble_gap_set_scan_params(&params);
+
+    if (cfg->dup_reset_ms) {
+        xTimerChangePeriod(eddy_scan_reset_timer, pdMS_TO_TICKS(cfg->dup_reset_ms), 0);
+    } else {
+        xTimerStop(eddy_scan_reset_timer, 0);
+    }
+}
+
+/**
+ * @brief Stop the scan so the requested profile is applied on the stop complete event.
+ *        If the scan is being started it is stopped as soon as it is running.
+ *
+ */
+static void esp_eddystone_scan_request_restart(void)
+{
+    bool stop;
+
+    portENTER_CRITICAL(&eddy_scan_lock);
+    stop = eddy_scan_ready && eddy_scan_running && !eddy_scan_restart;
+    eddy_scan_restart = eddy_scan_ready;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+
+    if (stop) {
+        esp_ble_gap_stop_scanning();
+    }
+}
+
+/**
+ * @brief Empty the controller duplicate cache, which is only done by restarting the scan
+ *
+ * @param timer
+ */
+static void esp_eddystone_scan_reset_cb(TimerHandle_t timer)
+{
+    esp_eddystone_scan_request_restart();
+}
+
+/**
+ * @brief Raise the duty cycle when new beacons showed up in the last period,
+ *        lower it one step after EDDY_SCAN_STABLE_PERIODS quiet periods
+ *
+ * @param timer
+ */
+static void esp_eddystone_scan_adapt_cb(TimerHandle_t timer)
+{
+    portENTER_CRITICAL(&eddy_scan_lock);
+    uint8_t duty = eddy_scan_duty.duty;
+    if (eddy_scan_duty.adaptive) {
+        if (eddy_scan_new_beacons) {
+            eddy_scan_stable_periods = 0;
+            duty = eddy_scan_duty.duty_max;
+        } else if (++eddy_scan_stable_periods >= EDDY_SCAN_STABLE_PERIODS) {
+            eddy_scan_stable_periods = 0;
+            duty = (duty > eddy_scan_duty.duty_min + EDDY_SCAN_DUTY_STEP) ?
+                   duty - EDDY_SCAN_DUTY_STEP : eddy_scan_duty.duty_min;
+        }
+    }
+    eddy_scan_new_beacons = 0;
+    bool changed = esp_eddystone_scan_duty_window(duty) != eddy_scan_window;
+    eddy_scan_duty.duty = duty;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+
+    if (changed) {
+        ESP_LOGD(SCAN_TAG, "Scan duty %u%%", duty);
+        esp_eddystone_scan_request_restart();
+    }
+}
+
+static bool esp_eddystone_scan_whitelist_find(const uint8_t* bda, int* pos)
+{
+    for (int i = 0; i < eddy_scan_whitelist_count; i++) {
+        if (!memcmp(eddy_scan_whitelist[i], bda, ESP_BD_ADDR_LEN)) {
+            *pos = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Push the whitelist to the controller and start scanning with the requested
+ *        profile. Must be called once bluedroid is enabled and the GAP callback registered.
+ *
+ */
+void esp_eddystone_scan_init(void)
+{
+    esp_bd_addr_t bda;
+
+    eddy_scan_reset_timer = xTimerCreate("eddy_scan_reset", pdMS_TO_TICKS(1000), pdTRUE, NULL,
+                                         esp_eddystone_scan_reset_cb);
+    eddy_scan_adapt_timer = xTimerCreate("eddy_scan_adapt", pdMS_TO_TICKS(EDDY_SCAN_ADAPT_PERIOD_MS), pdTRUE, NULL,
+                                         esp_eddystone_scan_adapt_cb);
+    xTimerStart(eddy_scan_adapt_timer, 0);
+
+    portENTER_CRITICAL(&eddy_scan_lock);
+    eddy_scan_ready = true;
+    int count = eddy_scan_whitelist_count;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+
+    for (int i = 0; i < count; i++) {
+        memcpy(bda, eddy_scan_whitelist[i], ESP_BD_ADDR_LEN);
+        esp_ble_gap_update_whitelist(true, bda);
+    }
+    ESP_LOGI(SCAN_TAG, "Scan profile: %s", eddy_scan_configs[eddy_scan_profile].name);
+    esp_eddystone_scan_apply();
+}
+
+/**
+ * @brief Handle the scan related GAP events
+ *
+ * @param event
+ * @param param
+ */
+void esp_eddystone_scan_gap_event(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param)
+{
+    esp_err_t err;
+
+    switch(event)
+    {
+        case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT: {
+            if ((err = param->scan_param_cmpl.status) != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(SCAN_TAG, "Scan params set failed: %s", esp_err_to_name(err));
+                break;
+            }
+            uint32_t duration = 0;
+            esp_ble_gap_start_scanning(duration);
+            break;
+        }
+        case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT: {
+            if ((err = param->scan_start_cmpl.status) != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(SCAN_TAG, "Scan start failed: %s", esp_err_to_name(err));
+                break;
+            }
+            portENTER_CRITICAL(&eddy_scan_lock);
+            eddy_scan_running = true;
+            eddy_scan_since = esp_timer_get_time();
+            bool stop = eddy_scan_restart;
+            portEXIT_CRITICAL(&eddy_scan_lock);
+
+            ESP_LOGD(SCAN_TAG, "Start scanning, profile %s", eddy_scan_configs[eddy_scan_applied].name);
+            metrics_boot_mark(METRICS_BOOT_SCAN_STARTED);
+            if (stop) {
+                esp_ble_gap_stop_scanning();
+            }
+            break;
+        }
+        case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT: {
+            if ((err = param->scan_stop_cmpl.status) != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(SCAN_TAG, "Scan stop failed: %s", esp_err_to_name(err));
+                break;
+            }
+            portENTER_CRITICAL(&eddy_scan_lock);
+            eddy_scan_running = false;
+            eddy_scan_counters[eddy_scan_applied].active_ms += (uint32_t)((esp_timer_get_time() - eddy_scan_since) / 1000);
+            bool restart = eddy_scan_restart;
+            portEXIT_CRITICAL(&eddy_scan_lock);
+
+            if (restart) {
+                esp_eddystone_scan_apply();
+            } else {
+                ESP_LOGI(SCAN_TAG, "Stop scan successfully");
+            }
+            break;
+        }
+        case ESP_GAP_BLE_UPDATE_WHITELIST_COMPLETE_EVT: {
+            if ((err = param->update_whitelist_cmpl.status) != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(SCAN_TAG, "Whitelist update failed: %s", esp_err_to_name(err));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Switch to another scan profile
+ *
+ * @param profile
+ * @return esp_err_t - ESP_ERR_INVALID_ARG for an unknown profile, ESP_ERR_INVALID_STATE for
+ *         the whitelist profile while the whitelist is empty
+ */
+esp_err_t esp_eddystone_scan_set_profile(esp_eddystone_scan_profile_t profile)
+{
+    if (profile >= EDDY_SCAN_PROFILE_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&eddy_scan_lock);
+    if (profile == EDDY_SCAN_PROFILE_WHITELIST && eddy_scan_whitelist_count == 0) {
+        /* the controller would drop every advertisement */
+        portEXIT_CRITICAL(&eddy_scan_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    bool changed = (profile != eddy_scan_profile);
+    eddy_scan_profile = profile;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+
+    if (changed) {
+        ESP_LOGI(SCAN_TAG, "Scan profile: %s", eddy_scan_configs[profile].name);
+        esp_eddystone_scan_request_restart();
+    }
+    return ESP_OK;
+}
+
+esp_eddystone_scan_profile_t esp_eddystone_scan_get_profile(void)
+{
+    return eddy_scan_profile;
+}
+
+/**
+ * @brief Get the settings of a profile
+ *
+ * @param profile
+ * @return const esp_eddystone_scan_config_t* - NULL for an unknown profile
+ */
+const esp_eddystone_scan_config_t* esp_eddystone_scan_get_config(esp_eddystone_scan_profile_t profile)
+{
+    return (profile < EDDY_SCAN_PROFILE_COUNT) ? &eddy_scan_configs[profile] : NULL;
+}
+
+/**
+ * @brief Change the duty cycle settings. In adaptive mode duty is clamped to the
+ *        bounds and then follows the beacon population.
+ *
+ * @param duty
+ * @return esp_err_t - ESP_ERR_INVALID_ARG for a percentage out of 1..100 or duty_min > duty_max
+ */
+esp_err_t esp_eddystone_scan_set_duty(const esp_eddystone_scan_duty_t* duty)
+{
+    if (duty->duty < 1 || duty->duty > 100 || duty->duty_min < 1 || duty->duty_max > 100 ||
+        duty->duty_min > duty->duty_max) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&eddy_scan_lock);
+    eddy_scan_duty = *duty;
+    if (duty->adaptive) {
+        if (eddy_scan_duty.duty < duty->duty_min) {
+            eddy_scan_duty.duty = duty->duty_min;
+        } else if (eddy_scan_duty.duty > duty->duty_max) {
+            eddy_scan_duty.duty = duty->duty_max;
+        }
+    }
+    eddy_scan_stable_periods = 0;
+    bool changed = esp_eddystone_scan_duty_window(eddy_scan_duty.duty) != eddy_scan_window;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+
+    ESP_LOGI(SCAN_TAG, "Scan duty %u%% (%s %u-%u%%)", eddy_scan_duty.duty, duty->adaptive ? "adaptive" : "fixed",
+             duty->duty_min, duty->duty_max);
+    if (changed) {
+        esp_eddystone_scan_request_restart();
+    }
+    return ESP_OK;
+}
+
+void esp_eddystone_scan_get_duty(esp_eddystone_scan_duty_t* duty)
+{
+    portENTER_CRITICAL(&eddy_scan_lock);
+    *duty = eddy_scan_duty;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+}
+
+/**
+ * @brief Get the scan window set in the controller
+ *
+ * @return uint16_t - 0.625 ms units
+ */
+uint16_t esp_eddystone_scan_get_window(void)
+{
+    return eddy_scan_window;
+}
+
+/**
+ * @brief Add a beacon to the whitelist used by EDDY_SCAN_PROFILE_WHITELIST.
+ *        Entries added before esp_eddystone_init() are pushed to the controller then.
+ *
+ * @param bda
+ * @return esp_err_t - ESP_ERR_NO_MEM when EDDY_SCAN_WHITELIST_SIZE beacons are already listed
+ */
+esp_err_t esp_eddystone_scan_whitelist_add(const uint8_t* bda)
+{
+    esp_bd_addr_t addr;
+    int pos;
+
+    portENTER_CRITICAL(&eddy_scan_lock);
+    if (esp_eddystone_scan_whitelist_find(bda, &pos)) {
+        portEXIT_CRITICAL(&eddy_scan_lock);
+        return ESP_OK;
+    }
+    if (eddy_scan_whitelist_count >= EDDY_SCAN_WHITELIST_SIZE) {
+        portEXIT_CRITICAL(&eddy_scan_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(eddy_scan_whitelist[eddy_scan_whitelist_count++], bda, ESP_BD_ADDR_LEN);
+    bool ready = eddy_scan_ready;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+
+    if (ready) {
+        memcpy(addr, bda, ESP_BD_ADDR_LEN);
+        esp_ble_gap_update_whitelist(true, addr);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Remove a beacon from the whitelist
+ *
+ * @param bda
+ * @return esp_err_t - ESP_ERR_NOT_FOUND if the beacon is not listed,
+ *         ESP_ERR_INVALID_STATE for the last beacon while the whitelist profile is in use
+ */
+esp_err_t esp_eddystone_scan_whitelist_remove(const uint8_t* bda)
+{
+    esp_bd_addr_t addr;
+    int pos;
+
+    portENTER_CRITICAL(&eddy_scan_lock);
+    if (!esp_eddystone_scan_whitelist_find(bda, &pos)) {
+        portEXIT_CRITICAL(&eddy_scan_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (eddy_scan_whitelist_count == 1 && eddy_scan_profile == EDDY_SCAN_PROFILE_WHITELIST) {
+        portEXIT_CRITICAL(&eddy_scan_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    eddy_scan_whitelist_count--;
+    memcpy(eddy_scan_whitelist[pos], eddy_scan_whitelist[eddy_scan_whitelist_count], ESP_BD_ADDR_LEN);
+    bool ready = eddy_scan_ready;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+
+    if (ready) {
+        memcpy(addr, bda, ESP_BD_ADDR_LEN);
+        esp_ble_gap_update_whitelist(false, addr);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Copy the whitelist
+ *
+ * @param list - EDDY_SCAN_WHITELIST_SIZE addresses
+ * @return int - Number of addresses copied
+ */
+int esp_eddystone_scan_get_whitelist(uint8_t list[][ESP_BD_ADDR_LEN])
+{
+    portENTER_CRITICAL(&eddy_scan_lock);
+    int count = eddy_scan_whitelist_count;
+    memcpy(list, eddy_scan_whitelist, count * ESP_BD_ADDR_LEN);
+    portEXIT_CRITICAL(&eddy_scan_lock);
+    return count;
+}
+
+/**
+ * @brief Count an advertising report, called from the GAP callback
+ *
+ */
+void esp_eddystone_scan_count_report(void)
+{
+    eddy_scan_counters[eddy_scan_applied].reports++;
+}
+
+/**
+ * @brief Count a beacon seen for the first time, called from the decoder task
+ *
+ */
+void esp_eddystone_scan_count_new_beacon(void)
+{
+    portENTER_CRITICAL(&eddy_scan_lock);
+    eddy_scan_new_beacons++;
+    portEXIT_CRITICAL(&eddy_scan_lock);
+}
+
+/**
+ * @brief Count a decoded eddystone frame, called from the decoder task
+ *
+ */
+void esp_eddystone_scan_count_frame(void)
+{
+    eddy_scan_counters[eddy_scan_applied].frames++;
+}
+
+/**
+ * @brief Read the counters of a profile, active_ms includes the scan in progress
+ *
+ * @param profile
+ * @param counters
+ */
+void esp_eddystone_scan_get_counters(esp_eddystone_scan_profile_t profile, esp_eddystone_scan_counters_t* counters)
+{
+    memset(counters, 0, sizeof(esp_eddystone_scan_counters_t));
+    if (profile >= EDDY_SCAN_PROFILE_COUNT) {
+        return;
+    }
+    portENTER_CRITICAL(&eddy_scan_lock);
+    *counters = eddy_scan_counters[profile];
+    if (eddy_scan_running && profile == eddy_scan_applied) {
+        counters->active_ms += (uint32_t)((esp_timer_get_time() - eddy_scan_since) / 1000);
+    }
+    portEXIT_CRITICAL(&eddy_scan_lock);
+}
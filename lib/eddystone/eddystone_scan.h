@@ -0,0 +1,102 @@
+/**
+ * @file eddystone_scan.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the BLE scan profiles.
+ *
+ *        A profile selects what the controller filters out before an
+ *        advertising report reaches the host: devices not in the whitelist,
+ *        repeated reports (the controller duplicate cache, emptied by restarting
+ *        the scan every dup_reset_ms) and scan responses (passive scanning).
+ *        Eddystone beacons rotate UID/URL/TLM frames from one address, so the
+ *        duplicate filter must compare the advertising data too
+ *        (menuconfig: Scan Duplicate Type = Device Address and Advertising Data).
+ *
+ *        Independently of the profile, the scan window is a duty cycle of the
+ *        interval. In adaptive mode it jumps to duty_max as soon as a new beacon
+ *        shows up and steps down to duty_min while the population is stable,
+ *        leaving the radio to Wi-Fi the rest of the time.
+ * @version 1.0
+ * @date 2020-04-01
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __EDDYSTONE_SCAN_H__
+#define __EDDYSTONE_SCAN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_gap_ble_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_timer.h"
+#include "metrics.h"
+
+#define EDDY_SCAN_INTERVAL          0x50    /* 50 ms, in 0.625 ms units */
+#define EDDY_SCAN_WINDOW_MIN        0x04    /* 2.5 ms, the smallest window the controller accepts */
+#define EDDY_SCAN_UNIT_US           625     /* scan interval and window unit */
+#define EDDY_SCAN_DUTY_MIN          10      /* % of the interval, adaptive lower bound */
+#define EDDY_SCAN_DUTY_MAX          80      /* % of the interval, adaptive upper bound */
+#define EDDY_SCAN_DUTY_STEP         10      /* % removed per stable period */
+#define EDDY_SCAN_ADAPT_PERIOD_MS   5000    /* new beacon check period */
+#define EDDY_SCAN_STABLE_PERIODS    6       /* periods without a new beacon before the duty is lowered */
+#define EDDY_SCAN_WHITELIST_SIZE    12      /* controller whitelist entries */
+#define EDDY_SCAN_DEFAULT_PROFILE   EDDY_SCAN_PROFILE_ALL
+
+typedef enum {
+    EDDY_SCAN_PROFILE_ALL = 0,      /*<! active, every report reaches the host */
+    EDDY_SCAN_PROFILE_PASSIVE,      /*<! passive, no scan requests */
+    EDDY_SCAN_PROFILE_DEDUP,        /*<! passive, controller duplicate filtering */
+    EDDY_SCAN_PROFILE_WHITELIST,    /*<! passive, whitelisted beacons only */
+    EDDY_SCAN_PROFILE_COUNT
+} esp_eddystone_scan_profile_t;
+
+typedef struct {
+    const char*               name;
+    esp_ble_scan_type_t       scan_type;
+    esp_ble_scan_filter_t     filter_policy;
+    esp_ble_scan_duplicate_t  duplicate;
+    uint32_t                  dup_reset_ms;     /*<! restart period emptying the duplicate cache, 0 for none */
+} esp_eddystone_scan_config_t;
+
+/* Scan duty cycle settings */
+typedef struct {
+    bool      adaptive;     /*<! follow the beacon population, otherwise keep duty */
+    uint8_t   duty;         /*<! % of the interval spent scanning */
+    uint8_t   duty_min;     /*<! adaptive bounds, % */
+    uint8_t   duty_max;
+} esp_eddystone_scan_duty_t;
+
+/* Counters of one profile, accumulated over every period it was in use */
+typedef struct {
+    uint32_t  reports;      /*<! advertising reports that reached the host */
+    uint32_t  frames;       /*<! of them, decoded as eddystone frames */
+    uint32_t  restarts;     /*<! scan restarts (profile, duty cycle and duplicate cache resets) */
+    uint32_t  active_ms;    /*<! time scanning with this profile */
+} esp_eddystone_scan_counters_t;
+
+/* Static variables */
+static const char* SCAN_TAG = "EDDY_SCAN";
+
+/* Public funtions */
+void esp_eddystone_scan_init(void);
+void esp_eddystone_scan_gap_event(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+esp_err_t esp_eddystone_scan_set_profile(esp_eddystone_scan_profile_t profile);
+esp_eddystone_scan_profile_t esp_eddystone_scan_get_profile(void);
+const esp_eddystone_scan_config_t* esp_eddystone_scan_get_config(esp_eddystone_scan_profile_t profile);
+esp_err_t esp_eddystone_scan_whitelist_add(const uint8_t* bda);
+esp_err_t esp_eddystone_scan_whitelist_remove(const uint8_t* bda);
+int esp_eddystone_scan_get_whitelist(uint8_t list[][ESP_BD_ADDR_LEN]);
+esp_err_t esp_eddystone_scan_set_duty(const esp_eddystone_scan_duty_t* duty);
+void esp_eddystone_scan_get_duty(esp_eddystone_scan_duty_t* duty);
+uint16_t esp_eddystone_scan_get_window(void);
+void esp_eddystone_scan_count_report(void);
+void esp_eddystone_scan_count_new_beacon(void);
+void esp_eddystone_scan_count_frame(void);
+void esp_eddystone_scan_get_counters(esp_eddystone_scan_profile_t profile, esp_eddystone_scan_counters_t* counters);
+
+#endif /* __EDDYSTONE_SCAN_H__ */
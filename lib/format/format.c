@@ -0,0 +1,104 @@
+/**
+ * @file format.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains small text formatters used instead of sprintf.
+ * @version 1.0
+ * @date 2020-04-03
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "format.h"
+
+static const char fmt_hex_digits[] = "0123456789ABCDEF";
+
+/**
+ * @brief Format bytes as upper case hex, "AABB..." or "AA:BB:..." with a separator
+ *
+ * @param out - Destination, at least 3 * len bytes
+ * @param bytes - Bytes to format
+ * @param len - Number of bytes
+ * @param sep - Separator between bytes, 0 for none
+ * @return size_t
+ */
+size_t fmt_hex(char* out, const uint8_t* bytes, size_t len, char sep)
+{
+    char* p = out;
+    for (size_t i = 0; i < len; i++) {
+        if (sep && i) {
+            *p++ = sep;
+        }
+        *p++ = fmt_hex_digits[bytes[i] >> 4];
+        *p++ = fmt_hex_digits[bytes[i] & 0xf];
+    }
+    *p = '\0';
+    return p - out;
+}
+
+/**
+ * @brief Format an unsigned decimal number
+ *
+ * @param out - Destination, at least FMT_UINT_MAX_LEN bytes
+ * @param value
+ * @return size_t
+ */
+size_t fmt_uint(char* out, uint32_t value)
+{
+    char digits[FMT_UINT_MAX_LEN];
+    size_t n = 0;
+    size_t len = 0;
+
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n) {
+        out[len++] = digits[--n];
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief Format a signed decimal number
+ *
+ * @param out - Destination, at least FMT_INT_MAX_LEN bytes
+ * @param value
+ * @return size_t
+ */
+size_t fmt_int(char* out, int32_t value)
+{
+    if (value < 0) {
+        *out = '-';
+        return 1 + fmt_uint(out + 1, -(uint32_t)value);
+    }
+    return fmt_uint(out, value);
+}
+
+/**
+ * @brief Format a fixed point number with two decimals, halves rounded away from zero
+ *        (an 8.8 temperature of 0x1780 gives "23.50")
+ *
+ * @param out - Destination, at least FMT_FIXED_MAX_LEN bytes
+ * @param value - value / 2^frac_bits is the number formatted, below 42949672 in magnitude
+ * @param frac_bits - Fractional bits of value, up to 16
+ * @return size_t
+ */
+size_t fmt_fixed(char* out, int32_t value, uint8_t frac_bits)
+{
+    char* p = out;
+    uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+    uint64_t half = frac_bits ? (1ull << (frac_bits - 1)) : 0;
+    uint32_t hundredths = (uint32_t)(((uint64_t)magnitude * 100 + half) >> frac_bits);
+
+    if (value < 0 && hundredths) {
+        *p++ = '-';
+    }
+    p += fmt_uint(p, hundredths / 100);
+    *p++ = '.';
+    *p++ = '0' + (hundredths / 10) % 10;
+    *p++ = '0' + hundredths % 10;
+    *p = '\0';
+    return p - out;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file format.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains small text formatters used instead of sprintf.
+ *
+ *        Every function writes a NUL terminated string and returns its length.
+ *        Plain C, no ESP-IDF dependency.
+ * @version 1.0
+ * @date 2020-04-03
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __FORMAT_H__
+#define __FORMAT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FMT_UINT_MAX_LEN    11      /* "4294967295" */
+#define FMT_INT_MAX_LEN     12      /* "-2147483648" */
+#define FMT_FIXED_MAX_LEN   15      /* sign, 10 digits, '.', 2 decimals */
+
+/* Public funtions */
+size_t fmt_hex(char* out, const uint8_t* bytes, size_t len, char sep);
+size_t fmt_uint(char* out, uint32_t value);
+size_t fmt_int(char* out, int32_t value);
+size_t fmt_fixed(char* out, int32_t value, uint8_t frac_bits);
+
+#endif /* __FORMAT_H__ */
@@ -0,0 +1,384 @@
+/**
+ * @file metrics.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains runtime counters, latency histograms and their
+ *        Prometheus text exposition.
+ * @version 1.0
+ * @date 2020-04-08
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "metrics.h"
+#include "esp_heap_caps.h"
+
+static TaskHandle_t metrics_tasks[METRICS_MAX_TASKS];
+static int metrics_task_count = 0;
+static portMUX_TYPE metrics_task_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Boot trace, ms since boot of each milestone, 0 until it happens */
+static uint32_t metrics_boot_ms[METRICS_BOOT_COUNT];
+static const char* const metrics_boot_names[METRICS_BOOT_COUNT] = {
+    [METRICS_BOOT_SCAN_STARTED]         = "scan_started",
+    [METRICS_BOOT_FIRST_ADV]            = "first_adv",
+    [METRICS_BOOT_FIRST_BEACON]         = "first_beacon",
+    [METRICS_BOOT_WIFI_CONNECTED]       = "wifi_connected",
+    [METRICS_BOOT_HTTP_LISTENING]       = "http_listening",
+    [METRICS_BOOT_FIRST_HTTP_RESPONSE]  = "first_http_response",
+};
+
+/**
+ * @brief Set up a histogram that was not statically initialized
+ *
+ * @param h
+ * @param bounds - Bucket upper bounds in ns, ascending, must outlive the histogram
+ * @param bucket_count - At most METRICS_HIST_MAX_BUCKETS
+ */
+void metrics_histogram_init(metrics_histogram_t* h, const uint32_t* bounds, uint8_t bucket_count)
+{
+    memset(h, 0, sizeof(*h));
+    h->bounds = bounds;
+    h->bucket_count = bucket_count < METRICS_HIST_MAX_BUCKETS ? bucket_count : METRICS_HIST_MAX_BUCKETS;
+}
+
+/**
+ * @brief Record one observation in the slot of the current core
+ *
+ * @param h
+ * @param ns
+ */
+void metrics_observe(metrics_histogram_t* h, uint32_t ns)
+{
+    uint8_t bucket = 0;
+    while (bucket < h->bucket_count && ns > h->bounds[bucket]) {
+        bucket++;
+    }
+
+    uint32_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    metrics_hist_slot_t* slot = &h->core[xPortGetCoreID()];
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (bucket < h->bucket_count) {
+        slot->buckets[bucket]++;
+    }
+    slot->count++;
+    slot->sum += ns;
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+/**
+ * @brief Total of a counter over every core
+ *
+ * @param c
+ * @return uint32_t
+ */
+uint32_t metrics_counter_read(const metrics_counter_t* c)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < METRICS_CORES; i++) {
+        total += __atomic_load_n(&c->core[i], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+/**
+ * @brief Total of a histogram over every core
+ *
+ * @param h
+ * @param total - Buckets are not cumulative, like the slots
+ */
+void metrics_histogram_read(const metrics_histogram_t* h, metrics_hist_slot_t* total)
+{
+    metrics_hist_slot_t copy;
+
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < METRICS_CORES; i++) {
+        const metrics_hist_slot_t* slot = &h->core[i];
+        uint32_t seq;
+        do {
+            while ((seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)) & 1) {
+            }
+            memcpy(&copy, slot, sizeof(copy));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq);
+
+        total->count += copy.count;
+        total->sum += copy.sum;
+        for (int b = 0; b < h->bucket_count; b++) {
+            total->buckets[b] += copy.buckets[b];
+        }
+    }
+}
+
+/**
+ * @brief Report the stack high water mark of a task
+ *
+ * @param task
+ */
+void metrics_register_task(TaskHandle_t task)
+{
+    portENTER_CRITICAL(&metrics_task_lock);
+    if (task && metrics_task_count < METRICS_MAX_TASKS) {
+        metrics_tasks[metrics_task_count++] = task;
+    }
+    portEXIT_CRITICAL(&metrics_task_lock);
+}
+
+/**
+ * @brief Record a boot milestone and log it, later occurrences cost one load
+ *
+ * @param event
+ */
+void metrics_boot_mark(metrics_boot_event_t event)
+{
+    uint32_t expected = 0;
+    uint32_t ms;
+
+    if (__atomic_load_n(&metrics_boot_ms[event], __ATOMIC_RELAXED)) {
+        return;
+    }
+    ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (ms == 0) {
+        ms = 1;
+    }
+    if (__atomic_compare_exchange_n(&metrics_boot_ms[event], &expected, ms, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        ESP_LOGI(METRICS_TAG, "Boot trace: %s after %u ms", metrics_boot_names[event], ms);
+    }
+}
+
+/**
+ * @brief Hand the buffered output to the flush callback
+ *
+ * @param w
+ */
+static void metrics_flush(metrics_writer_t* w)
+{
+    if (w->len && !w->error) {
+        w->error = w->flush(w->buf, w->len, w->ctx);
+    }
+    w->len = 0;
+}
+
+static void metrics_put(metrics_writer_t* w, const char* data, size_t len)
+{
+    while (len) {
+        if (w->len == METRICS_BUF_SIZE) {
+            metrics_flush(w);
+        }
+        size_t n = METRICS_BUF_SIZE - w->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&w->buf[w->len], data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void metrics_puts(metrics_writer_t* w, const char* text)
+{
+    metrics_put(w, text, strlen(text));
+}
+
+static void metrics_put_uint(metrics_writer_t* w, uint32_t value)
+{
+    char out[FMT_UINT_MAX_LEN];
+    metrics_put(w, out, fmt_uint(out, value));
+}
+
+/**
+ * @brief Write ns as seconds, without trailing zeros
+ *
+ * @param w
+ * @param ns
+ */
+static void metrics_put_seconds(metrics_writer_t* w, uint64_t ns)
+{
+    uint32_t frac = ns % 1000000000u;
+    int digits = 9;
+
+    metrics_put_uint(w, (uint32_t)(ns / 1000000000u));
+    if (frac == 0) {
+        return;
+    }
+    while (frac % 10 == 0) {
+        frac /= 10;
+        digits--;
+    }
+    char out[10];
+    out[0] = '.';
+    for (int i = digits; i > 0; i--) {
+        out[i] = '0' + frac % 10;
+        frac /= 10;
+    }
+    metrics_put(w, out, digits + 1);
+}
+
+/**
+ * @brief Write "name{labels" leaving the label set open for one more label
+ *
+ * @param w
+ * @param name
+ * @param suffix - Appended to the name, e.g. "_bucket"
+ * @param labels - Comma separated label pairs, NULL for none
+ * @return bool - A label was written
+ */
+static bool metrics_put_name(metrics_writer_t* w, const char* name, const char* suffix, const char* labels)
+{
+    metrics_puts(w, name);
+    metrics_puts(w, suffix);
+    if (labels && labels[0]) {
+        metrics_put(w, "{", 1);
+        metrics_puts(w, labels);
+        return true;
+    }
+    return false;
+}
+
+void metrics_writer_init(metrics_writer_t* w, metrics_flush_cb_t flush, void* ctx)
+{
+    w->len = 0;
+    w->flush = flush;
+    w->ctx = ctx;
+    w->error = 0;
+}
+
+/**
+ * @brief Write the HELP and TYPE lines of a metric family
+ *
+ * @param w
+ * @param name
+ * @param type - "counter", "gauge" or "histogram"
+ * @param help
+ */
+void metrics_write_help(metrics_writer_t* w, const char* name, const char* type, const char* help)
+{
+    metrics_puts(w, "# HELP ");
+    metrics_puts(w, name);
+    metrics_put(w, " ", 1);
+    metrics_puts(w, help);
+    metrics_puts(w, "\n# TYPE ");
+    metrics_puts(w, name);
+    metrics_put(w, " ", 1);
+    metrics_puts(w, type);
+    metrics_put(w, "\n", 1);
+}
+
+/**
+ * @brief Write one sample
+ *
+ * @param w
+ * @param name
+ * @param labels - Comma separated label pairs, e.g. frame="uid", NULL for none
+ * @param value
+ */
+void metrics_write_value(metrics_writer_t* w, const char* name, const char* labels, uint32_t value)
+{
+    if (metrics_put_name(w, name, "", labels)) {
+        metrics_put(w, "}", 1);
+    }
+    metrics_put(w, " ", 1);
+    metrics_put_uint(w, value);
+    metrics_put(w, "\n", 1);
+}
+
+/**
+ * @brief Write the cumulative buckets, sum (seconds) and count of a histogram
+ *
+ * @param w
+ * @param name
+ * @param labels - Comma separated label pairs, NULL for none
+ * @param h
+ */
+void metrics_write_histogram(metrics_writer_t* w, const char* name, const char* labels, const metrics_histogram_t* h)
+{
+    metrics_hist_slot_t total;
+    uint32_t cumulative = 0;
+
+    metrics_histogram_read(h, &total);
+    for (int b = 0; b <= h->bucket_count; b++) {
+        metrics_puts(w, metrics_put_name(w, name, "_bucket", labels) ? ",le=\"" : "{le=\"");
+        if (b < h->bucket_count) {
+            cumulative += total.buckets[b];
+            metrics_put_seconds(w, h->bounds[b]);
+        } else {
+            cumulative = total.count;
+            metrics_puts(w, "+Inf");
+        }
+        metrics_puts(w, "\"} ");
+        metrics_put_uint(w, cumulative);
+        metrics_put(w, "\n", 1);
+    }
+
+    if (metrics_put_name(w, name, "_sum", labels)) {
+        metrics_put(w, "}", 1);
+    }
+    metrics_put(w, " ", 1);
+    metrics_put_seconds(w, total.sum);
+    metrics_put(w, "\n", 1);
+
+    if (metrics_put_name(w, name, "_count", labels)) {
+        metrics_put(w, "}", 1);
+    }
+    metrics_put(w, " ", 1);
+    metrics_put_uint(w, total.count);
+    metrics_put(w, "\n", 1);
+}
+
+/**
+ * @brief Write heap, task stack and boot trace gauges
+ *
+ * @param w
+ */
+void metrics_write_system(metrics_writer_t* w)
+{
+    metrics_write_help(w, "heap_free_bytes", "gauge", "Free heap");
+    metrics_write_value(w, "heap_free_bytes", NULL, esp_get_free_heap_size());
+    metrics_write_help(w, "heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    metrics_write_value(w, "heap_min_free_bytes", NULL, esp_get_minimum_free_heap_size());
+    metrics_write_help(w, "heap_largest_free_block_bytes", "gauge", "Largest allocatable block");
+    metrics_write_value(w, "heap_largest_free_block_bytes", NULL, heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    metrics_write_help(w, "task_stack_min_free_bytes", "gauge", "Stack high water mark, lowest free stack since the task started");
+    for (int i = 0; i < metrics_task_count; i++) {
+        char labels[configMAX_TASK_NAME_LEN + 8];
+        char* p = labels;
+        memcpy(p, "task=\"", 6);
+        p += 6;
+        const char* name = pcTaskGetTaskName(metrics_tasks[i]);
+        size_t len = strnlen(name, configMAX_TASK_NAME_LEN);
+        memcpy(p, name, len);
+        p += len;
+        memcpy(p, "\"", 2);
+        metrics_write_value(w, "task_stack_min_free_bytes", labels, uxTaskGetStackHighWaterMark(metrics_tasks[i]));
+    }
+
+    metrics_write_help(w, "boot_event_seconds", "gauge", "Time from boot to the first occurrence of a milestone");
+    for (int i = 0; i < METRICS_BOOT_COUNT; i++) {
+        uint32_t ms = __atomic_load_n(&metrics_boot_ms[i], __ATOMIC_RELAXED);
+        if (ms == 0) {
+            continue;
+        }
+        metrics_put_name(w, "boot_event_seconds", "", "event=\"");
+        metrics_puts(w, metrics_boot_names[i]);
+        metrics_puts(w, "\"} ");
+        metrics_put_seconds(w, (uint64_t)ms * 1000000);
+        metrics_put(w, "\n", 1);
+    }
+}
+
+/**
+ * @brief Flush what is left in the buffer
+ *
+ * @param w
+ * @return int - Non zero if a flush failed
+ */
+int metrics_writer_finish(metrics_writer_t* w)
+{
+    metrics_flush(w);
+    return w->error;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file metrics.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains runtime counters, latency histograms and their
+ *        Prometheus text exposition.
+ *
+ *        Every counter and histogram has one slot per core. A writer only
+ *        touches the slot of the core it runs on, with interrupts masked on
+ *        that core for the few instructions of the update: no lock is taken
+ *        and the two cores never wait for each other. Readers add the slots
+ *        up, histogram slots are copied under a per slot sequence number so
+ *        the 64 bit sum is never read half written.
+ * @version 1.0
+ * @date 2020-04-08
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "xtensa/hal.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "format.h"
+
+#define METRICS_CORES               portNUM_PROCESSORS
+#define METRICS_HIST_MAX_BUCKETS    12      /* bounds of a histogram, +Inf excluded */
+#define METRICS_MAX_TASKS           12      /* tasks whose stack is reported */
+#define METRICS_BUF_SIZE            512     /* exposition output buffer */
+#define METRICS_CPU_MHZ             CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+
+/* Event counter */
+typedef struct {
+    uint32_t  core[METRICS_CORES];
+} metrics_counter_t;
+
+/* Observations of one core */
+typedef struct {
+    uint32_t  seq;                                  /*<! odd while the slot is being updated */
+    uint32_t  count;
+    uint64_t  sum;                                  /*<! ns */
+    uint32_t  buckets[METRICS_HIST_MAX_BUCKETS];    /*<! observations up to bounds[i] and above bounds[i-1] */
+} metrics_hist_slot_t;
+
+/* Latency histogram, observations in ns */
+typedef struct {
+    const uint32_t*     bounds;                     /*<! bucket upper bounds in ns, ascending */
+    uint8_t             bucket_count;
+    metrics_hist_slot_t core[METRICS_CORES];
+} metrics_histogram_t;
+
+#define METRICS_HISTOGRAM_INIT(bounds_array) \
+    { .bounds = (bounds_array), .bucket_count = sizeof(bounds_array) / sizeof((bounds_array)[0]) }
+
+/* Cycle count stopwatch, the cycle counter is per core */
+typedef struct {
+    uint32_t  ccount;
+    int       core;
+} metrics_stopwatch_t;
+
+/* Boot milestones, each is recorded the first time it happens */
+typedef enum {
+    METRICS_BOOT_SCAN_STARTED = 0,
+    METRICS_BOOT_FIRST_ADV,
+    METRICS_BOOT_FIRST_BEACON,
+    METRICS_BOOT_WIFI_CONNECTED,
+    METRICS_BOOT_HTTP_LISTENING,
+    METRICS_BOOT_FIRST_HTTP_RESPONSE,
+    METRICS_BOOT_COUNT
+} metrics_boot_event_t;
+
+/* Sends out len bytes of output, a non zero return aborts the exposition */
+typedef int (*metrics_flush_cb_t)(const char* data, size_t len, void* ctx);
+
+typedef struct {
+    char                buf[METRICS_BUF_SIZE];
+    size_t              len;
+    metrics_flush_cb_t  flush;
+    void*               ctx;
+    int                 error;      /*<! first flush error, output is discarded after it */
+} metrics_writer_t;
+
+/* Static variables */
+static const char *METRICS_TAG = "METRICS";
+
+/* Public funtions */
+void metrics_histogram_init(metrics_histogram_t* h, const uint32_t* bounds, uint8_t bucket_count);
+void metrics_observe(metrics_histogram_t* h, uint32_t ns);
+uint32_t metrics_counter_read(const metrics_counter_t* c);
+void metrics_histogram_read(const metrics_histogram_t* h, metrics_hist_slot_t* total);
+void metrics_register_task(TaskHandle_t task);
+void metrics_boot_mark(metrics_boot_event_t event);
+
+void metrics_writer_init(metrics_writer_t* w, metrics_flush_cb_t flush, void* ctx);
+void metrics_write_help(metrics_writer_t* w, const char* name, const char* type, const char* help);
+void metrics_write_value(metrics_writer_t* w, const char* name, const char* labels, uint32_t value);
+void metrics_write_histogram(metrics_writer_t* w, const char* name, const char* labels, const metrics_histogram_t* h);
+void metrics_write_system(metrics_writer_t* w);
+int metrics_writer_finish(metrics_writer_t* w);
+
+static inline void metrics_add(metrics_counter_t* c, uint32_t n)
+{
+    uint32_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    c->core[xPortGetCoreID()] += n;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+static inline void metrics_inc(metrics_counter_t* c)
+{
+    metrics_add(c, 1);
+}
+
+static inline void metrics_stopwatch_start(metrics_stopwatch_t* sw)
+{
+    sw->core = xPortGetCoreID();
+    sw->ccount = xthal_get_ccount();
+}
+
+/**
+ * @brief Time elapsed since metrics_stopwatch_start()
+ *
+ * @param sw
+ * @param ns - Elapsed time
+ * @return true - The task stayed on its core, the time is valid
+ */
+static inline bool metrics_stopwatch_ns(const metrics_stopwatch_t* sw, uint32_t* ns)
+{
+    uint32_t cycles = xthal_get_ccount() - sw->ccount;
+    if (xPortGetCoreID() != sw->core) {
+        return false;
+    }
+    *ns = (uint32_t)((uint64_t)cycles * 1000 / METRICS_CPU_MHZ);
+    return true;
+}
+
+#endif /* __METRICS_H__ */
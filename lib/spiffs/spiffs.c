@@ -11,7 +11,9 @@
 
 #include "spiffs.h"
 
-char file_buff[MAX_FILE_SIZE];
+static esp_spiffs_asset_t cache[SPIFFS_CACHE_ENTRIES];
+static int cache_count = 0;
+static SemaphoreHandle_t cache_lock = NULL;
 
 esp_vfs_spiffs_conf_t conf = {
     .base_path = "/spiffs",
@@ -21,11 +23,16 @@ esp_vfs_spiffs_conf_t conf = {
 };
 
 /**
- * @brief Initialize the SPI File System
+ * @brief Initialize the SPI File System, called once at boot. The partition
+ *        stays mounted for as long as the application runs.
  * 
  */
 void esp_spiffs_init(){
     ESP_LOGI(SPIFFS_TAG, "Initializing SPIFFS");
+
+    if (cache_lock == NULL) {
+        cache_lock = xSemaphoreCreateMutex();
+    }
     
     // Use settings defined above to initialize and mount SPIFFS filesystem.
     // Note: esp_vfs_spiffs_register is an all-in-one convenience function.
@@ -66,34 +73,133 @@ unsigned int esp_spiffs_get_file_size(FILE* f){
 }
 
 /**
- * @brief Read a file content and returns a string pointer
+ * @brief FNV-1a over a block, continuing from a previous hash
  * 
+ * @param hash - 2166136261 for the first block
+ * @param data 
+ * @param len 
+ * @return uint32_t 
+ */
+static uint32_t esp_spiffs_hash(uint32_t hash, const char* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Load a file in the cache. Files up to MAX_FILE_SIZE are read in RAM,
+ *        larger ones only have their size recorded and are streamed on use.
+ * 
+ * @param asset - Cache entry to fill
  * @param file_path - Path of the file to read
- * @return char* - Pointer to the file content
+ * @return esp_err_t - Error code
  */
-char* esp_spiffs_read_file(char* file_path){
-    ESP_LOGI(SPIFFS_TAG, "Reading file");
+static esp_err_t esp_spiffs_cache_load(esp_spiffs_asset_t* asset, const char* file_path)
+{
+    ESP_LOGI(SPIFFS_TAG, "Caching file %s", file_path);
+    snprintf(asset->path, sizeof(asset->path), "%s", file_path);
+    asset->size = 0;
+    asset->data = NULL;
+    asset->hash = 0;
+
     FILE* f = fopen(file_path, "r");
     if (f == NULL) {
-        ESP_LOGE(SPIFFS_TAG, "Failed to open file for reading");
-        return;
+        ESP_LOGW(SPIFFS_TAG, "%s not found", file_path);
+        asset->missing = true;
+        return ESP_OK;
     }
+    asset->missing = false;
 
     unsigned int file_size = esp_spiffs_get_file_size(f);
+    uint32_t hash = 2166136261u;
+    char* data = NULL;
 
-    fread(file_buff, file_size, 1, f);
+    if (file_size <= MAX_FILE_SIZE) {
+        data = malloc(file_size + 1);
+        if (data == NULL) {
+            fclose(f);
+            return ESP_ERR_NO_MEM;
+        }
+        if (fread(data, 1, file_size, f) != file_size) {
+            ESP_LOGE(SPIFFS_TAG, "Failed to read file");
+            free(data);
+            fclose(f);
+            return ESP_FAIL;
+        }
+        data[file_size] = '\0';
+        hash = esp_spiffs_hash(hash, data, file_size);
+    } else {
+        char chunk[SPIFFS_CHUNK_SIZE];
+        size_t len;
+        while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+            hash = esp_spiffs_hash(hash, chunk, len);
+        }
+    }
     fclose(f);
-    file_buff[file_size]='\0';
 
-    ESP_LOGI(SPIFFS_TAG, "Read from file: '%s'", file_buff);
+    asset->size = file_size;
+    asset->data = data;
+    asset->hash = hash;
+    return ESP_OK;
+}
 
-    for(int i = 0; i < file_size; i++) {
-        if (file_buff[i] == '\n' || file_buff[i] == '\r') {
-            memmove(&file_buff[i], &file_buff[i + 1], strlen(file_buff) - i);
+/**
+ * @brief Get a file from the cache, reading it from the partition on first use.
+ *        Entries are never evicted, the returned pointer stays valid. Missing
+ *        files are cached too, so probing for an optional file costs one lookup.
+ * 
+ * @param file_path - Path of the file
+ * @return const esp_spiffs_asset_t* - The cached file, NULL if it does not exist or could not be read
+ */
+const esp_spiffs_asset_t* esp_spiffs_cache_get(const char* file_path)
+{
+    esp_spiffs_asset_t* asset = NULL;
+
+    xSemaphoreTake(cache_lock, portMAX_DELAY);
+    for (int i = 0; i < cache_count; i++) {
+        if (!strcmp(cache[i].path, file_path)) {
+            asset = &cache[i];
+            break;
         }
     }
+    if (asset == NULL && cache_count < SPIFFS_CACHE_ENTRIES &&
+        esp_spiffs_cache_load(&cache[cache_count], file_path) == ESP_OK) {
+        asset = &cache[cache_count++];
+    }
+    xSemaphoreGive(cache_lock);
 
-    return file_buff;
+    return (asset && !asset->missing) ? asset : NULL;
+}
+
+/**
+ * @brief Read a file in SPIFFS_CHUNK_SIZE pieces, handing each one to cb
+ * 
+ * @param file_path - Path of the file
+ * @param cb - Chunk handler
+ * @param ctx - Passed to cb
+ * @return esp_err_t - Error code
+ */
+esp_err_t esp_spiffs_stream_file(const char* file_path, esp_spiffs_chunk_cb_t cb, void* ctx)
+{
+    char chunk[SPIFFS_CHUNK_SIZE];
+    size_t len;
+    esp_err_t ret = ESP_OK;
+
+    FILE* f = fopen(file_path, "r");
+    if (f == NULL) {
+        ESP_LOGE(SPIFFS_TAG, "Failed to open file for reading");
+        return ESP_ERR_NOT_FOUND;
+    }
+    while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        if (cb(chunk, len, ctx)) {
+            ret = ESP_FAIL;
+            break;
+        }
+    }
+    fclose(f);
+    return ret;
 }
 
 /**
@@ -13,21 +13,42 @@
 #define __SPIFFS_H__
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_spiffs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
-#define MAX_FILE_SIZE 1000
+#define MAX_FILE_SIZE 4096          /* larger files are not kept in RAM, they are streamed */
+#define SPIFFS_CHUNK_SIZE 512       /* read size when streaming a file */
+#define SPIFFS_CACHE_ENTRIES 8
+#define SPIFFS_MAX_PATH 48
+
+/* Cached file */
+typedef struct {
+    char    path[SPIFFS_MAX_PATH];
+    size_t  size;       /*<! file size in bytes */
+    char*   data;       /*<! resident NUL terminated content, NULL if the file is streamed */
+    uint32_t hash;      /*<! FNV-1a of the content, changes whenever the file does */
+    bool    missing;    /*<! the file does not exist, remembered so it is not looked up again */
+} esp_spiffs_asset_t;
+
+/* Called for each chunk of a streamed file, a non zero return stops the stream */
+typedef int (*esp_spiffs_chunk_cb_t)(const char* chunk, size_t len, void* ctx);
 
 /* Static variables */ 
 static const char *SPIFFS_TAG = "SPIFFS";
 
 /* Public funtions */ 
 void esp_spiffs_init();
-char* esp_spiffs_read_file(char* file_path);
+const esp_spiffs_asset_t* esp_spiffs_cache_get(const char* file_path);
+esp_err_t esp_spiffs_stream_file(const char* file_path, esp_spiffs_chunk_cb_t cb, void* ctx);
 void esp_spiffs_unmount();
 
-#endif /* __SPIFFS_H__ */
\ No newline at end of file
+#endif /* __SPIFFS_H__ */
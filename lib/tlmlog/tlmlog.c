@@ -0,0 +1,380 @@
+/**
+ * @file tlmlog.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the persistent log of TLM telemetry.
+ *
+ *        Every TLM frame is appended as a fixed size record to a circular log
+ *        file preallocated on the SPIFFS storage partition, so the data survives
+ *        reboots. Records are buffered in RAM and written TLMLOG_BATCH at a time,
+ *        or after TLMLOG_FLUSH_MS when fewer arrive, so flash is only touched
+ *        once per batch and a reboot loses at most a minute of records. SPIFFS writes every update to a
+ *        fresh page, which spreads the wear of the log over the whole partition.
+ *        Records name the beacon by its address and the time by the boot number
+ *        of the gateway and its uptime, plus the Unix time once SNTP set the
+ *        clock, so the history stays meaningful across reboots.
+ *        The decoder task only queues records without waiting, the flash writes
+ *        and the lock shared with queries belong to a low priority log task.
+ * @version 1.0
+ * @date 2020-03-28
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#include "tlmlog.h"
+#include "eddystone_registry.h"
+
+static FILE* log_file = NULL;
+static esp_tlmlog_header_t log_header;
+static esp_tlmlog_record_t log_batch[TLMLOG_BATCH];
+static int log_batch_count = 0;
+static SemaphoreHandle_t log_lock = NULL;
+static QueueHandle_t log_queue = NULL;
+static metrics_counter_t log_queued;        /*<! records handed to the log task */
+static metrics_counter_t log_dropped;       /*<! records lost because the queue was full */
+static uint32_t log_write_errors = 0;       /*<! failed batch writes, log task only */
+
+/**
+ * @brief Write the header at the start of the file
+ * 
+ * @return esp_err_t - Error code
+ */
+static esp_err_t esp_tlmlog_write_header(void)
+{
+    if (fseek(log_file, 0, SEEK_SET) ||
+        fwrite(&log_header, sizeof(log_header), 1, log_file) != 1) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Create an empty log, preallocating every record slot
+ * 
+ * @return esp_err_t - Error code
+ */
+static esp_err_t esp_tlmlog_create(void)
+{
+    esp_tlmlog_record_t empty[TLMLOG_BATCH];
+
+    ESP_LOGI(TLMLOG_TAG, "Creating %s for %d records", TLMLOG_PATH, TLMLOG_CAPACITY);
+    log_file = fopen(TLMLOG_PATH, "w+b");
+    if (log_file == NULL) {
+        return ESP_FAIL;
+    }
+    memset(&log_header, 0, sizeof(log_header));
+    log_header.magic = TLMLOG_MAGIC;
+    log_header.record_size = sizeof(esp_tlmlog_record_t);
+    log_header.capacity = TLMLOG_CAPACITY;
+    if (esp_tlmlog_write_header() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    memset(empty, 0, sizeof(empty));
+    for (int i = 0; i < TLMLOG_CAPACITY; i += TLMLOG_BATCH) {
+        if (fwrite(empty, sizeof(esp_tlmlog_record_t), TLMLOG_BATCH, log_file) != TLMLOG_BATCH) {
+            ESP_LOGE(TLMLOG_TAG, "Not enough space for the log");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    fflush(log_file);
+    return ESP_OK;
+}
+
+/**
+ * @brief Write the buffered records after the newest one, wrapping over the oldest
+ * 
+ * @return esp_err_t - Error code
+ */
+static esp_err_t esp_tlmlog_flush_locked(void)
+{
+    int written = 0;
+
+    if (log_file == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while (written < log_batch_count) {
+        int n = log_batch_count - written;
+        if (n > log_header.capacity - log_header.head) {
+            n = log_header.capacity - log_header.head;
+        }
+        long offset = sizeof(esp_tlmlog_header_t) + (long)log_header.head * sizeof(esp_tlmlog_record_t);
+        if (fseek(log_file, offset, SEEK_SET) ||
+            fwrite(&log_batch[written], sizeof(esp_tlmlog_record_t), n, log_file) != n) {
+            ESP_LOGE(TLMLOG_TAG, "Failed to write records");
+            log_batch_count = 0;
+            return ESP_FAIL;
+        }
+        written += n;
+        log_header.head = (log_header.head + n) % log_header.capacity;
+        log_header.count += n;
+        if (log_header.count > log_header.capacity) {
+            log_header.count = log_header.capacity;
+        }
+    }
+    log_batch_count = 0;
+    esp_err_t ret = esp_tlmlog_write_header();
+    fflush(log_file);
+    return ret;
+}
+
+/**
+ * @brief Eddystone listener, logs every TLM frame
+ * 
+ * @param bda 
+ * @param rssi 
+ * @param res 
+ * @param ctx 
+ */
+static void esp_tlmlog_listener(const uint8_t* bda, int8_t rssi, const esp_eddystone_result_t* res, void* ctx)
+{
+    if (res->common.frame_type != EDDYSTONE_FRAME_TYPE_TLM) {
+        return;
+    }
+    time_t now = time(NULL);
+    esp_tlmlog_record_t record = {
+        .timestamp = (now >= TLMLOG_TIME_VALID) ? (uint32_t)now : 0,
+        .boot = log_header.boot,
+        .uptime = esp_eddystone_registry_now(),
+        .batt = res->inform.tlm.battery_voltage,
+        .temp = res->inform.tlm.temperature,
+        .adv_count = res->inform.tlm.adv_count,
+        .time = res->inform.tlm.time,
+    };
+    memcpy(record.bda, bda, sizeof(record.bda));
+    esp_tlmlog_append(&record);
+}
+
+/**
+ * @brief Buffer a queued record, the batch is written to flash once full
+ * 
+ * @param record 
+ * @return esp_err_t - Error code
+ */
+static esp_err_t esp_tlmlog_write(const esp_tlmlog_record_t* record)
+{
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(log_lock, portMAX_DELAY);
+    log_batch[log_batch_count++] = *record;
+    if (log_batch_count == TLMLOG_BATCH) {
+        ret = esp_tlmlog_flush_locked();
+    }
+    xSemaphoreGive(log_lock);
+    return ret;
+}
+
+/**
+ * @brief Log task, writes the queued records, and a partial batch once its
+ *        oldest record waited TLMLOG_FLUSH_MS. It may wait on a query holding
+ *        the log or on a SPIFFS garbage collection, the decoder never does.
+ * 
+ * @param pvParameters 
+ */
+static void esp_tlmlog_task(void *pvParameters)
+{
+    esp_tlmlog_record_t record;
+    TickType_t batch_start = 0;     /* tick the oldest buffered record was taken */
+
+    for (;;) {
+        TickType_t wait = portMAX_DELAY;
+        if (log_batch_count) {
+            TickType_t age = xTaskGetTickCount() - batch_start;
+            wait = (age < pdMS_TO_TICKS(TLMLOG_FLUSH_MS)) ? pdMS_TO_TICKS(TLMLOG_FLUSH_MS) - age : 0;
+        }
+        if (xQueueReceive(log_queue, &record, wait) == pdTRUE) {
+            if (log_batch_count == 0) {
+                batch_start = xTaskGetTickCount();
+            }
+            if (esp_tlmlog_write(&record) != ESP_OK) {
+                log_write_errors++;
+            }
+        } else if (esp_tlmlog_flush() != ESP_OK) {
+            log_write_errors++;
+        }
+    }
+}
+
+/**
+ * @brief Open the log, creating it on first boot, and start logging TLM frames.
+ *        SPIFFS must be mounted and esp_eddystone_init() not called yet.
+ * 
+ * @return esp_err_t - Error code
+ */
+esp_err_t esp_tlmlog_init(void)
+{
+    esp_err_t ret = ESP_OK;
+
+    log_lock = xSemaphoreCreateMutex();
+    log_queue = xQueueCreate(TLMLOG_QUEUE_LEN, sizeof(esp_tlmlog_record_t));
+    log_file = fopen(TLMLOG_PATH, "r+b");
+    if (log_file == NULL ||
+        fread(&log_header, sizeof(log_header), 1, log_file) != 1 ||
+        log_header.magic != TLMLOG_MAGIC ||
+        log_header.record_size != sizeof(esp_tlmlog_record_t) ||
+        log_header.capacity != TLMLOG_CAPACITY ||
+        log_header.head >= TLMLOG_CAPACITY) {
+        if (log_file) {
+            fclose(log_file);
+        }
+        ret = esp_tlmlog_create();
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TLMLOG_TAG, "Failed to open %s", TLMLOG_PATH);
+        if (log_file) {
+            fclose(log_file);
+            log_file = NULL;
+        }
+        return ret;
+    }
+    log_header.boot++;
+    if (esp_tlmlog_write_header() != ESP_OK) {
+        ESP_LOGE(TLMLOG_TAG, "Failed to update %s", TLMLOG_PATH);
+    }
+    fflush(log_file);
+    ESP_LOGI(TLMLOG_TAG, "%u records logged, boot %u", log_header.count, log_header.boot);
+
+    TaskHandle_t task;
+    xTaskCreate(&esp_tlmlog_task, "esp_tlmlog", TLMLOG_TASK_STACK_SIZE, NULL, TLMLOG_TASK_PRIORITY, &task);
+    metrics_register_task(task);
+    return esp_eddystone_add_listener(esp_tlmlog_listener, NULL);
+}
+
+/**
+ * @brief Queue a record for the log task without waiting, safe on the decoder task
+ * 
+ * @param record 
+ * @return esp_err_t - ESP_ERR_TIMEOUT when the queue is full and the record was dropped
+ */
+esp_err_t esp_tlmlog_append(const esp_tlmlog_record_t* record)
+{
+    if (log_file == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xQueueSend(log_queue, record, 0) != pdTRUE) {
+        metrics_inc(&log_dropped);
+        return ESP_ERR_TIMEOUT;
+    }
+    metrics_inc(&log_queued);
+    return ESP_OK;
+}
+
+/**
+ * @brief Write the buffered records now. The log task calls it when a partial
+ *        batch is TLMLOG_FLUSH_MS old.
+ * 
+ * @return esp_err_t - Error code
+ */
+esp_err_t esp_tlmlog_flush(void)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (log_file == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(log_lock, portMAX_DELAY);
+    if (log_batch_count) {
+        ret = esp_tlmlog_flush_locked();
+    }
+    xSemaphoreGive(log_lock);
+    return ret;
+}
+
+/**
+ * @brief Date a record taken in this boot before the clock was set, from its uptime
+ * 
+ * @param record 
+ * @param now - Unix time, 0 while the clock is not set
+ * @param uptime - ms since boot at now
+ */
+static void esp_tlmlog_date(esp_tlmlog_record_t* record, uint32_t now, uint32_t uptime)
+{
+    if (record->timestamp == 0 && now && record->boot == log_header.boot) {
+        record->timestamp = now - (uptime - record->uptime) / 1000;
+    }
+}
+
+/**
+ * @brief Call cb, oldest first, for every record with a timestamp in [from, to].
+ *        Records of the current boot taken before SNTP set the clock are dated
+ *        from their uptime, older ones without a date keep timestamp 0 and are
+ *        only returned when from is 0. Records are read TLMLOG_BATCH at a time
+ *        and the lock is released while cb runs, so a slow reader never holds
+ *        up logging.
+ * 
+ * @param from - First timestamp
+ * @param to - Last timestamp
+ * @param cb - Record handler
+ * @param ctx - Passed to cb
+ * @return esp_err_t - Error code
+ */
+esp_err_t esp_tlmlog_query(uint32_t from, uint32_t to, esp_tlmlog_cb_t cb, void* ctx)
+{
+    esp_tlmlog_record_t chunk[TLMLOG_BATCH];
+    uint32_t done = 0;
+    time_t clock = time(NULL);
+    uint32_t now = (clock >= TLMLOG_TIME_VALID) ? (uint32_t)clock : 0;
+    uint32_t uptime = esp_eddystone_registry_now();
+
+    if (log_file == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (;;) {
+        int n = 0;
+        bool last = false;
+
+        xSemaphoreTake(log_lock, portMAX_DELAY);
+        if (done < log_header.count) {
+            uint32_t slot = (log_header.head + log_header.capacity - log_header.count + done) % log_header.capacity;
+            n = log_header.count - done;
+            if (n > TLMLOG_BATCH) {
+                n = TLMLOG_BATCH;
+            }
+            if (n > log_header.capacity - slot) {
+                n = log_header.capacity - slot;
+            }
+            long offset = sizeof(esp_tlmlog_header_t) + (long)slot * sizeof(esp_tlmlog_record_t);
+            if (fseek(log_file, offset, SEEK_SET) ||
+                fread(chunk, sizeof(esp_tlmlog_record_t), n, log_file) != n) {
+                xSemaphoreGive(log_lock);
+                return ESP_FAIL;
+            }
+            done += n;
+        } else {
+            /* records still waiting in RAM come last */
+            n = log_batch_count;
+            memcpy(chunk, log_batch, n * sizeof(esp_tlmlog_record_t));
+            last = true;
+        }
+        xSemaphoreGive(log_lock);
+
+        for (int i = 0; i < n; i++) {
+            esp_tlmlog_date(&chunk[i], now, uptime);
+            if (chunk[i].timestamp >= from && chunk[i].timestamp <= to && cb(&chunk[i], ctx)) {
+                return ESP_OK;
+            }
+        }
+        if (last) {
+            return ESP_OK;
+        }
+    }
+}
+
+/**
+ * @brief Write the log counters
+ * 
+ * @param w 
+ */
+void esp_tlmlog_write_metrics(metrics_writer_t* w)
+{
+    if (log_file == NULL) {
+        return;
+    }
+    metrics_write_help(w, "tlmlog_records_total", "counter", "TLM records queued for the log");
+    metrics_write_value(w, "tlmlog_records_total", NULL, metrics_counter_read(&log_queued));
+    metrics_write_help(w, "tlmlog_records_dropped_total", "counter", "TLM records dropped because the log queue was full");
+    metrics_write_value(w, "tlmlog_records_dropped_total", NULL, metrics_counter_read(&log_dropped));
+    metrics_write_help(w, "tlmlog_write_errors_total", "counter", "Failed flash writes of the log");
+    metrics_write_value(w, "tlmlog_write_errors_total", NULL, log_write_errors);
+    metrics_write_help(w, "tlmlog_queue_records", "gauge", "Records waiting for the log task");
+    metrics_write_value(w, "tlmlog_queue_records", NULL, uxQueueMessagesWaiting(log_queue));
+}
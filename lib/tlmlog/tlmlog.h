@@ -0,0 +1,76 @@
+/**
+ * @file tlmlog.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the persistent log of TLM telemetry.
+ * @version 1.0
+ * @date 2020-03-28
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef __TLMLOG_H__
+#define __TLMLOG_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "eddystone_api.h"
+#include "metrics.h"
+
+#define TLMLOG_PATH "/spiffs/tlm.log"
+#define TLMLOG_MAGIC 0x544C4D32         /* "TLM2" */
+#define TLMLOG_CAPACITY 4096            /* records kept, the oldest are overwritten */
+#define TLMLOG_BATCH 16                 /* records buffered in RAM between flash writes */
+#define TLMLOG_FLUSH_MS 60000           /* a partial batch is written once its oldest record is this old */
+#define TLMLOG_QUEUE_LEN 32             /* records waiting for the log task, more are dropped */
+#define TLMLOG_TASK_STACK_SIZE 3072
+#define TLMLOG_TASK_PRIORITY 2          /* below the decoder and the web server, flash writes can take tens of ms */
+#define TLMLOG_TIME_VALID 1577836800    /* 2020-01-01, an earlier clock was not set by SNTP yet */
+
+/* Log record, stored as is on flash. The clock is only known once SNTP
+   answered: records taken before have timestamp 0 and are ordered by boot
+   and uptime, esp_tlmlog_query() dates those of the current boot. */
+typedef struct {
+    uint32_t  timestamp;      /*<! Unix time at reception, 0 when the clock was not set */
+    uint16_t  boot;           /*<! boot number of the gateway, see esp_tlmlog_header_t */
+    uint32_t  uptime;         /*<! ms since that boot at reception */
+    uint8_t   bda[6];         /*<! beacon address */
+    uint16_t  batt;           /*<! battery voltage, 1mV/bit */
+    int16_t   temp;           /*<! beacon temperature, 8.8 fixed point degrees Celsius */
+    uint32_t  adv_count;      /*<! adv pdu count since power-on or reboot */
+    uint32_t  time;           /*<! time since power-on or reboot, 0.1 second resolution */
+} __attribute__((packed)) esp_tlmlog_record_t;
+
+/* Log file header, followed by TLMLOG_CAPACITY records */
+typedef struct {
+    uint32_t  magic;
+    uint16_t  record_size;
+    uint16_t  boot;           /*<! boots since the log was created, counted at esp_tlmlog_init() */
+    uint32_t  capacity;
+    uint32_t  head;           /*<! slot of the next record to write */
+    uint32_t  count;          /*<! valid records, up to capacity */
+} __attribute__((packed)) esp_tlmlog_header_t;
+
+/* Called for each record of a query, a non zero return stops the query */
+typedef int (*esp_tlmlog_cb_t)(const esp_tlmlog_record_t* record, void* ctx);
+
+/* Static variables */ 
+static const char *TLMLOG_TAG = "TLMLOG";
+
+/* Public funtions */ 
+esp_err_t esp_tlmlog_init(void);
+esp_err_t esp_tlmlog_append(const esp_tlmlog_record_t* record);
+esp_err_t esp_tlmlog_flush(void);
+esp_err_t esp_tlmlog_query(uint32_t from, uint32_t to, esp_tlmlog_cb_t cb, void* ctx);
+void esp_tlmlog_write_metrics(metrics_writer_t* w);
+
+#endif /* __TLMLOG_H__ */
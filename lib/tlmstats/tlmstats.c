@@ -0,0 +1,240 @@
+/**
+ * @file tlmstats.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the rolling temperature statistics of TLM beacons.
+ *
+ *        Every window (1 minute, 1 hour, 1 day) of a beacon is a ring of
+ *        TLMSTATS_BUCKETS buckets holding the min, max, sum and count of the
+ *        samples received during one sixth of the window. A sample only updates
+ *        the current bucket, after clearing the buckets that went out of the
+ *        window since the previous sample; a query merges at most
+ *        TLMSTATS_BUCKETS buckets. The windows slide one bucket at a time (the
+ *        1 minute window holds the last 50 to 60 s of samples), no sample is
+ *        kept and the memory used does not depend on the TLM rate.
+ *        Temperatures stay in the 8.8 fixed point of the TLM frame.
+ * @version 1.0
+ * @date 2020-04-11
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "tlmstats.h"
+
+/* Samples received during one bucket */
+typedef struct {
+    int16_t   min;
+    int16_t   max;
+    int32_t   sum;
+    uint16_t  count;
+} __attribute__((packed)) esp_tlmstats_bucket_t;
+
+typedef struct {
+    bool      used;
+    uint8_t   bda[6];
+    int16_t   last;
+    uint32_t  last_ms;
+    uint32_t  head[TLMSTATS_WINDOW_COUNT];    /*<! bucket number (time / bucket length) of the last sample */
+    esp_tlmstats_bucket_t buckets[TLMSTATS_WINDOW_COUNT][TLMSTATS_BUCKETS];
+} esp_tlmstats_entry_t;
+
+/* Static variables */
+static const uint32_t stats_window_s[TLMSTATS_WINDOW_COUNT] = { 60, 3600, 86400 };
+static const char* const stats_window_names[TLMSTATS_WINDOW_COUNT] = { "1m", "1h", "1d" };
+static esp_tlmstats_entry_t stats_table[TLMSTATS_MAX_BEACONS];
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Bucket number of a time
+ *
+ * @param window
+ * @param now_ms - ms since boot
+ * @return uint32_t
+ */
+static inline uint32_t esp_tlmstats_bucket(int window, int64_t now_ms)
+{
+    return (uint32_t)(now_ms / (stats_window_s[window] * 1000 / TLMSTATS_BUCKETS));
+}
+
+/**
+ * @brief Entry of a beacon, a new one replaces a free entry or the least
+ *        recently updated. Called with stats_lock held.
+ *
+ * @param bda
+ * @param now_ms - ms since boot
+ * @return esp_tlmstats_entry_t*
+ */
+static esp_tlmstats_entry_t* esp_tlmstats_find(const uint8_t* bda, int64_t now_ms)
+{
+    esp_tlmstats_entry_t* victim = NULL;
+
+    for (int i = 0; i < TLMSTATS_MAX_BEACONS; i++) {
+        esp_tlmstats_entry_t* e = &stats_table[i];
+        if (!e->used) {
+            if (victim == NULL || victim->used) {
+                victim = e;
+            }
+        } else if (!memcmp(e->bda, bda, sizeof(e->bda))) {
+            return e;
+        } else if (victim == NULL || (victim->used && (int32_t)(e->last_ms - victim->last_ms) < 0)) {
+            victim = e;
+        }
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    victim->used = true;
+    memcpy(victim->bda, bda, sizeof(victim->bda));
+    for (int w = 0; w < TLMSTATS_WINDOW_COUNT; w++) {
+        victim->head[w] = esp_tlmstats_bucket(w, now_ms);
+    }
+    return victim;
+}
+
+/**
+ * @brief Add a sample to every window of a beacon. Called with stats_lock held.
+ *
+ * @param e
+ * @param now_ms - ms since boot
+ * @param temp - 8.8 fixed point
+ */
+static void esp_tlmstats_add(esp_tlmstats_entry_t* e, int64_t now_ms, int16_t temp)
+{
+    for (int w = 0; w < TLMSTATS_WINDOW_COUNT; w++) {
+        esp_tlmstats_bucket_t* ring = e->buckets[w];
+        uint32_t n = esp_tlmstats_bucket(w, now_ms);
+        uint32_t gap = n - e->head[w];
+
+        /* clear the buckets reused since the last sample */
+        if (gap > TLMSTATS_BUCKETS) {
+            gap = TLMSTATS_BUCKETS;
+        }
+        for (uint32_t i = 1; i <= gap; i++) {
+            memset(&ring[(e->head[w] + i) % TLMSTATS_BUCKETS], 0, sizeof(esp_tlmstats_bucket_t));
+        }
+        e->head[w] = n;
+
+        esp_tlmstats_bucket_t* b = &ring[n % TLMSTATS_BUCKETS];
+        if (b->count == UINT16_MAX) {
+            continue;       /* keeps the sum in range, a bucket would need a frame every 0.2 s */
+        }
+        if (b->count == 0 || temp < b->min) {
+            b->min = temp;
+        }
+        if (b->count == 0 || temp > b->max) {
+            b->max = temp;
+        }
+        b->sum += temp;
+        b->count++;
+    }
+    e->last = temp;
+    e->last_ms = (uint32_t)now_ms;
+}
+
+/**
+ * @brief Eddystone listener, adds the temperature of every TLM frame
+ *
+ * @param bda
+ * @param rssi
+ * @param res
+ * @param ctx
+ */
+static void esp_tlmstats_listener(const uint8_t* bda, int8_t rssi, const esp_eddystone_result_t* res, void* ctx)
+{
+    if (res->common.frame_type != EDDYSTONE_FRAME_TYPE_TLM ||
+        res->inform.tlm.temperature == EDDYSTONE_TLM_TEMP_UNSUPPORTED) {
+        return;
+    }
+    int64_t now_ms = esp_timer_get_time() / 1000;
+
+    portENTER_CRITICAL(&stats_lock);
+    esp_tlmstats_add(esp_tlmstats_find(bda, now_ms), now_ms, res->inform.tlm.temperature);
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+/**
+ * @brief Start following TLM temperatures. Call it before esp_eddystone_init().
+ *
+ * @return esp_err_t - Error code
+ */
+esp_err_t esp_tlmstats_init(void)
+{
+    ESP_LOGI(TLMSTATS_TAG, "%d beacons, %u bytes", TLMSTATS_MAX_BEACONS, (unsigned int)sizeof(stats_table));
+    return esp_eddystone_add_listener(esp_tlmstats_listener, NULL);
+}
+
+/**
+ * @brief Statistics of one table entry, as of now
+ *
+ * @param index - 0 to TLMSTATS_MAX_BEACONS - 1
+ * @param stats
+ * @return true - The entry holds a beacon
+ */
+bool esp_tlmstats_read(uint16_t index, esp_tlmstats_t* stats)
+{
+    esp_tlmstats_entry_t e;
+
+    if (index >= TLMSTATS_MAX_BEACONS) {
+        return false;
+    }
+    portENTER_CRITICAL(&stats_lock);
+    e = stats_table[index];
+    portEXIT_CRITICAL(&stats_lock);
+    if (!e.used) {
+        return false;
+    }
+
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    memcpy(stats->bda, e.bda, sizeof(stats->bda));
+    stats->last = e.last;
+    stats->last_ms = e.last_ms;
+    for (int w = 0; w < TLMSTATS_WINDOW_COUNT; w++) {
+        esp_tlmstats_window_t* out = &stats->windows[w];
+        uint32_t age = esp_tlmstats_bucket(w, now_ms) - e.head[w];     /* buckets since the last sample */
+        uint32_t slot = e.head[w] % TLMSTATS_BUCKETS;
+        int64_t sum = 0;
+
+        memset(out, 0, sizeof(*out));
+        /* the buckets from the last sample back, while they are in the window ending now */
+        for (uint32_t k = 0; k + age < TLMSTATS_BUCKETS; k++) {
+            const esp_tlmstats_bucket_t* b = &e.buckets[w][(slot + TLMSTATS_BUCKETS - k) % TLMSTATS_BUCKETS];
+            if (b->count == 0) {
+                continue;
+            }
+            if (out->count == 0 || b->min < out->min) {
+                out->min = b->min;
+            }
+            if (out->count == 0 || b->max > out->max) {
+                out->max = b->max;
+            }
+            sum += b->sum;
+            out->count += b->count;
+        }
+        if (out->count) {
+            int64_t half = out->count / 2;
+            out->mean = (int16_t)((sum >= 0 ? sum + half : sum - half) / (int64_t)out->count);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Length of a window
+ *
+ * @param window - 0 to TLMSTATS_WINDOW_COUNT - 1
+ * @return uint32_t - seconds
+ */
+uint32_t esp_tlmstats_window_seconds(int window)
+{
+    return stats_window_s[window];
+}
+
+/**
+ * @brief Name of a window, "1m", "1h" or "1d"
+ *
+ * @param window - 0 to TLMSTATS_WINDOW_COUNT - 1
+ * @return const char*
+ */
+const char* esp_tlmstats_window_name(int window)
+{
+    return stats_window_names[window];
+}
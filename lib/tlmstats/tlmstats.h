@@ -0,0 +1,53 @@
+/**
+ * @file tlmstats.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the rolling temperature statistics of TLM beacons.
+ * @version 1.0
+ * @date 2020-04-11
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __TLMSTATS_H__
+#define __TLMSTATS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "eddystone_api.h"
+
+#define TLMSTATS_MAX_BEACONS 64         /* TLM beacons followed, the least recently updated is replaced */
+#define TLMSTATS_WINDOW_COUNT 3         /* 1 minute, 1 hour, 1 day */
+#define TLMSTATS_BUCKETS 6              /* buckets per window, a window slides one bucket at a time */
+
+/* Aggregate of one window, temperatures in degrees Celsius 8.8 fixed point */
+typedef struct {
+    uint32_t  count;          /*<! samples in the window, the other fields are 0 when there are none */
+    int16_t   min;
+    int16_t   max;
+    int16_t   mean;
+} esp_tlmstats_window_t;
+
+/* Statistics of one beacon */
+typedef struct {
+    uint8_t   bda[6];
+    int16_t   last;           /*<! last temperature, 8.8 fixed point */
+    uint32_t  last_ms;        /*<! ms since boot of the last sample */
+    esp_tlmstats_window_t windows[TLMSTATS_WINDOW_COUNT];
+} esp_tlmstats_t;
+
+/* Static variables */
+static const char *TLMSTATS_TAG = "TLMSTATS";
+
+/* Public funtions */
+esp_err_t esp_tlmstats_init(void);
+bool esp_tlmstats_read(uint16_t index, esp_tlmstats_t* stats);
+uint32_t esp_tlmstats_window_seconds(int window);
+const char* esp_tlmstats_window_name(int window);
+
+#endif /* __TLMSTATS_H__ */
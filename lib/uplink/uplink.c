@@ -0,0 +1,390 @@
+/**
+ * @file uplink.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the batched uplink of decoded frames to a collector.
+ *
+ *        Every decoded frame is encoded as a compact record in a bounded
+ *        backlog, the decoder task never waits for the network. The uplink
+ *        task wakes up once per batching window, or as soon as a frame worth
+ *        of records is waiting, and sends everything pending over one
+ *        persistent connection. While Wi-Fi or the collector is down the
+ *        records stay in the backlog, once it is full the oldest are dropped
+ *        and counted. A record leaves the backlog when lwIP accepted its
+ *        frame: frames in flight when a TCP connection breaks are lost, the
+ *        collector sees the gap in the frame sequence numbers.
+ * @version 1.0
+ * @date 2020-04-09
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "uplink.h"
+#include "eddystone_registry.h"
+
+typedef struct {
+    uint8_t   data[UPLINK_RECORD_MAX];      /*<! esp_uplink_record_t and its frame data */
+} esp_uplink_slot_t;
+
+static esp_uplink_slot_t* uplink_backlog = NULL;
+static uint32_t uplink_head = 0;            /*<! next slot to write */
+static uint32_t uplink_tail = 0;            /*<! oldest record not sent */
+static uint32_t uplink_inflight = 0;        /*<! records from the tail copied into the frame being sent */
+static esp_uplink_stats_t uplink_stats;
+static portMUX_TYPE uplink_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t uplink_task = NULL;
+
+/* Only used by the uplink task */
+static struct netconn* uplink_conn = NULL;
+static uint8_t uplink_frame[UPLINK_FRAME_SIZE];
+static uint32_t uplink_seq = 0;
+static uint8_t uplink_device[6];
+
+/**
+ * @brief Encode a decoded frame as a record
+ *
+ * @param bda
+ * @param rssi
+ * @param res
+ * @param out - At least UPLINK_RECORD_MAX bytes
+ * @return size_t - Record length, 0 for frame types that are not sent
+ */
+static size_t esp_uplink_encode(const uint8_t* bda, int8_t rssi, const esp_eddystone_result_t* res, uint8_t* out)
+{
+    esp_uplink_record_t* record = (esp_uplink_record_t*)out;
+    uint8_t* p = out + sizeof(esp_uplink_record_t);
+
+    switch (res->common.frame_type) {
+    case EDDYSTONE_FRAME_TYPE_UID:
+        *p++ = (uint8_t)res->inform.uid.ranging_data;
+        memcpy(p, res->inform.uid.namespace_id, sizeof(res->inform.uid.namespace_id));
+        p += sizeof(res->inform.uid.namespace_id);
+        memcpy(p, res->inform.uid.instance_id, sizeof(res->inform.uid.instance_id));
+        p += sizeof(res->inform.uid.instance_id);
+        break;
+    case EDDYSTONE_FRAME_TYPE_URL:
+        if (res->inform.url.len > EDDYSTONE_URL_MAX_LEN) {
+            return 0;
+        }
+        *p++ = (uint8_t)res->inform.url.tx_power;
+        memcpy(p, res->inform.url.encoded, res->inform.url.len);
+        p += res->inform.url.len;
+        break;
+    case EDDYSTONE_FRAME_TYPE_TLM:
+        /* the ESP32 is little endian like the wire format */
+        *p++ = res->inform.tlm.version;
+        memcpy(p, &res->inform.tlm.battery_voltage, 2);
+        memcpy(p + 2, &res->inform.tlm.temperature, 2);
+        memcpy(p + 4, &res->inform.tlm.adv_count, 4);
+        memcpy(p + 8, &res->inform.tlm.time, 4);
+        p += 12;
+        break;
+    default:
+        return 0;
+    }
+
+    record->frame_type = res->common.frame_type;
+    record->len = p - out - sizeof(esp_uplink_record_t);
+    record->rssi = rssi;
+    memcpy(record->bda, bda, sizeof(record->bda));
+    record->time_ms = esp_eddystone_registry_now();
+    return p - out;
+}
+
+/**
+ * @brief Eddystone listener, adds the frame to the backlog
+ *
+ * @param bda
+ * @param rssi
+ * @param res
+ * @param ctx
+ */
+static void esp_uplink_listener(const uint8_t* bda, int8_t rssi, const esp_eddystone_result_t* res, void* ctx)
+{
+    uint8_t record[UPLINK_RECORD_MAX];
+    size_t len = esp_uplink_encode(bda, rssi, res, record);
+    bool frame_ready;
+
+    if (len == 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&uplink_lock);
+    if (uplink_head - uplink_tail >= UPLINK_BACKLOG) {
+        /* overwrite the oldest record, unless it was already copied into the frame being sent */
+        uplink_tail++;
+        if (uplink_inflight) {
+            uplink_inflight--;
+        } else {
+            uplink_stats.dropped++;
+        }
+    }
+    memcpy(uplink_backlog[uplink_head % UPLINK_BACKLOG].data, record, len);
+    uplink_head++;
+    uplink_stats.queued++;
+    frame_ready = uplink_head - uplink_tail - uplink_inflight == UPLINK_FRAME_RECORDS;
+    portEXIT_CRITICAL(&uplink_lock);
+
+    if (frame_ready) {
+        xTaskNotifyGive(uplink_task);
+    }
+}
+
+/**
+ * @brief Copy the pending records that fit into the frame buffer, they stay in
+ *        the backlog until esp_uplink_commit()
+ *
+ * @param len - Frame length
+ * @return uint32_t - Records in the frame, 0 if none is pending
+ */
+static uint32_t esp_uplink_build(size_t* len)
+{
+    esp_uplink_frame_hdr_t* hdr = (esp_uplink_frame_hdr_t*)uplink_frame;
+    size_t used = sizeof(esp_uplink_frame_hdr_t);
+    uint32_t count = 0;
+    uint32_t dropped;
+    bool copied;
+
+    do {
+        copied = false;
+        portENTER_CRITICAL(&uplink_lock);
+        if (uplink_head - uplink_tail != uplink_inflight) {
+            const esp_uplink_slot_t* slot = &uplink_backlog[(uplink_tail + uplink_inflight) % UPLINK_BACKLOG];
+            size_t n = sizeof(esp_uplink_record_t) + ((const esp_uplink_record_t*)slot->data)->len;
+            if (used + n <= UPLINK_FRAME_SIZE) {
+                memcpy(&uplink_frame[used], slot->data, n);
+                used += n;
+                uplink_inflight++;
+                copied = true;
+            }
+        }
+        dropped = uplink_stats.dropped;
+        portEXIT_CRITICAL(&uplink_lock);
+        count += copied;
+    } while (copied);
+
+    hdr->magic = UPLINK_MAGIC;
+    hdr->len = used;
+    hdr->count = count;
+    hdr->seq = uplink_seq;
+    hdr->sent_ms = esp_eddystone_registry_now();
+    hdr->dropped = dropped;
+    memcpy(hdr->device, uplink_device, sizeof(hdr->device));
+    hdr->reserved = 0;
+    *len = used;
+    return count;
+}
+
+/**
+ * @brief Release the records of a sent frame, or give them back to the backlog
+ *
+ * @param count - Records in the frame
+ * @param len - Frame length
+ * @param sent - The frame was handed to lwIP
+ */
+static void esp_uplink_commit(uint32_t count, size_t len, bool sent)
+{
+    portENTER_CRITICAL(&uplink_lock);
+    if (sent) {
+        uplink_tail += uplink_inflight;
+        uplink_stats.sent += count;
+        uplink_stats.frames++;
+        uplink_stats.bytes += len;
+    } else {
+        /* records overwritten while the frame was being sent are gone now */
+        uplink_stats.dropped += count - uplink_inflight;
+    }
+    uplink_inflight = 0;
+    portEXIT_CRITICAL(&uplink_lock);
+}
+
+/**
+ * @brief Check whether the station has an address
+ *
+ * @return true - Wi-Fi is connected
+ */
+static bool esp_uplink_network_up(void)
+{
+    tcpip_adapter_ip_info_t info;
+    return tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &info) == ESP_OK && info.ip.addr != 0;
+}
+
+/**
+ * @brief Open the connection to the collector
+ *
+ * @return true - Connected
+ */
+static bool esp_uplink_connect(void)
+{
+    ip_addr_t addr;
+    err_t err;
+
+    err = netconn_gethostbyname(UPLINK_HOST, &addr);
+    if (err != ERR_OK) {
+        ESP_LOGW(UPLINK_TAG, "Cannot resolve %s: %d", UPLINK_HOST, err);
+        return false;
+    }
+    uplink_conn = netconn_new(UPLINK_UDP ? NETCONN_UDP : NETCONN_TCP);
+    if (uplink_conn == NULL) {
+        return false;
+    }
+    netconn_set_sendtimeout(uplink_conn, UPLINK_SEND_TIMEOUT_MS);
+    err = netconn_connect(uplink_conn, &addr, UPLINK_PORT);
+    if (err != ERR_OK) {
+        ESP_LOGW(UPLINK_TAG, "Cannot connect to %s:%d: %d", UPLINK_HOST, UPLINK_PORT, err);
+        netconn_delete(uplink_conn);
+        uplink_conn = NULL;
+        return false;
+    }
+
+    portENTER_CRITICAL(&uplink_lock);
+    uplink_stats.connects++;
+    portEXIT_CRITICAL(&uplink_lock);
+    ESP_LOGI(UPLINK_TAG, "Connected to %s:%d", UPLINK_HOST, UPLINK_PORT);
+    return true;
+}
+
+static void esp_uplink_disconnect(void)
+{
+    netconn_close(uplink_conn);
+    netconn_delete(uplink_conn);
+    uplink_conn = NULL;
+}
+
+/**
+ * @brief Send the frame buffer
+ *
+ * @param len - Frame length
+ * @return true - lwIP accepted the frame
+ */
+static bool esp_uplink_send(size_t len)
+{
+#if UPLINK_UDP
+    struct netbuf* buf = netbuf_new();
+    err_t err = ERR_MEM;
+
+    if (buf) {
+        netbuf_ref(buf, uplink_frame, len);
+        err = netconn_send(uplink_conn, buf);
+        netbuf_delete(buf);
+    }
+    return err == ERR_OK;
+#else
+    return netconn_write(uplink_conn, uplink_frame, len, NETCONN_COPY) == ERR_OK;
+#endif
+}
+
+/**
+ * @brief Send the backlog once per batching window, reconnecting with backoff
+ *
+ * @param pvParameters
+ */
+static void esp_uplink_task(void *pvParameters)
+{
+    uint32_t retry_ms = UPLINK_RETRY_MIN_MS;
+    int64_t retry_at = 0;
+    uint32_t count;
+    size_t len;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(UPLINK_BATCH_MS));
+
+        if (!esp_uplink_network_up()) {
+            if (uplink_conn) {
+                ESP_LOGW(UPLINK_TAG, "Network down, buffering records");
+                esp_uplink_disconnect();
+            }
+            continue;
+        }
+        if (uplink_conn == NULL) {
+            int64_t now = esp_timer_get_time() / 1000;
+            if (now < retry_at) {
+                continue;
+            }
+            if (!esp_uplink_connect()) {
+                retry_at = now + retry_ms;
+                retry_ms = retry_ms * 2 < UPLINK_RETRY_MAX_MS ? retry_ms * 2 : UPLINK_RETRY_MAX_MS;
+                continue;
+            }
+            retry_ms = UPLINK_RETRY_MIN_MS;
+        }
+
+        while ((count = esp_uplink_build(&len)) > 0) {
+            bool sent = esp_uplink_send(len);
+            esp_uplink_commit(count, len, sent);
+            if (!sent) {
+                ESP_LOGW(UPLINK_TAG, "Collector lost, buffering records");
+                esp_uplink_disconnect();
+                break;
+            }
+            uplink_seq++;
+        }
+    }
+}
+
+/**
+ * @brief Start the uplink when UPLINK_ENABLED is set, must be called before
+ *        esp_eddystone_init(). Records are buffered until Wi-Fi is up.
+ *
+ * @return esp_err_t - Error code
+ */
+esp_err_t esp_uplink_init(void)
+{
+    if (!UPLINK_ENABLED) {
+        return ESP_OK;
+    }
+
+    uplink_backlog = malloc(UPLINK_BACKLOG * sizeof(esp_uplink_slot_t));
+    if (uplink_backlog == NULL) {
+        ESP_LOGE(UPLINK_TAG, "No memory for the backlog");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_read_mac(uplink_device, ESP_MAC_WIFI_STA);
+    xTaskCreate(&esp_uplink_task, "esp_uplink", UPLINK_TASK_STACK_SIZE, NULL, 4, &uplink_task);
+    metrics_register_task(uplink_task);
+    ESP_LOGI(UPLINK_TAG, "Sending to %s:%d over %s every %d ms", UPLINK_HOST, UPLINK_PORT,
+             UPLINK_UDP ? "UDP" : "TCP", UPLINK_BATCH_MS);
+    return esp_eddystone_add_listener(esp_uplink_listener, NULL);
+}
+
+/**
+ * @brief Get the uplink counters
+ *
+ * @param stats
+ */
+void esp_uplink_get_stats(esp_uplink_stats_t* stats)
+{
+    portENTER_CRITICAL(&uplink_lock);
+    *stats = uplink_stats;
+    stats->backlog = uplink_head - uplink_tail;
+    portEXIT_CRITICAL(&uplink_lock);
+}
+
+/**
+ * @brief Write the uplink counters, nothing when the uplink is disabled
+ *
+ * @param w
+ */
+void esp_uplink_write_metrics(metrics_writer_t* w)
+{
+    esp_uplink_stats_t stats;
+
+    if (!UPLINK_ENABLED) {
+        return;
+    }
+    esp_uplink_get_stats(&stats);
+    metrics_write_help(w, "uplink_records_total", "counter", "Records added to the uplink backlog");
+    metrics_write_value(w, "uplink_records_total", NULL, stats.queued);
+    metrics_write_help(w, "uplink_records_sent_total", "counter", "Records sent to the collector");
+    metrics_write_value(w, "uplink_records_sent_total", NULL, stats.sent);
+    metrics_write_help(w, "uplink_records_dropped_total", "counter", "Records dropped because the backlog was full");
+    metrics_write_value(w, "uplink_records_dropped_total", NULL, stats.dropped);
+    metrics_write_help(w, "uplink_frames_sent_total", "counter", "Frames sent to the collector");
+    metrics_write_value(w, "uplink_frames_sent_total", NULL, stats.frames);
+    metrics_write_help(w, "uplink_bytes_sent_total", "counter", "Bytes sent to the collector");
+    metrics_write_value(w, "uplink_bytes_sent_total", NULL, stats.bytes);
+    metrics_write_help(w, "uplink_connects_total", "counter", "Connections opened to the collector");
+    metrics_write_value(w, "uplink_connects_total", NULL, stats.connects);
+    metrics_write_help(w, "uplink_backlog_records", "gauge", "Records waiting to be sent");
+    metrics_write_value(w, "uplink_backlog_records", NULL, stats.backlog);
+}
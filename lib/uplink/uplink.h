@@ -0,0 +1,109 @@
+/**
+ * @file uplink.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the batched uplink of decoded frames to a collector.
+ *
+ *        Wire format, little endian, packed: every frame is an
+ *        esp_uplink_frame_hdr_t followed by count records. A record is an
+ *        esp_uplink_record_t followed by len bytes depending on frame_type:
+ *          UID  ranging_data (int8), namespace (10), instance (6)
+ *          URL  tx_power (int8), scheme byte and encoded URL (1-18)
+ *          TLM  version (uint8), battery mV (uint16), temperature 8.8 (int16),
+ *               adv_count (uint32), time 0.1 s (uint32)
+ *        Over TCP the frames follow each other on the stream, over UDP each
+ *        frame is one datagram. tools/uplink_collector.py receives them.
+ * @version 1.0
+ * @date 2020-04-09
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __UPLINK_H__
+#define __UPLINK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "tcpip_adapter.h"
+#include "lwip/api.h"
+#include "eddystone_api.h"
+#include "metrics.h"
+
+/* Push mode, off by default. Enable it and point it at the collector with
+   build_flags = -DUPLINK_ENABLED=1 -DUPLINK_HOST=\"192.168.0.2\" in platformio.ini */
+#ifndef UPLINK_ENABLED
+#define UPLINK_ENABLED 0
+#endif
+#ifndef UPLINK_HOST
+#define UPLINK_HOST "192.168.0.2"       /* collector name or address */
+#endif
+#ifndef UPLINK_PORT
+#define UPLINK_PORT 5515
+#endif
+#ifndef UPLINK_UDP
+#define UPLINK_UDP 0                    /* 1: one datagram per frame, lost datagrams are not resent */
+#endif
+#ifndef UPLINK_BATCH_MS
+#define UPLINK_BATCH_MS 1000            /* batching window, a full frame is sent sooner */
+#endif
+#ifndef UPLINK_BACKLOG
+#define UPLINK_BACKLOG 512              /* records kept while the collector is unreachable, power of two */
+#endif
+#define UPLINK_FRAME_SIZE 1400          /* fits one TCP segment or unfragmented datagram */
+#define UPLINK_RETRY_MIN_MS 1000        /* reconnect backoff, doubled after every failure */
+#define UPLINK_RETRY_MAX_MS 30000
+#define UPLINK_SEND_TIMEOUT_MS 5000     /* a write blocked this long drops the connection */
+#define UPLINK_TASK_STACK_SIZE 3072
+#define UPLINK_MAGIC 0x31505545         /* "EUP1" */
+
+/* Frame header */
+typedef struct {
+    uint32_t  magic;
+    uint16_t  len;            /*<! frame length, header included */
+    uint16_t  count;          /*<! records in the frame */
+    uint32_t  seq;            /*<! frame sequence number since boot, a gap means frames were lost */
+    uint32_t  sent_ms;        /*<! device uptime when the frame was built */
+    uint32_t  dropped;        /*<! records dropped since boot because the backlog was full */
+    uint8_t   device[6];      /*<! Wi-Fi station MAC of the receiver */
+    uint16_t  reserved;
+} __attribute__((packed)) esp_uplink_frame_hdr_t;
+
+/* Record header, followed by len bytes of frame data */
+typedef struct {
+    uint8_t   frame_type;     /*<! EDDYSTONE_FRAME_TYPE_* */
+    uint8_t   len;
+    int8_t    rssi;
+    uint8_t   bda[6];
+    uint32_t  time_ms;        /*<! device uptime when the frame was decoded */
+} __attribute__((packed)) esp_uplink_record_t;
+
+#define UPLINK_RECORD_MAX (sizeof(esp_uplink_record_t) + 1 + EDDYSTONE_URL_MAX_LEN)     /* a URL record */
+#define UPLINK_FRAME_RECORDS ((UPLINK_FRAME_SIZE - sizeof(esp_uplink_frame_hdr_t)) / UPLINK_RECORD_MAX)
+
+/* Uplink counters, since boot */
+typedef struct {
+    uint32_t  queued;         /*<! records added to the backlog */
+    uint32_t  sent;           /*<! records written to the collector */
+    uint32_t  dropped;        /*<! records overwritten before they were sent */
+    uint32_t  frames;
+    uint32_t  bytes;
+    uint32_t  connects;       /*<! connections opened to the collector */
+    uint32_t  backlog;        /*<! records waiting */
+} esp_uplink_stats_t;
+
+/* Static variables */
+static const char *UPLINK_TAG = "UPLINK";
+
+/* Public funtions */
+esp_err_t esp_uplink_init(void);
+void esp_uplink_get_stats(esp_uplink_stats_t* stats);
+void esp_uplink_write_metrics(metrics_writer_t* w);
+
+#endif /* __UPLINK_H__ */
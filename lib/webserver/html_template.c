@@ -0,0 +1,96 @@
+/**
+ * @file html_template.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the HTML template parser.
+ * @version 1.0
+ * @date 2020-03-21
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "html_template.h"
+
+/**
+ * @brief Append a span, merging adjacent literal spans
+ *
+ * @param tpl
+ * @param offset
+ * @param len
+ * @param slot
+ * @return int - 0 on success, -1 if the span table is full
+ */
+static int html_template_add_span(html_template_t* tpl, size_t offset, size_t len, int slot)
+{
+    if (len == 0) {
+        return 0;
+    }
+    if (slot == TEMPLATE_LITERAL && tpl->span_count > 0) {
+        html_template_span_t* last = &tpl->spans[tpl->span_count - 1];
+        if (last->slot == TEMPLATE_LITERAL && last->offset + last->len == offset) {
+            last->len += len;
+            return 0;
+        }
+    }
+    if (tpl->span_count >= TEMPLATE_MAX_SPANS) {
+        return -1;
+    }
+    tpl->spans[tpl->span_count].offset = offset;
+    tpl->spans[tpl->span_count].len = len;
+    tpl->spans[tpl->span_count].slot = slot;
+    tpl->span_count++;
+    return 0;
+}
+
+/**
+ * @brief Split a template into literal spans and placeholder slots. Placeholders
+ *        are "%NAME%" strings, the slot of each one is its index on placeholders.
+ *        Text between '%' that is not a known placeholder is kept as literal.
+ *
+ * @param tpl - Template to fill
+ * @param text - Template text, referenced by the spans (not copied)
+ * @param len - Length of text
+ * @param placeholders - Placeholder strings, including the '%' delimiters
+ * @param placeholder_count - Number of placeholders
+ * @return int - 0 on success, -1 if the template has too many spans
+ */
+int html_template_parse(html_template_t* tpl, const char* text, size_t len,
+                        const char* const* placeholders, int placeholder_count)
+{
+    size_t literal = 0;
+    size_t pos = 0;
+
+    tpl->text = text;
+    tpl->span_count = 0;
+
+    while (pos < len) {
+        const char* open = memchr(text + pos, '%', len - pos);
+        if (open == NULL) {
+            break;
+        }
+        size_t start = open - text;
+        const char* close = memchr(open + 1, '%', len - start - 1);
+        if (close == NULL) {
+            break;
+        }
+        size_t tag_len = close - open + 1;
+        int slot = TEMPLATE_LITERAL;
+        for (int i = 0; i < placeholder_count; i++) {
+            if (strlen(placeholders[i]) == tag_len && !memcmp(open, placeholders[i], tag_len)) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot == TEMPLATE_LITERAL) {
+            /* not a placeholder, the closing '%' may open the next one */
+            pos = start + 1;
+            continue;
+        }
+        if (html_template_add_span(tpl, literal, start - literal, TEMPLATE_LITERAL) ||
+            html_template_add_span(tpl, start, tag_len, slot)) {
+            return -1;
+        }
+        pos = literal = start + tag_len;
+    }
+    return html_template_add_span(tpl, literal, len - literal, TEMPLATE_LITERAL);
+}
@@ -0,0 +1,43 @@
+/**
+ * @file html_template.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the HTML template parser.
+ *
+ *        A template is parsed once into a list of spans. Each span is either
+ *        literal text of the page or a placeholder slot, so a page is rendered
+ *        in a single pass by writing the literal spans as they are and the
+ *        value of each slot in their place.
+ * @version 1.0
+ * @date 2020-03-21
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __HTML_TEMPLATE_H__
+#define __HTML_TEMPLATE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define TEMPLATE_MAX_SPANS      48
+#define TEMPLATE_LITERAL        -1      /* slot of a literal span */
+
+typedef struct {
+    uint16_t  offset;   /*<! start of the span in the template text */
+    uint16_t  len;      /*<! length of the span */
+    int8_t    slot;     /*<! index of the placeholder, or TEMPLATE_LITERAL */
+} html_template_span_t;
+
+typedef struct {
+    const char*           text;     /*<! template text, must outlive the template */
+    uint16_t              span_count;
+    html_template_span_t  spans[TEMPLATE_MAX_SPANS];
+} html_template_t;
+
+/* Public funtions */
+int html_template_parse(html_template_t* tpl, const char* text, size_t len,
+                        const char* const* placeholders, int placeholder_count);
+
+#endif /* __HTML_TEMPLATE_H__ */
@@ -0,0 +1,455 @@
+/**
+ * @file http_parser.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the HTTP/1.1 request parser and route lookup.
+ * @version 1.0
+ * @date 2020-04-06
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <strings.h>
+
+#include "http_parser.h"
+
+/* Method names, in http_method_t order */
+static const char* const http_methods[HTTP_METHOD_COUNT] = {
+    [HTTP_METHOD_UNKNOWN] = "",
+    [HTTP_METHOD_GET]     = "GET",
+    [HTTP_METHOD_HEAD]    = "HEAD",
+    [HTTP_METHOD_POST]    = "POST",
+    [HTTP_METHOD_PUT]     = "PUT",
+    [HTTP_METHOD_DELETE]  = "DELETE",
+    [HTTP_METHOD_OPTIONS] = "OPTIONS",
+};
+
+/**
+ * @brief Reject the request
+ *
+ * @param parser
+ * @param status - Response status
+ */
+static void http_parser_fail(http_parser_t* parser, uint16_t status)
+{
+    parser->state = HTTP_STATE_ERROR;
+    parser->status = status;
+}
+
+/**
+ * @brief Parse "METHOD SP target SP HTTP/1.x"
+ *
+ * @param parser
+ * @param line - Start of the line in the buffer
+ * @param len - Length of the line without its line ending
+ */
+static void http_parser_request_line(http_parser_t* parser, char* line, size_t len)
+{
+    char* end = line + len;
+    char* sp = memchr(line, ' ', len);
+    if (sp == NULL || sp == line) {
+        http_parser_fail(parser, 400);
+        return;
+    }
+
+    size_t method_len = sp - line;
+    parser->method = HTTP_METHOD_UNKNOWN;
+    for (int i = HTTP_METHOD_UNKNOWN + 1; i < HTTP_METHOD_COUNT; i++) {
+        if (strlen(http_methods[i]) == method_len && !memcmp(line, http_methods[i], method_len)) {
+            parser->method = i;
+            break;
+        }
+    }
+
+    char* target = sp + 1;
+    sp = memchr(target, ' ', end - target);
+    if (sp == NULL || sp == target || target[0] != '/') {
+        http_parser_fail(parser, 400);
+        return;
+    }
+    char* version = sp + 1;
+    if (end - version != 8 || memcmp(version, "HTTP/", 5) || version[6] != '.' ||
+        version[5] < '0' || version[5] > '9' || version[7] < '0' || version[7] > '9') {
+        http_parser_fail(parser, 400);
+        return;
+    }
+    if (version[5] != '1') {
+        http_parser_fail(parser, 505);
+        return;
+    }
+    if (parser->method == HTTP_METHOD_UNKNOWN) {
+        http_parser_fail(parser, 501);
+        return;
+    }
+
+    *sp = '\0';
+    parser->version = version[7] - '0';
+    if (parser->version == 0) {
+        /* HTTP/1.0 keep-alive is not offered, the response ends with the connection */
+        parser->flags |= HTTP_FLAG_CLOSE;
+    }
+    parser->target = target - parser->buf;
+    parser->target_len = sp - target;
+    char* query = memchr(target, '?', parser->target_len);
+    parser->path_len = query ? (uint16_t)(query - target) : parser->target_len;
+    parser->state = HTTP_STATE_HEADERS;
+}
+
+/**
+ * @brief Parse a Content-Length value
+ *
+ * @param parser
+ * @param value
+ * @param len
+ */
+static void http_parser_content_length(http_parser_t* parser, const char* value, size_t len)
+{
+    uint32_t length = 0;
+
+    if (len == 0) {
+        http_parser_fail(parser, 400);
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] < '0' || value[i] > '9') {
+            http_parser_fail(parser, 400);
+            return;
+        }
+        length = length * 10 + (value[i] - '0');
+        if (length >= HTTP_BUFFER_SIZE) {
+            http_parser_fail(parser, 413);
+            return;
+        }
+    }
+    if ((parser->flags & HTTP_FLAG_CONTENT_LENGTH) && parser->content_length != length) {
+        http_parser_fail(parser, 400);
+        return;
+    }
+    parser->flags |= HTTP_FLAG_CONTENT_LENGTH;
+    parser->content_length = length;
+}
+
+/**
+ * @brief Parse a header line, the empty line ends the request head
+ *
+ * @param parser
+ * @param line - Start of the line in the buffer
+ * @param len - Length of the line without its line ending
+ */
+static void http_parser_header_line(http_parser_t* parser, char* line, size_t len)
+{
+    if (len == 0) {
+        parser->body = parser->len;
+        if (parser->content_length == 0) {
+            parser->buf[parser->len] = '\0';
+            parser->state = HTTP_STATE_DONE;
+        } else if (parser->content_length >= sizeof(parser->buf) - parser->len) {
+            http_parser_fail(parser, 413);
+        } else {
+            parser->state = HTTP_STATE_BODY;
+        }
+        return;
+    }
+
+    /* Folded lines are obsolete, whitespace before the colon is not allowed */
+    char* colon = memchr(line, ':', len);
+    if (line[0] == ' ' || line[0] == '\t' || colon == NULL || colon == line ||
+        colon[-1] == ' ' || colon[-1] == '\t') {
+        http_parser_fail(parser, 400);
+        return;
+    }
+
+    char* value = colon + 1;
+    char* end = line + len;
+    while (value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+        end--;
+    }
+    *end = '\0';
+
+    size_t name_len = colon - line;
+    size_t value_len = end - value;
+    if (name_len == 14 && !strncasecmp(line, "Content-Length", 14)) {
+        http_parser_content_length(parser, value, value_len);
+    } else if (name_len == 10 && !strncasecmp(line, "Connection", 10)) {
+        if (http_header_has_token(value, value_len, "close")) {
+            parser->flags |= HTTP_FLAG_CLOSE;
+        }
+    } else if (name_len == 17 && !strncasecmp(line, "Transfer-Encoding", 17)) {
+        /* Chunked request bodies are not supported */
+        http_parser_fail(parser, 411);
+    }
+
+    if (parser->header_count < HTTP_MAX_HEADERS) {
+        http_header_t* header = &parser->headers[parser->header_count++];
+        header->name = line - parser->buf;
+        header->name_len = name_len;
+        header->value = value - parser->buf;
+        header->value_len = value_len;
+    }
+}
+
+/**
+ * @brief Parse the line ending at the end of the buffer
+ *
+ * @param parser
+ */
+static void http_parser_line(http_parser_t* parser)
+{
+    char* line = parser->buf + parser->line;
+    size_t len = parser->len - parser->line - 1;    /* without '\n' */
+    if (len && line[len - 1] == '\r') {
+        len--;
+    }
+
+    if (parser->state == HTTP_STATE_REQUEST_LINE) {
+        if (len == 0) {
+            /* Empty lines before a request are ignored */
+            parser->len = parser->line;
+            return;
+        }
+        http_parser_request_line(parser, line, len);
+    } else {
+        http_parser_header_line(parser, line, len);
+    }
+}
+
+/**
+ * @brief Reset the parser for a new request
+ *
+ * @param parser
+ */
+void http_parser_init(http_parser_t* parser)
+{
+    memset(parser, 0, offsetof(http_parser_t, headers));
+}
+
+/**
+ * @brief Feed received bytes to the parser. Parsing stops at the end of the
+ *        request, the bytes after it belong to the next one.
+ *
+ * @param parser
+ * @param data
+ * @param len
+ * @return size_t - Bytes consumed
+ */
+size_t http_parser_feed(http_parser_t* parser, const char* data, size_t len)
+{
+    size_t used = 0;
+
+    while (used < len && parser->state < HTTP_STATE_DONE) {
+        const char* p = data + used;
+        size_t n;
+
+        if (parser->state == HTTP_STATE_BODY) {
+            n = parser->body + parser->content_length - parser->len;
+            if (n > len - used) {
+                n = len - used;
+            }
+            memcpy(parser->buf + parser->len, p, n);
+            parser->len += n;
+            used += n;
+            if (parser->len == parser->body + parser->content_length) {
+                parser->buf[parser->len] = '\0';
+                parser->state = HTTP_STATE_DONE;
+            }
+            continue;
+        }
+
+        /* Copy up to the end of the line, one byte is kept for the body NUL */
+        const char* nl = memchr(p, '\n', len - used);
+        n = nl ? (size_t)(nl - p) + 1 : len - used;
+        if (parser->len + n >= sizeof(parser->buf)) {
+            http_parser_fail(parser, parser->state == HTTP_STATE_REQUEST_LINE ? 414 : 431);
+            break;
+        }
+        memcpy(parser->buf + parser->len, p, n);
+        parser->len += n;
+        used += n;
+        if (nl) {
+            http_parser_line(parser);
+            parser->line = parser->len;
+        }
+    }
+    return used;
+}
+
+/**
+ * @brief Find a request header, the name is matched case insensitively
+ *
+ * @param parser
+ * @param name - Header name without the colon
+ * @param value_len - Set to the length of the value
+ * @return const char* - The NUL terminated value, NULL if the header is not present
+ */
+const char* http_parser_header(const http_parser_t* parser, const char* name, size_t* value_len)
+{
+    size_t name_len = strlen(name);
+
+    for (int i = 0; i < parser->header_count; i++) {
+        const http_header_t* header = &parser->headers[i];
+        if (header->name_len == name_len && !strncasecmp(parser->buf + header->name, name, name_len)) {
+            *value_len = header->value_len;
+            return parser->buf + header->value;
+        }
+    }
+    return NULL;
+}
+
+static inline bool http_is_ows(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/**
+ * @brief Check whether the parameters of a list element hold q=0, e.g. ";q=0.000"
+ *
+ * @param p - Parameters, from the first ';', or end when there are none
+ * @param end - End of the element
+ * @return true - The element is refused
+ */
+static bool http_header_q_zero(const char* p, const char* end)
+{
+    while (p < end) {
+        p++;                                    /* ';' */
+        while (p < end && http_is_ows(*p)) {
+            p++;
+        }
+        const char* next = memchr(p, ';', end - p);
+        if (next == NULL) {
+            next = end;
+        }
+        if (next - p >= 3 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '=' && p[2] == '0') {
+            const char* v = p + 3;
+            if (v < next && *v == '.') {
+                v++;
+            }
+            while (v < next && *v == '0') {
+                v++;
+            }
+            while (v < next && http_is_ows(*v)) {
+                v++;
+            }
+            if (v == next) {
+                return true;
+            }
+        }
+        p = next;
+    }
+    return false;
+}
+
+/**
+ * @brief Check whether a comma separated header value lists a token, e.g. gzip
+ *        in Accept-Encoding. Elements are compared whole and case insensitively,
+ *        up to their parameters; an element with q=0 is a refusal.
+ *
+ * @param value
+ * @param len
+ * @param token
+ * @return true - The token is present
+ */
+bool http_header_has_token(const char* value, size_t len, const char* token)
+{
+    size_t token_len = strlen(token);
+    const char* end = value + len;
+    const char* p = value;
+
+    while (p < end) {
+        const char* item_end = memchr(p, ',', end - p);
+        if (item_end == NULL) {
+            item_end = end;
+        }
+        while (p < item_end && http_is_ows(*p)) {
+            p++;
+        }
+        const char* params = p;
+        while (params < item_end && *params != ';') {
+            params++;
+        }
+        const char* name_end = params;
+        while (name_end > p && http_is_ows(name_end[-1])) {
+            name_end--;
+        }
+        if ((size_t)(name_end - p) == token_len && !strncasecmp(p, token, token_len) &&
+            !http_header_q_zero(params, item_end)) {
+            return true;
+        }
+        p = item_end + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief Look the request up in a route table
+ *
+ * @param routes
+ * @param count
+ * @param req - A parsed request
+ * @param allowed - Set to the HTTP_METHOD_BIT() mask of the methods the path accepts
+ * @return const http_route_t* - The route, NULL when there is none: 404 if allowed is 0, 405 otherwise
+ */
+const http_route_t* http_route_find(const http_route_t* routes, size_t count,
+                                    const http_parser_t* req, uint32_t* allowed)
+{
+    const char* path = http_parser_target(req);
+
+    *allowed = 0;
+    for (size_t i = 0; i < count; i++) {
+        const http_route_t* route = &routes[i];
+        size_t len = strlen(route->path);
+        bool match;
+        if (len && route->path[len - 1] == '*') {
+            match = req->path_len >= len - 1 && !memcmp(path, route->path, len - 1);
+        } else {
+            match = req->path_len == len && !memcmp(path, route->path, len);
+        }
+        if (!match) {
+            continue;
+        }
+        if (route->method == req->method) {
+            return route;
+        }
+        *allowed |= HTTP_METHOD_BIT(route->method);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Name of a method, for the Allow header
+ *
+ * @param method
+ * @return const char*
+ */
+const char* http_method_name(http_method_t method)
+{
+    return method < HTTP_METHOD_COUNT ? http_methods[method] : "";
+}
+
+/**
+ * @brief Reason phrase of the statuses the server sends
+ *
+ * @param status
+ * @return const char*
+ */
+const char* http_status_reason(uint16_t status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 431: return "Request Header Fields Too Large";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default:  return "Error";
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ * @file http_parser.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the HTTP/1.1 request parser and route lookup.
+ *
+ *        The parser is fed whatever each netbuf holds and keeps the request
+ *        line, headers and a small body in its own buffer, so a request split
+ *        across segments is parsed the same as one received at once and
+ *        nothing is allocated. Every completed line is parsed as soon as its
+ *        newline arrives, no byte is looked at twice.
+ *
+ *        Plain C, no ESP-IDF dependency: tools/http_parser_bench.c builds it on Linux.
+ * @version 1.0
+ * @date 2020-04-06
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __HTTP_PARSER_H__
+#define __HTTP_PARSER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define HTTP_BUFFER_SIZE        1280    /* request line, headers and body */
+#define HTTP_MAX_HEADERS        20      /* further headers are kept in the buffer but not indexed */
+
+typedef enum {
+    HTTP_METHOD_UNKNOWN = 0,
+    HTTP_METHOD_GET,
+    HTTP_METHOD_HEAD,
+    HTTP_METHOD_POST,
+    HTTP_METHOD_PUT,
+    HTTP_METHOD_DELETE,
+    HTTP_METHOD_OPTIONS,
+    HTTP_METHOD_COUNT
+} http_method_t;
+
+typedef enum {
+    HTTP_STATE_REQUEST_LINE = 0,
+    HTTP_STATE_HEADERS,
+    HTTP_STATE_BODY,
+    HTTP_STATE_DONE,            /*<! a complete request is in the buffer */
+    HTTP_STATE_ERROR            /*<! malformed or unsupported request, see status */
+} http_state_t;
+
+/* Bits of http_parser_t.flags */
+#define HTTP_FLAG_CONTENT_LENGTH    (1 << 0)    /* a Content-Length header was received */
+#define HTTP_FLAG_CLOSE             (1 << 1)    /* the client does not keep the connection open */
+
+typedef struct {
+    uint16_t  name;             /*<! offsets in the buffer */
+    uint16_t  name_len;
+    uint16_t  value;            /*<! NUL terminated, surrounding spaces removed */
+    uint16_t  value_len;
+} http_header_t;
+
+typedef struct {
+    uint8_t   state;            /*<! http_state_t */
+    uint8_t   method;           /*<! http_method_t */
+    uint8_t   version;          /*<! minor version, HTTP/1.0 or HTTP/1.1 */
+    uint8_t   header_count;
+    uint8_t   flags;            /*<! HTTP_FLAG_* */
+    uint16_t  status;           /*<! response status of a rejected request */
+    uint16_t  len;              /*<! bytes used in buf */
+    uint16_t  line;             /*<! start of the line being received */
+    uint16_t  target;           /*<! request target, NUL terminated */
+    uint16_t  target_len;
+    uint16_t  path_len;         /*<! target up to the query string */
+    uint16_t  body;             /*<! start of the body */
+    uint16_t  content_length;
+    http_header_t headers[HTTP_MAX_HEADERS];
+    char      buf[HTTP_BUFFER_SIZE];
+} http_parser_t;
+
+/* One entry of a route table. A path ending with '*' matches every path with that prefix.
+   A handler returns false when the connection cannot be reused: the body was sent
+   without a length, or writing it failed. */
+struct netconn;
+typedef bool (*http_handler_t)(struct netconn* conn, const http_parser_t* req);
+typedef struct {
+    http_method_t   method;
+    const char*     path;
+    http_handler_t  handler;
+} http_route_t;
+
+#define HTTP_METHOD_BIT(method)     (1u << (method))
+
+/* Public funtions */
+void http_parser_init(http_parser_t* parser);
+size_t http_parser_feed(http_parser_t* parser, const char* data, size_t len);
+const char* http_parser_header(const http_parser_t* parser, const char* name, size_t* value_len);
+bool http_header_has_token(const char* value, size_t len, const char* token);
+const http_route_t* http_route_find(const http_route_t* routes, size_t count,
+                                    const http_parser_t* req, uint32_t* allowed);
+const char* http_method_name(http_method_t method);
+const char* http_status_reason(uint16_t status);
+
+static inline const char* http_parser_target(const http_parser_t* parser)
+{
+    return parser->buf + parser->target;
+}
+
+static inline const char* http_parser_body(const http_parser_t* parser)
+{
+    return parser->buf + parser->body;
+}
+
+#endif /* __HTTP_PARSER_H__ */
@@ -0,0 +1,244 @@
+/**
+ * @file json_writer.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains a streaming JSON writer.
+ * @version 1.0
+ * @date 2020-03-24
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "json_writer.h"
+
+static const char json_hex_digits[] = "0123456789abcdef";
+
+/**
+ * @brief Hand the buffered output to the flush callback
+ *
+ * @param w
+ */
+static void json_flush(json_writer_t* w)
+{
+    if (w->len && !w->error) {
+        w->error = w->flush(w->buf, w->len, w->ctx);
+    }
+    w->len = 0;
+}
+
+static void json_put(json_writer_t* w, const char* data, size_t len)
+{
+    while (len) {
+        if (w->len == JSON_BUF_SIZE) {
+            json_flush(w);
+        }
+        size_t n = JSON_BUF_SIZE - w->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&w->buf[w->len], data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void json_putc(json_writer_t* w, char c)
+{
+    if (w->len == JSON_BUF_SIZE) {
+        json_flush(w);
+    }
+    w->buf[w->len++] = c;
+}
+
+/**
+ * @brief Write the separator needed before a new value or key
+ *
+ * @param w
+ */
+static void json_separator(json_writer_t* w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->has_items & (1u << w->depth)) {
+        json_putc(w, ',');
+    }
+    w->has_items |= (1u << w->depth);
+}
+
+static void json_open(json_writer_t* w, char c)
+{
+    json_separator(w);
+    json_putc(w, c);
+    if (w->depth + 1 < JSON_MAX_DEPTH) {
+        w->depth++;
+    }
+    w->has_items &= ~(1u << w->depth);
+}
+
+static void json_close(json_writer_t* w, char c)
+{
+    if (w->depth > 0) {
+        w->depth--;
+    }
+    json_putc(w, c);
+}
+
+/**
+ * @brief Start a document
+ *
+ * @param w
+ * @param flush - Called with each full buffer and on json_finish()
+ * @param ctx - Passed to flush
+ */
+void json_init(json_writer_t* w, json_flush_cb_t flush, void* ctx)
+{
+    w->len = 0;
+    w->flush = flush;
+    w->ctx = ctx;
+    w->has_items = 0;
+    w->depth = 0;
+    w->after_key = false;
+    w->error = 0;
+}
+
+void json_begin_object(json_writer_t* w)
+{
+    json_open(w, '{');
+}
+
+void json_end_object(json_writer_t* w)
+{
+    json_close(w, '}');
+}
+
+void json_begin_array(json_writer_t* w)
+{
+    json_open(w, '[');
+}
+
+void json_end_array(json_writer_t* w)
+{
+    json_close(w, ']');
+}
+
+/**
+ * @brief Write an object key, the next call writes its value
+ *
+ * @param w
+ * @param key - Plain ASCII key, written without escaping
+ */
+void json_key(json_writer_t* w, const char* key)
+{
+    json_separator(w);
+    json_putc(w, '"');
+    json_put(w, key, strlen(key));
+    json_put(w, "\":", 2);
+    w->after_key = true;
+}
+
+void json_string(json_writer_t* w, const char* value)
+{
+    json_separator(w);
+    json_putc(w, '"');
+    for (const char* p = value; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\') {
+            json_putc(w, '\\');
+            json_putc(w, c);
+        } else if (c < 0x20) {
+            char esc[6] = { '\\', 'u', '0', '0', json_hex_digits[c >> 4], json_hex_digits[c & 0xf] };
+            json_put(w, esc, sizeof(esc));
+        } else {
+            json_putc(w, c);
+        }
+    }
+    json_putc(w, '"');
+}
+
+/**
+ * @brief Write bytes as a lower case hex string
+ *
+ * @param w
+ * @param bytes
+ * @param len
+ */
+void json_hex(json_writer_t* w, const uint8_t* bytes, size_t len)
+{
+    json_separator(w);
+    json_putc(w, '"');
+    for (size_t i = 0; i < len; i++) {
+        json_putc(w, json_hex_digits[bytes[i] >> 4]);
+        json_putc(w, json_hex_digits[bytes[i] & 0xf]);
+    }
+    json_putc(w, '"');
+}
+
+void json_int(json_writer_t* w, int32_t value)
+{
+    char num[FMT_INT_MAX_LEN];
+    json_separator(w);
+    json_put(w, num, fmt_int(num, value));
+}
+
+void json_uint(json_writer_t* w, uint32_t value)
+{
+    char num[FMT_UINT_MAX_LEN];
+    json_separator(w);
+    json_put(w, num, fmt_uint(num, value));
+}
+
+/**
+ * @brief Write a fixed point number with two decimals
+ *
+ * @param w
+ * @param value - value / 2^frac_bits is the number written
+ * @param frac_bits
+ */
+void json_fixed(json_writer_t* w, int32_t value, uint8_t frac_bits)
+{
+    char num[FMT_FIXED_MAX_LEN];
+    json_separator(w);
+    json_put(w, num, fmt_fixed(num, value, frac_bits));
+}
+
+void json_bool(json_writer_t* w, bool value)
+{
+    json_separator(w);
+    if (value) {
+        json_put(w, "true", 4);
+    } else {
+        json_put(w, "false", 5);
+    }
+}
+
+void json_null(json_writer_t* w)
+{
+    json_separator(w);
+    json_put(w, "null", 4);
+}
+
+/**
+ * @brief Write text as it is, outside of the JSON structure (no separator)
+ *
+ * @param w
+ * @param text
+ */
+void json_raw(json_writer_t* w, const char* text)
+{
+    json_put(w, text, strlen(text));
+}
+
+/**
+ * @brief Flush what is left of the document
+ *
+ * @param w
+ * @return int - 0 on success, the first flush error otherwise
+ */
+int json_finish(json_writer_t* w)
+{
+    json_flush(w);
+    return w->error;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file json_writer.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains a streaming JSON writer.
+ *
+ *        Output is built in a small fixed buffer that is handed to a flush
+ *        callback whenever it fills up, so documents of any size are written
+ *        without ever being held in memory as a whole.
+ * @version 1.0
+ * @date 2020-03-24
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __JSON_WRITER_H__
+#define __JSON_WRITER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "format.h"
+
+#define JSON_BUF_SIZE   512     /* documents up to this size are sent with a Content-Length, larger ones in chunks of this size */
+#define JSON_MAX_DEPTH  16
+
+/* Sends out len bytes of output, a non zero return aborts the document */
+typedef int (*json_flush_cb_t)(const char* data, size_t len, void* ctx);
+
+typedef struct {
+    char             buf[JSON_BUF_SIZE];
+    size_t           len;
+    json_flush_cb_t  flush;
+    void*            ctx;
+    uint32_t         has_items;     /*<! bit n set when the container at depth n is not empty */
+    uint8_t          depth;
+    bool             after_key;     /*<! a key was written, the next value needs no comma */
+    int              error;         /*<! first flush error, output is discarded after it */
+} json_writer_t;
+
+/* Public funtions */
+void json_init(json_writer_t* w, json_flush_cb_t flush, void* ctx);
+void json_begin_object(json_writer_t* w);
+void json_end_object(json_writer_t* w);
+void json_begin_array(json_writer_t* w);
+void json_end_array(json_writer_t* w);
+void json_key(json_writer_t* w, const char* key);
+void json_string(json_writer_t* w, const char* value);
+void json_hex(json_writer_t* w, const uint8_t* bytes, size_t len);
+void json_int(json_writer_t* w, int32_t value);
+void json_uint(json_writer_t* w, uint32_t value);
+void json_fixed(json_writer_t* w, int32_t value, uint8_t frac_bits);
+void json_bool(json_writer_t* w, bool value);
+void json_null(json_writer_t* w);
+void json_raw(json_writer_t* w, const char* text);
+int json_finish(json_writer_t* w);
+
+#endif /* __JSON_WRITER_H__ */
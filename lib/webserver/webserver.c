@@ -11,11 +11,29 @@
 
 #include "webserver.h"
 
-uint8_t wifi_got_ip = 0;
-
-static EventGroupHandle_t wifi_event_group;
+static EventGroupHandle_t wifi_event_group;     /* CONNECTED_BIT is set while the station has an address */
+static QueueHandle_t web_conn_queue;
 const int CONNECTED_BIT = BIT0;
 
+/* Page placeholders, in esp_webserver_html_slot_t order */
+static const char* const html_placeholders[HTML_SLOT_COUNT] = {
+    [HTML_SLOT_MAC]      = MAC_PLACEHOLDER,
+    [HTML_SLOT_NAME]     = NAME_PLACEHOLDER,
+    [HTML_SLOT_INSTANCE] = INSTANCE_PLACEHOLDER,
+    [HTML_SLOT_RSSI]     = RSSI_PLACEHOLDER,
+    [HTML_SLOT_URL]      = URL_PLACEHOLDER,
+    [HTML_SLOT_VER]      = VER_PLACEHOLDER,
+    [HTML_SLOT_BAT]      = BAT_PLACEHOLDER,
+    [HTML_SLOT_TEMP]     = TEMP_PLACEHOLDER,
+    [HTML_SLOT_ADV]      = ADV_PLACEHOLDER,
+    [HTML_SLOT_TIME]     = TIME_PLACEHOLDER,
+    [HTML_SLOT_DIST]     = DIST_PLACEHOLDER,
+};
+
+static html_template_t html_template;
+static uint32_t html_etag_nonce;    /* page ETags of an earlier boot never match */
+static http_parser_t web_parsers[WEB_WORKER_COUNT];   /* one per worker, kept off their stacks */
+
 /**
  * @brief Handles the wifi events
  * 
@@ -30,13 +48,12 @@ static esp_err_t esp_webserver_event_handler(void *ctx, system_event_t *event)
         esp_wifi_connect();
         break;
     case SYSTEM_EVENT_STA_GOT_IP:
-        wifi_got_ip = 1;
         xEventGroupSetBits(wifi_event_group, CONNECTED_BIT);
+        metrics_boot_mark(METRICS_BOOT_WIFI_CONNECTED);
         break;
     case SYSTEM_EVENT_STA_DISCONNECTED:
         /* This is a workaround as ESP32 WiFi libs don't currently
            auto-reassociate. */
-        wifi_got_ip = 0;
         esp_wifi_connect();
         xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
         break;
@@ -67,140 +84,605 @@ void esp_webserver_wifi_init(void)
     ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
     ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
     ESP_ERROR_CHECK( esp_wifi_start() );
+
+    /* lwIP retries on its own until the station is connected */
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, WIFI_SNTP_SERVER);
+    sntp_init();
 }
 
 /**
- * @brief Format an html string replacing an existing placeholder for a giving value
- * 
- * @param buffer - The html string 
- * @param placeholder - The existing placeholder on the htm string
- * @param value - The value that will replace the placeholder
- * @return char* - The new html string
- */
-char* esp_webserver_format_html(char* buffer, char* placeholder, char* value) {
-    char *result; 
-    int i, cnt = 0; 
-    int value_len = strlen(value); 
-    int placeholder_len = strlen(placeholder); 
-
-    ESP_LOGI(WEB_TAG, "Replacing: %s For: %s", placeholder, value);
-  
-    // Counting the number of times old word 
-    // occur in the string 
-    for (i = 0; buffer[i] != '\0'; i++) 
-    { 
-        if (strstr(&buffer[i], placeholder) == &buffer[i]) 
-        { 
-            cnt++; 
-  
-            // Jumping to index after the old word. 
-            i += placeholder_len - 1; 
-        } 
-    } 
-  
-    // Making new string of enough length 
-    result = (char *)malloc(i + cnt * (value_len - placeholder_len) + 1); 
-  
-    i = 0; 
-    while (*buffer) 
-    { 
-        // compare the substring with the result 
-        if (strstr(buffer, placeholder) == buffer) 
-        { 
-            strcpy(&result[i], value); 
-            i += value_len; 
-            buffer += placeholder_len; 
-        } 
-        else
-            result[i++] = *buffer++; 
-    } 
-  
-    result[i] = '\0'; 
-
-    return result;
-}
-
-/**
- * @brief Handles the HTTP requests
- * 
- * @param conn - netconn struct
- */
-static void esp_webserver_netconn_serve(struct netconn *conn)
+ * @brief Copy a suffix after a formatted value
+ * 
+ * @param out - End of the value
+ * @param text - Suffix, NUL terminated
+ * @return int - Length of the suffix
+ */
+static inline int esp_webserver_append(char* out, const char* text)
 {
-    struct netbuf *inbuf;
-    char *buf;
-    u16_t buflen;
-    err_t err;
-    char* html_file;
-    char* css_file;
-
-    /* Read the data from the port, blocking if nothing yet there.
-    We assume the request (the part we care about) is in one netbuf */
-    err = netconn_recv(conn, &inbuf);
-
-    if (err == ERR_OK) {
-      netbuf_data(inbuf, (void**)&buf, &buflen);
-      ESP_LOGI(WEB_TAG, "%s", buf);
-      esp_spiffs_init();
-
-      /* Is this an HTTP GET command? (only check the first 6 chars)*/
-      if (!strncmp(buf, "GET / ", 6)) {
-        /* Send the HTML header
-              * subtract 1 from the size, since we dont send the \0 in the string
-              * NETCONN_NOCOPY: our data is const static, so no need to copy it
-        */
-        netconn_write(conn, http_html_hdr, sizeof(http_html_hdr)-1, NETCONN_NOCOPY);
-
-        /* Send our HTML file */
-        html_file = esp_spiffs_read_file("/spiffs/index.html");
-
-        if (eddy_common_received) {
-            html_file = esp_webserver_format_html(html_file, MAC_PLACEHOLDER, &eddy_mac);
-            html_file = esp_webserver_format_html(html_file, NAME_PLACEHOLDER, &eddy_namespace_id);
-            html_file = esp_webserver_format_html(html_file, INSTANCE_PLACEHOLDER, &eddy_instance_id);
+    size_t len = strlen(text);
+    memcpy(out, text, len + 1);
+    return len;
+}
+
+/**
+ * @brief Format the value of a page placeholder. Beacons are stored in binary form,
+ *        this is the only place their fields are turned into text for the page.
+ * 
+ * @param slot - The placeholder to format
+ * @param beacon - The beacon shown on the page, NULL if none was seen yet
+ * @param out - Destination, at least HTML_VALUE_MAX_LEN bytes
+ * @return int - The length of the value
+ */
+static int esp_webserver_format_slot(int slot, const esp_eddystone_beacon_t* beacon, char* out)
+{
+    uint8_t frames = beacon ? beacon->frames : 0;
+    int len;
+
+    switch (slot) {
+    case HTML_SLOT_MAC:
+        if (!beacon) break;
+        return fmt_hex(out, beacon->bda, ESP_BD_ADDR_LEN, ':');
+    case HTML_SLOT_NAME:
+        if (!(frames & EDDY_FRAME_UID_SEEN)) break;
+        return fmt_hex(out, beacon->uid.namespace_id, EDDYSTONE_UID_NAMESPACE_LEN, ':');
+    case HTML_SLOT_INSTANCE:
+        if (!(frames & EDDY_FRAME_UID_SEEN)) break;
+        return fmt_hex(out, beacon->uid.instance_id, EDDYSTONE_UID_INSTANCE_LEN, ':');
+    case HTML_SLOT_RSSI:
+        if (!beacon) break;
+        len = fmt_fixed(out, beacon->rssi_filter.rssi, EDDY_RSSI_Q);
+        return len + esp_webserver_append(out + len, " dbm");
+    case HTML_SLOT_DIST:
+        if (!beacon || beacon->distance == EDDY_RSSI_DISTANCE_NONE) break;
+        len = fmt_fixed(out, beacon->distance, EDDY_RSSI_Q);
+        return len + esp_webserver_append(out + len, " m");
+    case HTML_SLOT_URL:
+        if (!(frames & EDDY_FRAME_URL_SEEN)) break;
+        return esp_eddystone_url_expand(beacon->url.encoded, beacon->url.len, out);
+    case HTML_SLOT_VER:
+        if (!(frames & EDDY_FRAME_TLM_SEEN)) break;
+        return fmt_uint(out, beacon->tlm.version);
+    case HTML_SLOT_BAT:
+        if (!(frames & EDDY_FRAME_TLM_SEEN)) break;
+        len = fmt_uint(out, beacon->tlm.battery_voltage);
+        return len + esp_webserver_append(out + len, " mV");
+    case HTML_SLOT_TEMP:
+        if (!(frames & EDDY_FRAME_TLM_SEEN)) break;
+        len = fmt_fixed(out, beacon->tlm.temperature, 8);
+        return len + esp_webserver_append(out + len, " C");
+    case HTML_SLOT_ADV:
+        if (!(frames & EDDY_FRAME_TLM_SEEN)) break;
+        return fmt_uint(out, beacon->tlm.adv_count);
+    case HTML_SLOT_TIME:
+        if (!(frames & EDDY_FRAME_TLM_SEEN)) break;
+        len = fmt_uint(out, beacon->tlm.time / 10);
+        return len + esp_webserver_append(out + len, " s");
+    default:
+        break;
+    }
+    return esp_webserver_append(out, "NOT FOUND");
+}
+
+/**
+ * @brief Split the cached index.html into literal spans and placeholder slots.
+ *        The page is only parsed once, every request renders from the same spans.
+ * 
+ */
+static void esp_webserver_load_template(void)
+{
+    const esp_spiffs_asset_t* html_file = esp_spiffs_cache_get("/spiffs/index.html");
+    if (html_file == NULL) {
+        return;
+    }
+    if (html_file->data == NULL) {
+        ESP_LOGE(WEB_TAG, "index.html too large to be kept in RAM");
+        return;
+    }
+    if (html_template_parse(&html_template, html_file->data, html_file->size, html_placeholders, HTML_SLOT_COUNT)) {
+        ESP_LOGE(WEB_TAG, "index.html has too many placeholders");
+        html_template.span_count = 0;
+    }
+}
+
+/**
+ * @brief esp_spiffs_stream_file() handler, writes each chunk to the connection
+ * 
+ * @param chunk 
+ * @param len 
+ * @param ctx - netconn struct
+ * @return int - Non zero when the write failed
+ */
+static int esp_webserver_write_chunk(const char* chunk, size_t len, void* ctx)
+{
+    return netconn_write((struct netconn*)ctx, chunk, len, NETCONN_COPY) != ERR_OK;
+}
+
+/**
+ * @brief Format an ETag as a quoted hex string
+ * 
+ * @param etag - Destination, WEB_ETAG_MAX_LEN bytes
+ * @param prefix - Tells apart ETags of different representations
+ * @param hi 
+ * @param lo 
+ * @return int - Length of the ETag
+ */
+static int esp_webserver_format_etag(char* etag, char prefix, uint32_t hi, uint32_t lo)
+{
+    uint8_t bytes[8] = {
+        hi >> 24, hi >> 16, hi >> 8, hi, lo >> 24, lo >> 16, lo >> 8, lo
+    };
+    etag[0] = '"';
+    etag[1] = prefix;
+    int len = 2 + fmt_hex(etag + 2, bytes, sizeof(bytes), 0);
+    etag[len++] = '"';
+    etag[len] = '\0';
+    return len;
+}
+
+/**
+ * @brief Check If-None-Match against the current ETag, answering 304 on a match
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @param etag - Current ETag of the resource
+ * @return true - The client copy is fresh and 304 was sent
+ */
+static bool esp_webserver_not_modified(struct netconn *conn, const http_parser_t* req, const char* etag)
+{
+    size_t len;
+    const char* match = http_parser_header(req, "If-None-Match", &len);
+    if (match == NULL) {
+        return false;
+    }
+    /* weak comparison: a cache may hand our ETag back as W/"..." */
+    char weak[WEB_ETAG_MAX_LEN + 2];
+    snprintf(weak, sizeof(weak), "W/%s", etag);
+    if (!(len == 1 && match[0] == '*') &&
+        !http_header_has_token(match, len, etag) && !http_header_has_token(match, len, weak)) {
+        return false;
+    }
+    char hdr[sizeof(http_304_hdr) + WEB_ETAG_MAX_LEN + 4];
+    int hdr_len = snprintf(hdr, sizeof(hdr), http_304_hdr, etag);
+    netconn_write(conn, hdr, hdr_len, NETCONN_COPY);
+    return true;
+}
+
+/**
+ * @brief Send a static file with its validators. The gzip copy built into the
+ *        image (tools/gzip_assets.py) is preferred when the client accepts it,
+ *        a client that already holds the same ETag gets 304 and no body.
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @param file_path - Path of the uncompressed file
+ * @param content_type 
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_send_static(struct netconn *conn, const http_parser_t* req,
+                                      const char* file_path, const char* content_type)
+{
+    char gz_path[SPIFFS_MAX_PATH];
+    const esp_spiffs_asset_t* asset = NULL;
+    const char* encoding = "";
+    size_t len;
+
+    const char* accept = http_parser_header(req, "Accept-Encoding", &len);
+    if (accept && http_header_has_token(accept, len, "gzip") &&
+        snprintf(gz_path, sizeof(gz_path), "%s.gz", file_path) < (int)sizeof(gz_path)) {
+        asset = esp_spiffs_cache_get(gz_path);
+        encoding = "Content-Encoding: gzip\r\n";
+    }
+    if (asset == NULL) {
+        asset = esp_spiffs_cache_get(file_path);
+        encoding = "";
+    }
+    if (asset == NULL) {
+        return netconn_write(conn, http_404_hdr, sizeof(http_404_hdr)-1, NETCONN_NOCOPY) == ERR_OK;
+    }
+
+    char etag[WEB_ETAG_MAX_LEN];
+    esp_webserver_format_etag(etag, encoding[0] ? 'g' : 'i', asset->size, asset->hash);
+    if (esp_webserver_not_modified(conn, req, etag)) {
+        return true;
+    }
+
+    char hdr[256];
+    int hdr_len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-type: %s\r\n%s"
+                           "Content-Length: %u\r\nETag: %s\r\nCache-Control: max-age=%d\r\n"
+                           "Vary: Accept-Encoding\r\n\r\n",
+                           content_type, encoding, (unsigned int)asset->size, etag, WEB_ASSET_MAX_AGE);
+    netconn_write(conn, hdr, hdr_len, NETCONN_COPY | NETCONN_MORE);
+    if (asset->data) {
+        return netconn_write(conn, asset->data, asset->size, NETCONN_NOCOPY) == ERR_OK;
+    }
+    /* A short read would leave the client waiting for the announced length */
+    return esp_spiffs_stream_file(asset->path, esp_webserver_write_chunk, conn) == ESP_OK;
+}
+
+/**
+ * @brief Send the page: every placeholder is formatted once into a stack buffer,
+ *        which gives the Content-Length, then literal spans are sent straight
+ *        from the template text and values in their place
+ * 
+ * @param conn - netconn struct
+ * @param beacon - The beacon shown on the page, NULL if none was seen yet
+ * @param etag - ETag of this version of the page
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_render_page(struct netconn *conn, const esp_eddystone_beacon_t* beacon, const char* etag)
+{
+    char values[HTML_SLOT_COUNT][HTML_VALUE_MAX_LEN];
+    uint8_t lens[HTML_SLOT_COUNT];
+    size_t length = 0;
+
+    for (int slot = 0; slot < HTML_SLOT_COUNT; slot++) {
+        lens[slot] = esp_webserver_format_slot(slot, beacon, values[slot]);
+    }
+    for (int i = 0; i < html_template.span_count; i++) {
+        const html_template_span_t* span = &html_template.spans[i];
+        length += (span->slot == TEMPLATE_LITERAL) ? span->len : lens[span->slot];
+    }
+
+    char hdr[sizeof(http_html_hdr) + FMT_UINT_MAX_LEN + WEB_ETAG_MAX_LEN];
+    int hdr_len = snprintf(hdr, sizeof(hdr), http_html_hdr, (unsigned int)length, etag);
+    err_t err = netconn_write(conn, hdr, hdr_len, NETCONN_COPY | (length ? NETCONN_MORE : 0));
+
+    for (int i = 0; i < html_template.span_count && err == ERR_OK; i++) {
+        const html_template_span_t* span = &html_template.spans[i];
+        u8_t more = (i + 1 < html_template.span_count) ? NETCONN_MORE : 0;
+        if (span->slot == TEMPLATE_LITERAL) {
+            err = netconn_write(conn, html_template.text + span->offset, span->len, NETCONN_NOCOPY | more);
         } else {
-            html_file = esp_webserver_format_html(html_file, MAC_PLACEHOLDER, "NOT FOUND");
-            html_file = esp_webserver_format_html(html_file, NAME_PLACEHOLDER, "NOT FOUND");
-            html_file = esp_webserver_format_html(html_file, INSTANCE_PLACEHOLDER, "NOT FOUND");
+            err = netconn_write(conn, values[span->slot], lens[span->slot], NETCONN_COPY | more);
         }
-        
-        if (eddy_url_received) {
-            html_file = esp_webserver_format_html(html_file, RSSI_PLACEHOLDER, &eddy_tx_power);
-            html_file = esp_webserver_format_html(html_file, URL_PLACEHOLDER, &eddy_url);
-        } else {
-            html_file = esp_webserver_format_html(html_file, RSSI_PLACEHOLDER, "NOT FOUND");
-            html_file = esp_webserver_format_html(html_file, URL_PLACEHOLDER, "NOT FOUND");
+    }
+    return err == ERR_OK;
+}
+
+/**
+ * @brief GET /, the page showing the last seen beacon
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_page(struct netconn *conn, const http_parser_t* req)
+{
+    /* The page only changes with the registry: its ETag is the registry
+       sequence number, read before the beacon so it never runs ahead of it */
+    char etag[WEB_ETAG_MAX_LEN];
+    esp_webserver_format_etag(etag, 'p', html_etag_nonce, esp_eddystone_registry_seq());
+    if (esp_webserver_not_modified(conn, req, etag)) {
+        return true;
+    }
+
+    /* Without index.html the template has no span and the page is empty */
+    esp_eddystone_beacon_t latest;
+    return esp_webserver_render_page(conn, esp_eddystone_registry_read_latest(&latest) ? &latest : NULL, etag);
+}
+
+/**
+ * @brief GET /style.css, gzipped when the client accepts it
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_style(struct netconn *conn, const http_parser_t* req)
+{
+    return esp_webserver_send_static(conn, req, "/spiffs/style.css", "text/css");
+}
+
+/**
+ * @brief GET /api/beacons.bin, the binary beacon snapshot
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_beacons_bin(struct netconn *conn, const http_parser_t* req)
+{
+    return esp_webserver_api_beacons_bin(conn, req);
+}
+
+/**
+ * @brief GET /api/beacons and /api/beacons/AA:BB:CC:DD:EE:FF, beacon data as JSON
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_beacons(struct netconn *conn, const http_parser_t* req)
+{
+    return esp_webserver_api_beacons(conn, req);
+}
+
+/**
+ * @brief GET /api/tlm, the logged TLM history as JSON
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_tlm(struct netconn *conn, const http_parser_t* req)
+{
+    return esp_webserver_api_tlm(conn, req);
+}
+
+/**
+ * @brief GET /api/tlm/stats, rolling temperature statistics per beacon as JSON
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_tlm_stats(struct netconn *conn, const http_parser_t* req)
+{
+    return esp_webserver_api_tlm_stats(conn, req);
+}
+
+/**
+ * @brief GET /api/scan, the scan settings and counters as JSON
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_scan(struct netconn *conn, const http_parser_t* req)
+{
+    return esp_webserver_api_scan(conn, req);
+}
+
+/**
+ * @brief POST /api/scan, change the scan settings from the query string
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_post_scan(struct netconn *conn, const http_parser_t* req)
+{
+    return esp_webserver_api_scan(conn, req);
+}
+
+/**
+ * @brief GET /events, stream decoded frames until the client goes away
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_events(struct netconn *conn, const http_parser_t* req)
+{
+    /* The stream only ends with the connection */
+    esp_webserver_sse_serve(conn);
+    return false;
+}
+
+/**
+ * @brief GET /metrics, counters and latencies in the Prometheus text format
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_get_metrics(struct netconn *conn, const http_parser_t* req)
+{
+    return esp_webserver_api_metrics(conn, req);
+}
+
+/* Routes, new endpoints only need an entry here */
+static const http_route_t web_routes[] = {
+    { HTTP_METHOD_GET,  "/",                        esp_webserver_get_page },
+    { HTTP_METHOD_GET,  "/style.css",               esp_webserver_get_style },
+    { HTTP_METHOD_GET,  API_BEACONS_BIN_PATH,       esp_webserver_get_beacons_bin },
+    { HTTP_METHOD_GET,  API_BEACONS_PATH,           esp_webserver_get_beacons },
+    { HTTP_METHOD_GET,  API_BEACONS_PATH "/*",      esp_webserver_get_beacons },
+    { HTTP_METHOD_GET,  API_TLM_PATH,               esp_webserver_get_tlm },
+    { HTTP_METHOD_GET,  API_TLM_STATS_PATH,         esp_webserver_get_tlm_stats },
+    { HTTP_METHOD_GET,  API_SCAN_PATH,              esp_webserver_get_scan },
+    { HTTP_METHOD_POST, API_SCAN_PATH,              esp_webserver_post_scan },
+    { HTTP_METHOD_GET,  SSE_EVENTS_PATH,            esp_webserver_get_events },
+    { HTTP_METHOD_GET,  API_METRICS_PATH,           esp_webserver_get_metrics },
+};
+#define WEB_ROUTE_COUNT (sizeof(web_routes) / sizeof(web_routes[0]))
+
+/* Request metrics, per route */
+static const uint32_t web_latency_bounds[] = {    /* ns */
+    1000000, 2000000, 5000000, 10000000, 25000000, 50000000,
+    100000000, 250000000, 500000000, 1000000000, 2500000000u
+};
+static metrics_counter_t web_route_requests[WEB_ROUTE_COUNT];
+static metrics_histogram_t web_route_latency[WEB_ROUTE_COUNT];  /*<! handler run time, an event stream lasts as long as its client */
+static metrics_counter_t web_unrouted;      /*<! answered 404 or 405 */
+static metrics_counter_t web_rejected;      /*<! malformed or unsupported requests */
+
+/**
+ * @brief Send a response without a body
+ * 
+ * @param conn - netconn struct
+ * @param status 
+ * @param allowed - HTTP_METHOD_BIT() mask for the Allow header of a 405, 0 otherwise
+ * @param close - The connection is closed after this response
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_send_status(struct netconn *conn, uint16_t status, uint32_t allowed, bool close)
+{
+    char hdr[160];
+    int len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %u %s\r\nContent-Length: 0\r\n%s",
+                       status, http_status_reason(status), close ? "Connection: close\r\n" : "");
+
+    if (allowed) {
+        const char* sep = "Allow: ";
+        for (int m = 0; m < HTTP_METHOD_COUNT; m++) {
+            if (allowed & HTTP_METHOD_BIT(m)) {
+                len += snprintf(hdr + len, sizeof(hdr) - len, "%s%s", sep, http_method_name(m));
+                sep = ", ";
+            }
         }
+        len += snprintf(hdr + len, sizeof(hdr) - len, "\r\n");
+    }
+    len += snprintf(hdr + len, sizeof(hdr) - len, "\r\n");
+    return netconn_write(conn, hdr, len, NETCONN_COPY) == ERR_OK && !close;
+}
 
-        if (eddy_tlm_received) {
-            html_file = esp_webserver_format_html(html_file, VER_PLACEHOLDER, &eddy_tlm_version);
-            html_file = esp_webserver_format_html(html_file, BAT_PLACEHOLDER, &eddy_tlm_battery_voltage);
-            html_file = esp_webserver_format_html(html_file, TEMP_PLACEHOLDER, &eddy_tlm_temperature);
-            html_file = esp_webserver_format_html(html_file, ADV_PLACEHOLDER, &eddy_tlm_adv_count);
-            html_file = esp_webserver_format_html(html_file, TIME_PLACEHOLDER, &eddy_tlm_time);
-        } else {
-            html_file = esp_webserver_format_html(html_file, VER_PLACEHOLDER, "NOT FOUND");
-            html_file = esp_webserver_format_html(html_file, BAT_PLACEHOLDER, "NOT FOUND");
-            html_file = esp_webserver_format_html(html_file, TEMP_PLACEHOLDER, "NOT FOUND");
-            html_file = esp_webserver_format_html(html_file, ADV_PLACEHOLDER, "NOT FOUND");
-            html_file = esp_webserver_format_html(html_file, TIME_PLACEHOLDER, "NOT FOUND");
+/**
+ * @brief Answer a parsed or rejected request
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_dispatch(struct netconn *conn, const http_parser_t* req)
+{
+    if (req->state == HTTP_STATE_ERROR) {
+        /* What follows a malformed request cannot be trusted to start a new one */
+        ESP_LOGW(WEB_TAG, "Rejected request: %u", req->status);
+        metrics_inc(&web_rejected);
+        return esp_webserver_send_status(conn, req->status, 0, true);
+    }
+
+    uint32_t allowed;
+    const http_route_t* route = http_route_find(web_routes, WEB_ROUTE_COUNT, req, &allowed);
+    ESP_LOGI(WEB_TAG, "%s %s", http_method_name(req->method), http_parser_target(req));
+    bool keep_alive;
+    if (route) {
+        size_t index = route - web_routes;
+        int64_t start = esp_timer_get_time();
+        keep_alive = route->handler(conn, req);
+        int64_t ns = (esp_timer_get_time() - start) * 1000;
+        metrics_inc(&web_route_requests[index]);
+        metrics_observe(&web_route_latency[index], ns < UINT32_MAX ? (uint32_t)ns : UINT32_MAX);
+    } else {
+        metrics_inc(&web_unrouted);
+        keep_alive = esp_webserver_send_status(conn, allowed ? 405 : 404, allowed, false);
+    }
+    metrics_boot_mark(METRICS_BOOT_FIRST_HTTP_RESPONSE);
+    return keep_alive && !(req->flags & HTTP_FLAG_CLOSE);
+}
+
+/**
+ * @brief Write the request metrics
+ * 
+ * @param w 
+ */
+void esp_webserver_write_metrics(metrics_writer_t* w)
+{
+    char labels[WEB_ROUTE_COUNT][48];
+
+    for (size_t i = 0; i < WEB_ROUTE_COUNT; i++) {
+        snprintf(labels[i], sizeof(labels[i]), "route=\"%s %s\"",
+                 http_method_name(web_routes[i].method), web_routes[i].path);
+    }
+
+    metrics_write_help(w, "http_requests_total", "counter", "Requests answered, per route");
+    for (size_t i = 0; i < WEB_ROUTE_COUNT; i++) {
+        metrics_write_value(w, "http_requests_total", labels[i], metrics_counter_read(&web_route_requests[i]));
+    }
+    metrics_write_help(w, "http_requests_unrouted_total", "counter", "Requests answered 404 or 405");
+    metrics_write_value(w, "http_requests_unrouted_total", NULL, metrics_counter_read(&web_unrouted));
+    metrics_write_help(w, "http_requests_rejected_total", "counter", "Malformed or unsupported requests");
+    metrics_write_value(w, "http_requests_rejected_total", NULL, metrics_counter_read(&web_rejected));
+
+    metrics_write_help(w, "http_request_duration_seconds", "histogram", "Time to render and send a response, per route");
+    for (size_t i = 0; i < WEB_ROUTE_COUNT; i++) {
+        metrics_write_histogram(w, "http_request_duration_seconds", labels[i], &web_route_latency[i]);
+    }
+}
+
+/**
+ * @brief Wait for request data. Between requests a kept alive connection waits
+ *        at most WEB_KEEPALIVE_IDLE_MS, and gives its worker up as soon as
+ *        another client is queued.
+ * 
+ * @param conn - netconn struct
+ * @param inbuf 
+ * @param idle - No request is in progress
+ * @return err_t - ERR_TIMEOUT when the connection should be dropped
+ */
+static err_t esp_webserver_recv(struct netconn *conn, struct netbuf **inbuf, bool idle)
+{
+    if (!idle) {
+        netconn_set_recvtimeout(conn, WEB_RECV_TIMEOUT_MS);
+        return netconn_recv(conn, inbuf);
+    }
+
+    netconn_set_recvtimeout(conn, WEB_KEEPALIVE_POLL_MS);
+    for (int waited = 0; waited < WEB_KEEPALIVE_IDLE_MS; waited += WEB_KEEPALIVE_POLL_MS) {
+        err_t err = netconn_recv(conn, inbuf);
+        if (err != ERR_TIMEOUT || uxQueueMessagesWaiting(web_conn_queue)) {
+            return err;
         }
+    }
+    return ERR_TIMEOUT;
+}
 
-        netconn_write(conn, html_file, strlen(html_file), NETCONN_NOCOPY);
-      } 
-      else if(!strncmp(buf, "GET /style.css", 14)) {
-        /* Send our CSS file */
-        css_file = esp_spiffs_read_file("/spiffs/style.css");
-        netconn_write(conn, css_file, strlen(css_file), NETCONN_NOCOPY);
-      }
-      esp_spiffs_unmount();
+/**
+ * @brief Handles the HTTP requests of a connection until it is closed, idle
+ *        or an unframed response ends it. Pipelined requests are answered in order.
+ * 
+ * @param conn - netconn struct
+ * @param req - Parser of this worker
+ */
+static void esp_webserver_netconn_serve(struct netconn *conn, http_parser_t* req)
+{
+    struct netbuf *inbuf;
+    void *data;
+    u16_t len;
+    int served = 0;
+    bool keep_alive = true;
+
+    http_parser_init(req);
+    while (keep_alive) {
+        /* The first request gets the full timeout, the next ones the idle one */
+        err_t err = esp_webserver_recv(conn, &inbuf, served > 0 && req->len == 0);
+        if (err != ERR_OK) {
+            if (err == ERR_TIMEOUT && req->len) {
+                esp_webserver_send_status(conn, 408, 0, true);
+            }
+            break;
+        }
+        do {
+            netbuf_data(inbuf, &data, &len);
+            const char* p = data;
+            /* A segment may end one request and start the next one */
+            while (len && keep_alive) {
+                size_t used = http_parser_feed(req, p, len);
+                p += used;
+                len -= used;
+                if (req->state < HTTP_STATE_DONE) {
+                    break;
+                }
+                keep_alive = esp_webserver_dispatch(conn, req) && ++served < WEB_KEEPALIVE_MAX_REQUESTS;
+                http_parser_init(req);
+            }
+        } while (keep_alive && netbuf_next(inbuf) >= 0);
+        /* netconn_recv gives us ownership of the buffer */
+        netbuf_delete(inbuf);
     }
-    /* Close the connection (server closes in HTTP) */
+
     netconn_close(conn);
+}
 
-    /* Delete the buffer (netconn_recv gives us ownership,
-    so we have to make sure to deallocate the buffer) */
-    netbuf_delete(inbuf);
+/**
+ * @brief Connection worker, serves the connections queued by the accept loop
+ * 
+ * @param pvParameters - Request parser of the worker
+ */
+static void esp_webserver_worker(void *pvParameters)
+{
+    http_parser_t* req = pvParameters;
+    struct netconn *conn;
+
+    for (;;) {
+        if (xQueueReceive(web_conn_queue, &conn, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        /* A client that stops sending only holds this worker for the timeout */
+        esp_webserver_netconn_serve(conn, req);
+        netconn_delete(conn);
+    }
 }
 
 /**
@@ -212,21 +694,61 @@ static void esp_webserver_http_server(void *pvParameters)
 {
     struct netconn *conn, *newconn;
     err_t err;
+
+    /* Load the assets once, requests are served from RAM */
+    esp_spiffs_cache_get("/spiffs/style.css");
+    esp_spiffs_cache_get("/spiffs/style.css.gz");
+    esp_webserver_load_template();
+    html_etag_nonce = esp_random();
+    esp_webserver_api_init();
+
+    /* Spread the workers over both cores */
+    for (int i = 0; i < WEB_WORKER_COUNT; i++) {
+        char name[configMAX_TASK_NAME_LEN];
+        TaskHandle_t worker = NULL;
+        snprintf(name, sizeof(name), "esp_web_worker%d", i);
+        xTaskCreatePinnedToCore(&esp_webserver_worker, name, WEB_WORKER_STACK_SIZE, &web_parsers[i], 5, &worker, i % portNUM_PROCESSORS);
+        metrics_register_task(worker);
+    }
+
+    /* BLE comes up meanwhile, the server only waits for the network here */
+    xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
     conn = netconn_new(NETCONN_TCP);
     netconn_bind(conn, NULL, 80);
     netconn_listen(conn);
+    metrics_boot_mark(METRICS_BOOT_HTTP_LISTENING);
     do {
       err = netconn_accept(conn, &newconn);
       if (err == ERR_OK) {
-        esp_webserver_netconn_serve(newconn);
-        netconn_delete(newconn);
+        /* Hand the connection to a worker, drop it if they are all backed up */
+        if (xQueueSend(web_conn_queue, &newconn, pdMS_TO_TICKS(WEB_QUEUE_TIMEOUT_MS)) != pdTRUE) {
+          ESP_LOGW(WEB_TAG, "Connection queue full, dropping client");
+          netconn_write(newconn, http_503_hdr, sizeof(http_503_hdr)-1, NETCONN_NOCOPY);
+          netconn_close(newconn);
+          netconn_delete(newconn);
+        }
       }
     } while(err == ERR_OK);
     netconn_close(conn);
     netconn_delete(conn);
 }
 
+/**
+ * @brief Create the accept loop task and the queue feeding its workers.
+ *        Must be called before esp_eddystone_init() so the event stream
+ *        receives the decoded frames.
+ * 
+ */
 void esp_webserver_create_task(void)
 {
-    xTaskCreate(&esp_webserver_http_server, "esp_webserver_http_server", 8192, NULL, 5, NULL);
+    TaskHandle_t server = NULL;
+
+    for (size_t i = 0; i < WEB_ROUTE_COUNT; i++) {
+        metrics_histogram_init(&web_route_latency[i], web_latency_bounds,
+                               sizeof(web_latency_bounds) / sizeof(web_latency_bounds[0]));
+    }
+    web_conn_queue = xQueueCreate(WEB_CONN_QUEUE_LEN, sizeof(struct netconn*));
+    esp_webserver_sse_init();
+    xTaskCreate(&esp_webserver_http_server, "esp_webserver_http_server", 8192, NULL, 5, &server);
+    metrics_register_task(server);
 }
\ No newline at end of file
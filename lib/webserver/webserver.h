@@ -16,6 +16,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/queue.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
@@ -23,14 +24,36 @@
 #include "nvs_flash.h"
 #include "spiffs.h"
 #include "eddystone_api.h"
+#include "eddystone_registry.h"
+#include "html_template.h"
+#include "http_parser.h"
+#include "format.h"
+#include "metrics.h"
+#include "webserver_api.h"
+#include "webserver_sse.h"
+#include "webserver_stream.h"
 
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 #include "lwip/api.h"
+#include "lwip/apps/sntp.h"
 
 /* WIFI parametrs (Change to match you network) */
 #define WIFI_SSID "YOUR_SSID"
 #define WIFI_PASS "YOUR_PASS"
+#define WIFI_SNTP_SERVER "pool.ntp.org"     /* sets the clock of the TLM log once connected */
+
+/* HTTP server parameters */
+#define WEB_WORKER_COUNT 4              /* connections served in parallel */
+#define WEB_WORKER_STACK_SIZE 7168
+#define WEB_CONN_QUEUE_LEN 8            /* accepted connections waiting for a worker */
+#define WEB_QUEUE_TIMEOUT_MS 500        /* wait for a queue slot before refusing a client */
+#define WEB_RECV_TIMEOUT_MS 5000        /* drop clients that stop sending in the middle of a request */
+#define WEB_KEEPALIVE_IDLE_MS 5000      /* close kept alive connections idle for this long */
+#define WEB_KEEPALIVE_POLL_MS 250       /* idle connections give their worker up to queued clients this often */
+#define WEB_KEEPALIVE_MAX_REQUESTS 100  /* requests served on one connection */
+#define WEB_ASSET_MAX_AGE 300           /* s a static file is used without revalidation */
+#define WEB_ETAG_MAX_LEN 20             /* quoted prefix and 16 hex digits */
 
 /* HTML placeholders defines */
 #define NAME_PLACEHOLDER "%NAME%"
@@ -43,16 +66,40 @@
 #define TEMP_PLACEHOLDER "%TEMP%"
 #define ADV_PLACEHOLDER "%ADV%"
 #define TIME_PLACEHOLDER "%TIME%"
+#define DIST_PLACEHOLDER "%DIST%"
+#define HTML_VALUE_MAX_LEN EDDYSTONE_URL_DECODED_MAX_LEN    /* longest placeholder value, an expanded URL */
+
+/* Template slot of each placeholder */
+typedef enum {
+    HTML_SLOT_MAC = 0,
+    HTML_SLOT_NAME,
+    HTML_SLOT_INSTANCE,
+    HTML_SLOT_RSSI,
+    HTML_SLOT_URL,
+    HTML_SLOT_VER,
+    HTML_SLOT_BAT,
+    HTML_SLOT_TEMP,
+    HTML_SLOT_ADV,
+    HTML_SLOT_TIME,
+    HTML_SLOT_DIST,
+    HTML_SLOT_COUNT
+} esp_webserver_html_slot_t;
 
 /* Static variables */
 static const char *WEB_TAG = "WEB SERVER";
-static const char http_html_hdr[] = "HTTP/1.1 200 OK\r\nContent-type: text/html\r\n\r\n";
-
-/* Public Global Variables */
-uint8_t wifi_got_ip;
+static const char http_html_hdr[] = "HTTP/1.1 200 OK\r\nContent-type: text/html\r\nContent-Length: %u\r\nETag: %s\r\nCache-Control: no-cache\r\n\r\n";
+static const char http_304_hdr[] = "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n";
+static const char http_len_hdr[] = "HTTP/1.1 200 OK\r\nContent-type: %s\r\nContent-Length: %u\r\n\r\n";
+static const char http_chunked_hdr[] = "HTTP/1.1 200 OK\r\nContent-type: %s\r\nTransfer-Encoding: chunked\r\n\r\n";
+static const char http_close_hdr[] = "HTTP/1.1 200 OK\r\nContent-type: %s\r\nConnection: close\r\n\r\n";
+static const char http_400_hdr[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+static const char http_404_hdr[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+static const char http_409_hdr[] = "HTTP/1.1 409 Conflict\r\nContent-Length: 0\r\n\r\n";
+static const char http_503_hdr[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
 
 /* Public functions */
 void esp_webserver_wifi_init(void);
 void esp_webserver_create_task(void);
+void esp_webserver_write_metrics(metrics_writer_t* w);
 
 #endif /* __WEBSERVER_H__ */
\ No newline at end of file
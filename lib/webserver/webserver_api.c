@@ -0,0 +1,704 @@
+/**
+ * @file webserver_api.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the JSON API of the webserver.
+ *
+ *        GET /api/beacons        every tracked beacon
+ *        GET /api/beacons/{mac}  one beacon, mac as AA:BB:CC:DD:EE:FF
+ *        GET /api/beacons.bin    binary snapshot (see webserver_api.h), optional ?since=seq&epoch=
+ *        GET /api/tlm            logged TLM records, optional ?from=&to= Unix times
+ *        GET /api/tlm/stats      temperature min/max/mean per beacon over the last minute, hour and day
+ *        GET /api/scan           scan profile, duty cycle and per profile counters
+ *        POST /api/scan          change them, ?profile=&mode=adaptive|fixed&duty=&min=&max=
+ *                                &whitelist_add=mac&whitelist_remove=mac
+ * @version 1.0
+ * @date 2020-03-24
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#include "webserver.h"
+#include "webserver_api.h"
+#include "json_writer.h"
+#include "tlmlog.h"
+#include "tlmstats.h"
+#include "uplink.h"
+
+static uint32_t api_bin_epoch;      /* registry sequence numbers restart at 0 on every boot */
+
+/**
+ * @brief Pick the epoch of this boot, call it before the server starts
+ * 
+ */
+void esp_webserver_api_init(void)
+{
+    do {
+        api_bin_epoch = esp_random();
+    } while (api_bin_epoch == 0);   /* 0 is what a client without an epoch sends */
+}
+
+/**
+ * @brief Start a JSON response
+ * 
+ * @param w 
+ * @param out 
+ * @param conn - netconn struct
+ * @param req - The request being answered
+ */
+static void esp_webserver_api_json_begin(json_writer_t* w, esp_webserver_stream_t* out,
+                                         struct netconn* conn, const http_parser_t* req)
+{
+    esp_webserver_stream_init(out, conn, req, "application/json");
+    json_init(w, esp_webserver_stream_write, out);
+}
+
+/**
+ * @brief Finish a JSON response. A document still held in the writer buffer
+ *        is sent with its Content-Length.
+ * 
+ * @param w 
+ * @param out 
+ * @return true - The connection can be reused
+ */
+static bool esp_webserver_api_json_end(json_writer_t* w, esp_webserver_stream_t* out)
+{
+    esp_webserver_stream_length(out, w->len);
+    return esp_webserver_stream_end(out, json_finish(w));
+}
+
+/**
+ * @brief Parse a "AA:BB:CC:DD:EE:FF" device address
+ * 
+ * @param str - Address text, not NUL terminated
+ * @param len - Length of str
+ * @param bda - Parsed address
+ * @return int - 0 on success, -1 if str is not a device address
+ */
+static int esp_webserver_api_parse_mac(const char* str, size_t len, uint8_t* bda)
+{
+    if (len != ESP_BD_ADDR_LEN * 3 - 1) {
+        return -1;
+    }
+    for (int i = 0; i < ESP_BD_ADDR_LEN; i++) {
+        uint8_t byte = 0;
+        for (int j = 0; j < 2; j++) {
+            char c = str[i * 3 + j];
+            byte <<= 4;
+            if (c >= '0' && c <= '9') {
+                byte |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                byte |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                byte |= c - 'A' + 10;
+            } else {
+                return -1;
+            }
+        }
+        if (i < ESP_BD_ADDR_LEN - 1 && str[i * 3 + 2] != ':') {
+            return -1;
+        }
+        bda[i] = byte;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write one beacon as a JSON object
+ * 
+ * @param w 
+ * @param beacon 
+ * @param now - ms since boot
+ */
+static void esp_webserver_api_write_beacon(json_writer_t* w, const esp_eddystone_beacon_t* beacon, uint32_t now)
+{
+    char mac[3 * ESP_BD_ADDR_LEN];
+    char url[EDDYSTONE_URL_DECODED_MAX_LEN];
+    fmt_hex(mac, beacon->bda, ESP_BD_ADDR_LEN, ':');
+
+    json_begin_object(w);
+    json_key(w, "mac");
+    json_string(w, mac);
+    json_key(w, "rssi");
+    json_int(w, beacon->rssi);
+    json_key(w, "rssi_filtered");
+    json_fixed(w, beacon->rssi_filter.rssi, EDDY_RSSI_Q);
+    json_key(w, "distance_m");
+    if (beacon->distance != EDDY_RSSI_DISTANCE_NONE) {
+        json_fixed(w, beacon->distance, EDDY_RSSI_Q);
+    } else {
+        json_null(w);
+    }
+    json_key(w, "age_ms");
+    json_uint(w, now - beacon->last_seen);
+    json_key(w, "tracked_ms");
+    json_uint(w, now - beacon->first_seen);
+    json_key(w, "frames");
+    json_uint(w, beacon->frame_count);
+
+    json_key(w, "uid");
+    if (beacon->frames & EDDY_FRAME_UID_SEEN) {
+        json_begin_object(w);
+        json_key(w, "ranging_data");
+        json_int(w, beacon->uid.ranging_data);
+        json_key(w, "namespace");
+        json_hex(w, beacon->uid.namespace_id, EDDYSTONE_UID_NAMESPACE_LEN);
+        json_key(w, "instance");
+        json_hex(w, beacon->uid.instance_id, EDDYSTONE_UID_INSTANCE_LEN);
+        json_end_object(w);
+    } else {
+        json_null(w);
+    }
+
+    json_key(w, "url");
+    if (beacon->frames & EDDY_FRAME_URL_SEEN) {
+        json_begin_object(w);
+        json_key(w, "tx_power");
+        json_int(w, beacon->url.tx_power);
+        json_key(w, "url");
+        esp_eddystone_url_expand(beacon->url.encoded, beacon->url.len, url);
+        json_string(w, url);
+        json_end_object(w);
+    } else {
+        json_null(w);
+    }
+
+    json_key(w, "tlm");
+    if (beacon->frames & EDDY_FRAME_TLM_SEEN) {
+        json_begin_object(w);
+        json_key(w, "version");
+        json_uint(w, beacon->tlm.version);
+        json_key(w, "battery_mv");
+        json_uint(w, beacon->tlm.battery_voltage);
+        json_key(w, "temperature");
+        json_fixed(w, beacon->tlm.temperature, 8);
+        json_key(w, "adv_count");
+        json_uint(w, beacon->tlm.adv_count);
+        json_key(w, "uptime_ds");
+        json_uint(w, beacon->tlm.time);
+        json_end_object(w);
+    } else {
+        json_null(w);
+    }
+    json_end_object(w);
+}
+
+typedef struct {
+    json_writer_t*  w;
+    uint32_t        now;
+} esp_webserver_api_list_t;
+
+static void esp_webserver_api_list_cb(const esp_eddystone_beacon_t* beacon, void* ctx)
+{
+    esp_webserver_api_list_t* list = (esp_webserver_api_list_t*)ctx;
+    esp_webserver_api_write_beacon(list->w, beacon, list->now);
+}
+
+/**
+ * @brief Serve GET /api/beacons and GET /api/beacons/{mac}
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+bool esp_webserver_api_beacons(struct netconn *conn, const http_parser_t* req)
+{
+    const char* path = http_parser_target(req);
+    size_t path_len = req->path_len;     /* the query string is not part of the beacon address */
+    json_writer_t w;
+    esp_webserver_stream_t out;
+    uint32_t now = esp_eddystone_registry_now();
+    const size_t prefix_len = sizeof(API_BEACONS_PATH) - 1;
+
+    if (path_len == prefix_len) {
+        esp_webserver_api_list_t list = { .w = &w, .now = now };
+
+        esp_webserver_api_json_begin(&w, &out, conn, req);
+        json_begin_object(&w);
+        json_key(&w, "count");
+        json_uint(&w, esp_eddystone_registry_count());
+        json_key(&w, "beacons");
+        json_begin_array(&w);
+        esp_eddystone_registry_foreach(esp_webserver_api_list_cb, &list);
+        json_end_array(&w);
+        json_end_object(&w);
+        return esp_webserver_api_json_end(&w, &out);
+    }
+
+    uint8_t bda[ESP_BD_ADDR_LEN];
+    if (path[prefix_len] != '/' ||
+        esp_webserver_api_parse_mac(path + prefix_len + 1, path_len - prefix_len - 1, bda)) {
+        return netconn_write(conn, http_400_hdr, sizeof(http_400_hdr)-1, NETCONN_NOCOPY) == ERR_OK;
+    }
+    esp_eddystone_beacon_t beacon;
+    if (!esp_eddystone_registry_read_bda(bda, &beacon)) {
+        return netconn_write(conn, http_404_hdr, sizeof(http_404_hdr)-1, NETCONN_NOCOPY) == ERR_OK;
+    }
+    esp_webserver_api_json_begin(&w, &out, conn, req);
+    esp_webserver_api_write_beacon(&w, &beacon, now);
+    return esp_webserver_api_json_end(&w, &out);
+}
+
+/**
+ * @brief Find a query parameter ("?name=value&...")
+ * 
+ * @param target - Request target with its query string, not NUL terminated
+ * @param target_len - Length of target
+ * @param name - Parameter name
+ * @param value_len - Length of the value
+ * @return const char* - The value, not NUL terminated, or NULL when the parameter is missing
+ */
+static const char* esp_webserver_api_query(const char* target, size_t target_len, const char* name, size_t* value_len)
+{
+    const char* query = memchr(target, '?', target_len);
+    const char* end = target + target_len;
+    size_t name_len = strlen(name);
+
+    while (query && query < end) {
+        query++;
+        if ((size_t)(end - query) > name_len && !memcmp(query, name, name_len) && query[name_len] == '=') {
+            const char* value = query + name_len + 1;
+            const char* value_end = memchr(value, '&', end - value);
+            *value_len = (value_end ? value_end : end) - value;
+            return value;
+        }
+        query = memchr(query, '&', end - query);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Read an unsigned query parameter
+ * 
+ * @param target - Request target with its query string, not NUL terminated
+ * @param target_len - Length of target
+ * @param name - Parameter name
+ * @param value - Parsed value, untouched when the parameter is missing
+ */
+static void esp_webserver_api_query_uint(const char* target, size_t target_len, const char* name, uint32_t* value)
+{
+    size_t len;
+    const char* p = esp_webserver_api_query(target, target_len, name, &len);
+
+    if (p) {
+        uint32_t v = 0;
+        for (const char* end = p + len; p < end && *p >= '0' && *p <= '9'; p++) {
+            v = v * 10 + (*p - '0');
+        }
+        *value = v;
+    }
+}
+
+/**
+ * @brief Fill the wire record of a beacon
+ * 
+ * @param beacon 
+ * @param record 
+ */
+static void esp_webserver_api_bin_record(const esp_eddystone_beacon_t* beacon, esp_webserver_bin_record_t* record)
+{
+    memset(record, 0, sizeof(esp_webserver_bin_record_t));
+    memcpy(record->bda, beacon->bda, ESP_BD_ADDR_LEN);
+    record->frames = beacon->frames;
+    record->rssi = beacon->rssi;
+    record->seq = beacon->seq;
+    record->first_seen = beacon->first_seen;
+    record->last_seen = beacon->last_seen;
+    record->frame_count = beacon->frame_count;
+    record->ranging_data = beacon->uid.ranging_data;
+    memcpy(record->namespace_id, beacon->uid.namespace_id, EDDYSTONE_UID_NAMESPACE_LEN);
+    memcpy(record->instance_id, beacon->uid.instance_id, EDDYSTONE_UID_INSTANCE_LEN);
+    record->tx_power = beacon->url.tx_power;
+    record->url_len = beacon->url.len;
+    memcpy(record->url, beacon->url.encoded, beacon->url.len);
+    record->tlm_version = beacon->tlm.version;
+    record->battery_voltage = beacon->tlm.battery_voltage;
+    record->temperature = beacon->tlm.temperature;
+    record->adv_count = beacon->tlm.adv_count;
+    record->uptime = beacon->tlm.time;
+    record->rssi_filtered = (int16_t)beacon->rssi_filter.rssi;
+    record->distance = beacon->distance;
+}
+
+/**
+ * @brief Serve GET /api/beacons.bin. The beacons to send are picked first so the
+ *        header count and Content-Length are known before any record is written.
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+bool esp_webserver_api_beacons_bin(struct netconn *conn, const http_parser_t* req)
+{
+    const char* target = http_parser_target(req);
+    size_t target_len = req->target_len;
+    uint16_t picked[EDDY_REGISTRY_SIZE];
+    uint8_t out[8 * sizeof(esp_webserver_bin_record_t)];
+    char hdr[96];
+    uint32_t since = 0;
+    uint32_t epoch = 0;
+    esp_webserver_bin_header_t header;
+    esp_eddystone_beacon_t beacon;
+    size_t len = 0;
+
+    esp_webserver_api_query_uint(target, target_len, "since", &since);
+    esp_webserver_api_query_uint(target, target_len, "epoch", &epoch);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = API_BIN_MAGIC;
+    header.version = API_BIN_VERSION;
+    header.header_size = sizeof(esp_webserver_bin_header_t);
+    header.record_size = sizeof(esp_webserver_bin_record_t);
+    header.seq = esp_eddystone_registry_seq();
+    header.now = esp_eddystone_registry_now();
+    header.epoch = api_bin_epoch;
+    /* removed beacons cannot be sent as a delta. The sequence restarts at 0 on
+       every boot, a since of another epoch says nothing about this table */
+    if (since == 0 || epoch != api_bin_epoch ||
+        since < esp_eddystone_registry_removed_seq() || since > header.seq) {
+        header.flags |= API_BIN_FLAG_FULL;
+        since = 0;
+    }
+    for (uint16_t i = 0; i < EDDY_REGISTRY_SIZE; i++) {
+        if (esp_eddystone_registry_read(i, &beacon) && beacon.seq > since) {
+            picked[header.count++] = i;
+        }
+    }
+
+    int hdr_len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-type: application/octet-stream\r\n"
+                           "Content-Length: %u\r\n\r\n",
+                           (unsigned)(sizeof(header) + header.count * sizeof(esp_webserver_bin_record_t)));
+    netconn_write(conn, hdr, hdr_len, NETCONN_COPY | NETCONN_MORE);
+    memcpy(out, &header, sizeof(header));
+    len = sizeof(header);
+
+    for (uint16_t i = 0; i < header.count; i++) {
+        esp_webserver_bin_record_t* record = (esp_webserver_bin_record_t*)&out[len];
+        if (esp_eddystone_registry_read(picked[i], &beacon)) {
+            esp_webserver_api_bin_record(&beacon, record);
+        } else {
+            /* expired meanwhile, keep the announced count with an empty record */
+            memset(record, 0, sizeof(esp_webserver_bin_record_t));
+        }
+        len += sizeof(esp_webserver_bin_record_t);
+        if (len + sizeof(esp_webserver_bin_record_t) > sizeof(out)) {
+            if (netconn_write(conn, out, len, NETCONN_COPY | NETCONN_MORE) != ERR_OK) {
+                return false;
+            }
+            len = 0;
+        }
+    }
+    return netconn_write(conn, out, len, NETCONN_COPY) == ERR_OK;
+}
+
+static int esp_webserver_api_tlm_cb(const esp_tlmlog_record_t* record, void* ctx)
+{
+    json_writer_t* w = (json_writer_t*)ctx;
+    char mac[3 * ESP_BD_ADDR_LEN];
+    fmt_hex(mac, record->bda, ESP_BD_ADDR_LEN, ':');
+
+    json_begin_object(w);
+    json_key(w, "timestamp");
+    if (record->timestamp) {
+        json_uint(w, record->timestamp);
+    } else {
+        json_null(w);
+    }
+    json_key(w, "boot");
+    json_uint(w, record->boot);
+    json_key(w, "gateway_uptime_ms");
+    json_uint(w, record->uptime);
+    json_key(w, "mac");
+    json_string(w, mac);
+    json_key(w, "battery_mv");
+    json_uint(w, record->batt);
+    json_key(w, "temperature");
+    json_fixed(w, record->temp, 8);
+    json_key(w, "adv_count");
+    json_uint(w, record->adv_count);
+    json_key(w, "uptime_ds");
+    json_uint(w, record->time);
+    json_end_object(w);
+    return w->error;
+}
+
+/**
+ * @brief Serve GET /api/tlm, the logged TLM history read straight from flash
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+bool esp_webserver_api_tlm(struct netconn *conn, const http_parser_t* req)
+{
+    const char* target = http_parser_target(req);
+    size_t target_len = req->target_len;
+    json_writer_t w;
+    esp_webserver_stream_t out;
+    uint32_t from = 0;
+    uint32_t to = UINT32_MAX;
+
+    esp_webserver_api_query_uint(target, target_len, "from", &from);
+    esp_webserver_api_query_uint(target, target_len, "to", &to);
+
+    esp_webserver_api_json_begin(&w, &out, conn, req);
+    json_begin_array(&w);
+    esp_tlmlog_query(from, to, esp_webserver_api_tlm_cb, &w);
+    json_end_array(&w);
+    return esp_webserver_api_json_end(&w, &out);
+}
+
+/**
+ * @brief Serve GET /api/tlm/stats, the rolling temperature statistics of every TLM beacon
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+bool esp_webserver_api_tlm_stats(struct netconn *conn, const http_parser_t* req)
+{
+    json_writer_t w;
+    esp_webserver_stream_t out;
+    esp_tlmstats_t stats;
+    char mac[3 * ESP_BD_ADDR_LEN];
+    uint32_t now = esp_eddystone_registry_now();
+
+    esp_webserver_api_json_begin(&w, &out, conn, req);
+    json_begin_object(&w);
+    json_key(&w, "windows");
+    json_begin_object(&w);
+    for (int i = 0; i < TLMSTATS_WINDOW_COUNT; i++) {
+        json_key(&w, esp_tlmstats_window_name(i));
+        json_uint(&w, esp_tlmstats_window_seconds(i));
+    }
+    json_end_object(&w);
+    json_key(&w, "beacons");
+    json_begin_array(&w);
+    for (uint16_t i = 0; i < TLMSTATS_MAX_BEACONS && !w.error; i++) {
+        if (!esp_tlmstats_read(i, &stats)) {
+            continue;
+        }
+        fmt_hex(mac, stats.bda, ESP_BD_ADDR_LEN, ':');
+        json_begin_object(&w);
+        json_key(&w, "mac");
+        json_string(&w, mac);
+        json_key(&w, "last");
+        json_fixed(&w, stats.last, 8);
+        json_key(&w, "age_ms");
+        json_uint(&w, now - stats.last_ms);
+        for (int j = 0; j < TLMSTATS_WINDOW_COUNT; j++) {
+            const esp_tlmstats_window_t* win = &stats.windows[j];
+            json_key(&w, esp_tlmstats_window_name(j));
+            if (win->count == 0) {
+                json_null(&w);
+                continue;
+            }
+            json_begin_object(&w);
+            json_key(&w, "count");
+            json_uint(&w, win->count);
+            json_key(&w, "min");
+            json_fixed(&w, win->min, 8);
+            json_key(&w, "max");
+            json_fixed(&w, win->max, 8);
+            json_key(&w, "mean");
+            json_fixed(&w, win->mean, 8);
+            json_end_object(&w);
+        }
+        json_end_object(&w);
+    }
+    json_end_array(&w);
+    json_end_object(&w);
+    return esp_webserver_api_json_end(&w, &out);
+}
+
+/**
+ * @brief Write the scan settings and the counters of every profile
+ * 
+ * @param w 
+ */
+static void esp_webserver_api_write_scan(json_writer_t* w)
+{
+    esp_eddystone_scan_duty_t duty;
+    esp_eddystone_scan_counters_t counters;
+    esp_eddystone_scan_profile_t current = esp_eddystone_scan_get_profile();
+    uint8_t whitelist[EDDY_SCAN_WHITELIST_SIZE][ESP_BD_ADDR_LEN];
+    int count = esp_eddystone_scan_get_whitelist(whitelist);
+    char mac[3 * ESP_BD_ADDR_LEN];
+
+    esp_eddystone_scan_get_duty(&duty);
+
+    json_begin_object(w);
+    json_key(w, "profile");
+    json_string(w, esp_eddystone_scan_get_config(current)->name);
+    json_key(w, "mode");
+    json_string(w, duty.adaptive ? "adaptive" : "fixed");
+    json_key(w, "duty");
+    json_uint(w, duty.duty);
+    json_key(w, "min");
+    json_uint(w, duty.duty_min);
+    json_key(w, "max");
+    json_uint(w, duty.duty_max);
+    json_key(w, "interval_us");
+    json_uint(w, EDDY_SCAN_INTERVAL * EDDY_SCAN_UNIT_US);
+    json_key(w, "window_us");
+    json_uint(w, esp_eddystone_scan_get_window() * EDDY_SCAN_UNIT_US);
+    json_key(w, "whitelist");
+    json_begin_array(w);
+    for (int i = 0; i < count; i++) {
+        fmt_hex(mac, whitelist[i], ESP_BD_ADDR_LEN, ':');
+        json_string(w, mac);
+    }
+    json_end_array(w);
+    json_key(w, "profiles");
+    json_begin_array(w);
+    for (int i = 0; i < EDDY_SCAN_PROFILE_COUNT; i++) {
+        esp_eddystone_scan_get_counters(i, &counters);
+        json_begin_object(w);
+        json_key(w, "name");
+        json_string(w, esp_eddystone_scan_get_config(i)->name);
+        json_key(w, "reports");
+        json_uint(w, counters.reports);
+        json_key(w, "frames");
+        json_uint(w, counters.frames);
+        json_key(w, "restarts");
+        json_uint(w, counters.restarts);
+        json_key(w, "active_ms");
+        json_uint(w, counters.active_ms);
+        json_end_object(w);
+    }
+    json_end_array(w);
+    json_end_object(w);
+}
+
+/**
+ * @brief Apply the scan settings found in the query, missing ones are left unchanged
+ * 
+ * @param target - Request target with its query string, not NUL terminated
+ * @param target_len - Length of target
+ * @return esp_err_t - ESP_ERR_INVALID_ARG if a value is not valid, ESP_ERR_NOT_FOUND when
+ *         removing a beacon not in the whitelist, ESP_ERR_NO_MEM when the whitelist is full,
+ *         ESP_ERR_INVALID_STATE when the whitelist profile would be left with no beacon
+ */
+static esp_err_t esp_webserver_api_update_scan(const char* target, size_t target_len)
+{
+    esp_eddystone_scan_duty_t duty;
+    uint8_t add[ESP_BD_ADDR_LEN], remove[ESP_BD_ADDR_LEN];
+    bool has_add = false, has_remove = false;
+    uint32_t value;
+    size_t len;
+    const char* p;
+    esp_err_t err;
+
+    esp_eddystone_scan_get_duty(&duty);
+
+    if ((p = esp_webserver_api_query(target, target_len, "mode", &len)) != NULL) {
+        if (len == 8 && !memcmp(p, "adaptive", 8)) {
+            duty.adaptive = true;
+        } else if (len == 5 && !memcmp(p, "fixed", 5)) {
+            duty.adaptive = false;
+        } else {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    value = duty.duty;
+    esp_webserver_api_query_uint(target, target_len, "duty", &value);
+    duty.duty = (value > 100) ? 0 : value;
+    value = duty.duty_min;
+    esp_webserver_api_query_uint(target, target_len, "min", &value);
+    duty.duty_min = (value > 100) ? 0 : value;
+    value = duty.duty_max;
+    esp_webserver_api_query_uint(target, target_len, "max", &value);
+    duty.duty_max = (value > 100) ? 101 : value;
+
+    int profile = EDDY_SCAN_PROFILE_COUNT;
+    if ((p = esp_webserver_api_query(target, target_len, "profile", &len)) != NULL) {
+        for (profile = 0; profile < EDDY_SCAN_PROFILE_COUNT; profile++) {
+            const char* name = esp_eddystone_scan_get_config(profile)->name;
+            if (strlen(name) == len && !memcmp(p, name, len)) {
+                break;
+            }
+        }
+        if (profile == EDDY_SCAN_PROFILE_COUNT) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    if ((p = esp_webserver_api_query(target, target_len, "whitelist_add", &len)) != NULL) {
+        if (esp_webserver_api_parse_mac(p, len, add)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        has_add = true;
+    }
+    if ((p = esp_webserver_api_query(target, target_len, "whitelist_remove", &len)) != NULL) {
+        if (esp_webserver_api_parse_mac(p, len, remove)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        has_remove = true;
+    }
+
+    /* the beacon is added before the profile needs it and removed after the
+       profile no longer does */
+    if (has_add && (err = esp_eddystone_scan_whitelist_add(add)) != ESP_OK) {
+        return err;
+    }
+    if (esp_eddystone_scan_set_duty(&duty) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (profile != EDDY_SCAN_PROFILE_COUNT && (err = esp_eddystone_scan_set_profile(profile)) != ESP_OK) {
+        return err;
+    }
+    if (has_remove) {
+        return esp_eddystone_scan_whitelist_remove(remove);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Serve GET /api/scan and POST /api/scan
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+bool esp_webserver_api_scan(struct netconn *conn, const http_parser_t* req)
+{
+    const char* target = http_parser_target(req);
+    size_t target_len = req->target_len;
+    bool update = req->method == HTTP_METHOD_POST;
+    json_writer_t w;
+    esp_webserver_stream_t out;
+
+    if (update) {
+        esp_err_t err = esp_webserver_api_update_scan(target, target_len);
+        if (err != ESP_OK) {
+            const char* hdr = (err == ESP_ERR_INVALID_ARG) ? http_400_hdr :
+                              (err == ESP_ERR_NOT_FOUND) ? http_404_hdr : http_409_hdr;
+            return netconn_write(conn, hdr, strlen(hdr), NETCONN_NOCOPY) == ERR_OK;
+        }
+    }
+    esp_webserver_api_json_begin(&w, &out, conn, req);
+    esp_webserver_api_write_scan(&w);
+    return esp_webserver_api_json_end(&w, &out);
+}
+
+/**
+ * @brief Serve GET /metrics in the Prometheus text format
+ * 
+ * @param conn - netconn struct
+ * @param req - The request
+ * @return true - The connection can be reused
+ */
+bool esp_webserver_api_metrics(struct netconn *conn, const http_parser_t* req)
+{
+    metrics_writer_t w;
+    esp_webserver_stream_t out;
+
+    esp_webserver_stream_init(&out, conn, req, "text/plain; version=0.0.4");
+    metrics_writer_init(&w, esp_webserver_stream_write, &out);
+    esp_eddystone_write_metrics(&w);
+    esp_webserver_write_metrics(&w);
+    esp_tlmlog_write_metrics(&w);
+    esp_uplink_write_metrics(&w);
+    metrics_write_system(&w);
+    esp_webserver_stream_length(&out, w.len);
+    return esp_webserver_stream_end(&out, metrics_writer_finish(&w));
+}
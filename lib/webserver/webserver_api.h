@@ -0,0 +1,83 @@
+/**
+ * @file webserver_api.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the JSON API of the webserver.
+ * @version 1.0
+ * @date 2020-03-24
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef __WEBSERVER_API_H__
+#define __WEBSERVER_API_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "lwip/api.h"
+#include "http_parser.h"
+
+#define API_BEACONS_PATH "/api/beacons"
+#define API_TLM_PATH "/api/tlm"
+#define API_TLM_STATS_PATH "/api/tlm/stats"
+#define API_SCAN_PATH "/api/scan"
+#define API_BEACONS_BIN_PATH "/api/beacons.bin"
+#define API_METRICS_PATH "/metrics"
+
+/* Binary beacon snapshot, little endian: one header then header.count records.
+   A client keeps header.seq and header.epoch and asks for ?since=seq&epoch=epoch
+   next time; when the header has API_BIN_FLAG_FULL set the records replace its
+   whole table. A record with frame_count 0 is a beacon that expired while the
+   snapshot was written. */
+#define API_BIN_MAGIC       0x59444445      /* "EDDY" */
+#define API_BIN_VERSION     3
+#define API_BIN_FLAG_FULL   (1 << 0)        /* full table, beacons missing from it are gone */
+
+typedef struct {
+    uint32_t  magic;
+    uint8_t   version;
+    uint8_t   flags;            /*<! API_BIN_FLAG_* */
+    uint16_t  header_size;      /*<! offset of the first record */
+    uint16_t  record_size;      /*<! size of each record, newer versions only append fields */
+    uint16_t  count;            /*<! records following */
+    uint32_t  seq;              /*<! registry sequence number of this snapshot */
+    uint32_t  now;              /*<! ms since boot of the gateway */
+    /* version 3 */
+    uint32_t  epoch;            /*<! random per boot, sequence numbers of another epoch are meaningless */
+} __attribute__((packed)) esp_webserver_bin_header_t;
+
+typedef struct {
+    uint8_t   bda[6];
+    uint8_t   frames;           /*<! EDDY_FRAME_*_SEEN bitmask */
+    int8_t    rssi;
+    uint32_t  seq;              /*<! sequence number of the last change */
+    uint32_t  first_seen;       /*<! ms since boot */
+    uint32_t  last_seen;        /*<! ms since boot */
+    uint32_t  frame_count;
+    int8_t    ranging_data;
+    uint8_t   namespace_id[10];
+    uint8_t   instance_id[6];
+    int8_t    tx_power;
+    uint8_t   url_len;
+    uint8_t   url[18];          /*<! Eddystone-URL encoding: scheme byte, then the encoded URL */
+    uint8_t   tlm_version;
+    uint16_t  battery_voltage;  /*<! mV */
+    int16_t   temperature;      /*<! degrees Celsius, 8.8 fixed point */
+    uint32_t  adv_count;
+    uint32_t  uptime;           /*<! 0.1 s resolution */
+    /* version 2 */
+    int16_t   rssi_filtered;    /*<! dBm, 8.8 fixed point */
+    uint32_t  distance;         /*<! meters 8.8, 0xFFFFFFFF when unknown */
+} __attribute__((packed)) esp_webserver_bin_record_t;
+
+/* Public functions */
+void esp_webserver_api_init(void);
+bool esp_webserver_api_beacons(struct netconn *conn, const http_parser_t* req);
+bool esp_webserver_api_tlm(struct netconn *conn, const http_parser_t* req);
+bool esp_webserver_api_tlm_stats(struct netconn *conn, const http_parser_t* req);
+bool esp_webserver_api_beacons_bin(struct netconn *conn, const http_parser_t* req);
+bool esp_webserver_api_scan(struct netconn *conn, const http_parser_t* req);
+bool esp_webserver_api_metrics(struct netconn *conn, const http_parser_t* req);
+
+#endif /* __WEBSERVER_API_H__ */
@@ -0,0 +1,230 @@
+/**
+ * @file webserver_sse.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the Server-Sent Events stream of decoded frames.
+ *
+ *        GET /events keeps the connection open and pushes every frame decoded by
+ *        the eddystone module as soon as it is decoded. Each subscriber has its
+ *        own bounded queue, when a client falls behind its oldest frames are
+ *        dropped so the decoder task never waits for the network.
+ * @version 1.0
+ * @date 2020-03-26
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#include "webserver.h"
+#include "webserver_sse.h"
+#include "json_writer.h"
+
+typedef struct {
+    bool                        active;
+    TaskHandle_t                task;       /*<! worker serving the subscriber */
+    uint32_t                    head;       /*<! next event to write */
+    uint32_t                    tail;       /*<! next event to send */
+    uint32_t                    dropped;
+    esp_webserver_sse_event_t   queue[SSE_QUEUE_LEN];
+} esp_webserver_sse_client_t;
+
+static esp_webserver_sse_client_t sse_clients[SSE_MAX_CLIENTS];
+static portMUX_TYPE sse_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char http_sse_hdr[] = "HTTP/1.1 200 OK\r\nContent-type: text/event-stream\r\nCache-Control: no-cache\r\n\r\n";
+static const char sse_keepalive[] = ": keep-alive\n\n";
+
+/**
+ * @brief Eddystone listener, queues the frame for every subscriber
+ * 
+ * @param bda 
+ * @param rssi 
+ * @param res 
+ * @param ctx 
+ */
+static void esp_webserver_sse_publish(const uint8_t* bda, int8_t rssi, const esp_eddystone_result_t* res, void* ctx)
+{
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        esp_webserver_sse_client_t* client = &sse_clients[i];
+        TaskHandle_t task = NULL;
+
+        portENTER_CRITICAL(&sse_lock);
+        if (client->active) {
+            if (client->head - client->tail >= SSE_QUEUE_LEN) {
+                /* drop the oldest frame */
+                client->tail++;
+                client->dropped++;
+            }
+            esp_webserver_sse_event_t* ev = &client->queue[client->head % SSE_QUEUE_LEN];
+            memcpy(ev->bda, bda, ESP_BD_ADDR_LEN);
+            ev->rssi = rssi;
+            ev->res = *res;
+            client->head++;
+            task = client->task;
+        }
+        portEXIT_CRITICAL(&sse_lock);
+
+        if (task) {
+            xTaskNotifyGive(task);
+        }
+    }
+}
+
+/**
+ * @brief Take the oldest queued frame of a subscriber
+ * 
+ * @param client 
+ * @param ev - Copy of the frame
+ * @return true - A frame was copied
+ * @return false - The queue is empty
+ */
+static bool esp_webserver_sse_pop(esp_webserver_sse_client_t* client, esp_webserver_sse_event_t* ev)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&sse_lock);
+    if (client->head != client->tail) {
+        *ev = client->queue[client->tail % SSE_QUEUE_LEN];
+        client->tail++;
+        found = true;
+    }
+    portEXIT_CRITICAL(&sse_lock);
+    return found;
+}
+
+static int esp_webserver_sse_flush(const char* data, size_t len, void* ctx)
+{
+    return netconn_write((struct netconn*)ctx, data, len, NETCONN_COPY) != ERR_OK;
+}
+
+/**
+ * @brief Send one frame as an SSE event named after its frame type
+ * 
+ * @param conn - netconn struct
+ * @param ev 
+ * @return int - Non zero when the client is gone
+ */
+static int esp_webserver_sse_send(struct netconn *conn, const esp_webserver_sse_event_t* ev)
+{
+    json_writer_t w;
+    char mac[3 * ESP_BD_ADDR_LEN];
+    char url[EDDYSTONE_URL_DECODED_MAX_LEN];
+    const esp_eddystone_result_t* res = &ev->res;
+
+    fmt_hex(mac, ev->bda, ESP_BD_ADDR_LEN, ':');
+
+    json_init(&w, esp_webserver_sse_flush, conn);
+    switch (res->common.frame_type) {
+    case EDDYSTONE_FRAME_TYPE_UID:
+        json_raw(&w, "event: uid\ndata: ");
+        json_begin_object(&w);
+        json_key(&w, "mac");
+        json_string(&w, mac);
+        json_key(&w, "rssi");
+        json_int(&w, ev->rssi);
+        json_key(&w, "ranging_data");
+        json_int(&w, res->inform.uid.ranging_data);
+        json_key(&w, "namespace");
+        json_hex(&w, res->inform.uid.namespace_id, EDDYSTONE_UID_NAMESPACE_LEN);
+        json_key(&w, "instance");
+        json_hex(&w, res->inform.uid.instance_id, EDDYSTONE_UID_INSTANCE_LEN);
+        json_end_object(&w);
+        break;
+    case EDDYSTONE_FRAME_TYPE_URL:
+        json_raw(&w, "event: url\ndata: ");
+        json_begin_object(&w);
+        json_key(&w, "mac");
+        json_string(&w, mac);
+        json_key(&w, "rssi");
+        json_int(&w, ev->rssi);
+        json_key(&w, "tx_power");
+        json_int(&w, res->inform.url.tx_power);
+        json_key(&w, "url");
+        esp_eddystone_url_expand(res->inform.url.encoded, res->inform.url.len, url);
+        json_string(&w, url);
+        json_end_object(&w);
+        break;
+    case EDDYSTONE_FRAME_TYPE_TLM:
+        json_raw(&w, "event: tlm\ndata: ");
+        json_begin_object(&w);
+        json_key(&w, "mac");
+        json_string(&w, mac);
+        json_key(&w, "rssi");
+        json_int(&w, ev->rssi);
+        json_key(&w, "version");
+        json_uint(&w, res->inform.tlm.version);
+        json_key(&w, "battery_mv");
+        json_uint(&w, res->inform.tlm.battery_voltage);
+        json_key(&w, "temperature");
+        json_fixed(&w, res->inform.tlm.temperature, 8);
+        json_key(&w, "adv_count");
+        json_uint(&w, res->inform.tlm.adv_count);
+        json_key(&w, "uptime_ds");
+        json_uint(&w, res->inform.tlm.time);
+        json_end_object(&w);
+        break;
+    default:
+        return 0;
+    }
+    json_raw(&w, "\n\n");
+    return json_finish(&w);
+}
+
+/**
+ * @brief Register the SSE publisher on the eddystone module, must be called
+ *        before esp_eddystone_init()
+ * 
+ */
+void esp_webserver_sse_init(void)
+{
+    esp_eddystone_add_listener(esp_webserver_sse_publish, NULL);
+}
+
+/**
+ * @brief Serve GET /events, only returns once the client is gone
+ * 
+ * @param conn - netconn struct
+ */
+void esp_webserver_sse_serve(struct netconn *conn)
+{
+    esp_webserver_sse_client_t* client = NULL;
+    esp_webserver_sse_event_t ev;
+
+    portENTER_CRITICAL(&sse_lock);
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (!sse_clients[i].active) {
+            client = &sse_clients[i];
+            client->active = true;
+            client->task = xTaskGetCurrentTaskHandle();
+            client->head = client->tail = 0;
+            client->dropped = 0;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&sse_lock);
+
+    if (client == NULL) {
+        ESP_LOGW(WEB_TAG, "Too many event subscribers");
+        netconn_write(conn, http_503_hdr, sizeof(http_503_hdr)-1, NETCONN_NOCOPY);
+        return;
+    }
+
+    ESP_LOGI(WEB_TAG, "Event subscriber connected");
+    err_t err = netconn_write(conn, http_sse_hdr, sizeof(http_sse_hdr)-1, NETCONN_NOCOPY);
+    while (err == ERR_OK) {
+        if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SSE_KEEPALIVE_MS))) {
+            err = netconn_write(conn, sse_keepalive, sizeof(sse_keepalive)-1, NETCONN_NOCOPY);
+            continue;
+        }
+        while (err == ERR_OK && esp_webserver_sse_pop(client, &ev)) {
+            if (esp_webserver_sse_send(conn, &ev)) {
+                err = ERR_CLSD;
+            }
+        }
+    }
+
+    portENTER_CRITICAL(&sse_lock);
+    client->active = false;
+    client->task = NULL;
+    portEXIT_CRITICAL(&sse_lock);
+    ESP_LOGI(WEB_TAG, "Event subscriber gone, %u frames dropped", client->dropped);
+}
@@ -0,0 +1,35 @@
+/**
+ * @file webserver_sse.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the Server-Sent Events stream of decoded frames.
+ * @version 1.0
+ * @date 2020-03-26
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef __WEBSERVER_SSE_H__
+#define __WEBSERVER_SSE_H__
+
+#include <stdint.h>
+#include "lwip/api.h"
+#include "eddystone_api.h"
+
+#define SSE_EVENTS_PATH "/events"
+#define SSE_MAX_CLIENTS 2           /* each subscriber holds a worker, keep below WEB_WORKER_COUNT */
+#define SSE_QUEUE_LEN 16            /* pending frames per subscriber, the oldest are dropped */
+#define SSE_KEEPALIVE_MS 15000      /* idle streams get a comment to detect closed clients */
+
+/* Decoded frame waiting to be sent */
+typedef struct {
+    uint8_t                 bda[ESP_BD_ADDR_LEN];
+    int8_t                  rssi;
+    esp_eddystone_result_t  res;
+} esp_webserver_sse_event_t;
+
+/* Public functions */
+void esp_webserver_sse_init(void);
+void esp_webserver_sse_serve(struct netconn *conn);
+
+#endif /* __WEBSERVER_SSE_H__ */
@@ -0,0 +1,121 @@
+/**
+ * @file webserver_stream.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the writer of generated responses.
+ *
+ *        Generated documents (JSON, metrics) are built in the small buffer of
+ *        their writer, this is its flush callback. A document that never
+ *        outgrows the buffer is sent with a Content-Length. A larger one is
+ *        sent as it is generated with chunked transfer encoding, one chunk per
+ *        buffer, so a response of any size holds no more RAM than the writer
+ *        buffer and the connection stays reusable. HTTP/1.0 clients do not read
+ *        chunks, their body ends with the connection.
+ * @version 1.0
+ * @date 2020-04-10
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include "webserver.h"
+#include "webserver_stream.h"
+
+/**
+ * @brief Start a generated response
+ *
+ * @param s
+ * @param conn - netconn struct
+ * @param req - The request being answered
+ * @param content_type
+ */
+void esp_webserver_stream_init(esp_webserver_stream_t* s, struct netconn* conn,
+                               const http_parser_t* req, const char* content_type)
+{
+    s->conn = conn;
+    s->content_type = content_type;
+    s->chunked = req->version >= 1;
+    s->header_sent = false;
+    s->chunk_open = false;
+    s->keep_alive = true;
+}
+
+/**
+ * @brief json_writer_t and metrics_writer_t flush handler. Called before the
+ *        document is finished only when it outgrew the writer buffer: its length
+ *        is unknown, the body is sent in chunks.
+ *
+ * @param data
+ * @param len
+ * @param ctx - esp_webserver_stream_t struct
+ * @return int - Non zero when the write failed
+ */
+int esp_webserver_stream_write(const char* data, size_t len, void* ctx)
+{
+    esp_webserver_stream_t* s = (esp_webserver_stream_t*)ctx;
+    err_t err;
+
+    if (!s->header_sent) {
+        char hdr[sizeof(http_chunked_hdr) + 32];
+        int hdr_len = snprintf(hdr, sizeof(hdr), s->chunked ? http_chunked_hdr : http_close_hdr, s->content_type);
+        s->header_sent = true;
+        s->keep_alive = s->chunked;
+        netconn_write(s->conn, hdr, hdr_len, NETCONN_COPY | NETCONN_MORE);
+    }
+    if (!s->chunked) {
+        return netconn_write(s->conn, data, len, NETCONN_COPY) != ERR_OK;
+    }
+    if (len == 0) {
+        return 0;   /* an empty chunk would end the body */
+    }
+
+    char size[STREAM_CHUNK_HDR_LEN];
+    int size_len = snprintf(size, sizeof(size), "%s%x\r\n", s->chunk_open ? "\r\n" : "", (unsigned int)len);
+    s->chunk_open = true;
+    err = netconn_write(s->conn, size, size_len, NETCONN_COPY | NETCONN_MORE);
+    if (err == ERR_OK) {
+        err = netconn_write(s->conn, data, len, NETCONN_COPY | NETCONN_MORE);
+    }
+    return err != ERR_OK;
+}
+
+/**
+ * @brief Send the header of a document that never left the writer buffer,
+ *        its length is known. Call it before finishing the writer.
+ *
+ * @param s
+ * @param len - Bytes held in the writer buffer
+ */
+void esp_webserver_stream_length(esp_webserver_stream_t* s, size_t len)
+{
+    if (!s->header_sent) {
+        char hdr[sizeof(http_len_hdr) + 32 + FMT_UINT_MAX_LEN];
+        int hdr_len = snprintf(hdr, sizeof(hdr), http_len_hdr, s->content_type, (unsigned int)len);
+        s->header_sent = true;
+        s->chunked = false;
+        netconn_write(s->conn, hdr, hdr_len, NETCONN_COPY | NETCONN_MORE);
+    }
+}
+
+/**
+ * @brief End the response once the writer is finished
+ *
+ * @param s
+ * @param error - Result of finishing the writer
+ * @return true - The connection can be reused
+ */
+bool esp_webserver_stream_end(esp_webserver_stream_t* s, int error)
+{
+    static const char last_chunk[] = "\r\n0\r\n\r\n";
+
+    if (error) {
+        return false;
+    }
+    if (s->chunked) {
+        /* the CRLF of the last data chunk, then the zero size chunk */
+        size_t skip = s->chunk_open ? 0 : 2;
+        if (netconn_write(s->conn, last_chunk + skip, sizeof(last_chunk) - 1 - skip, NETCONN_NOCOPY) != ERR_OK) {
+            return false;
+        }
+    }
+    return s->keep_alive;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file webserver_stream.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief This file contains the writer of generated responses.
+ * @version 1.0
+ * @date 2020-04-10
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __WEBSERVER_STREAM_H__
+#define __WEBSERVER_STREAM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "lwip/api.h"
+#include "http_parser.h"
+
+#define STREAM_CHUNK_HDR_LEN 14     /* CRLF ending the previous chunk, size in hex, CRLF */
+
+/* A generated response being written */
+typedef struct {
+    struct netconn* conn;
+    const char*     content_type;
+    bool            chunked;        /*<! the body is sent as chunks, HTTP/1.1 clients */
+    bool            header_sent;
+    bool            chunk_open;     /*<! a chunk was sent, its CRLF goes out before the next chunk size */
+    bool            keep_alive;     /*<! the body has a length, the connection can be reused */
+} esp_webserver_stream_t;
+
+/* Public functions */
+void esp_webserver_stream_init(esp_webserver_stream_t* s, struct netconn* conn,
+                               const http_parser_t* req, const char* content_type);
+int esp_webserver_stream_write(const char* data, size_t len, void* ctx);
+void esp_webserver_stream_length(esp_webserver_stream_t* s, size_t len);
+bool esp_webserver_stream_end(esp_webserver_stream_t* s, int error);
+
+#endif /* __WEBSERVER_STREAM_H__ */
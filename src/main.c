@@ -14,19 +14,25 @@
 
 #include "eddystone_api.h"
 #include "webserver.h"
+#include "spiffs.h"
+#include "tlmlog.h"
+#include "tlmstats.h"
+#include "uplink.h"
 
 
 void app_main(void)
 {
     ESP_ERROR_CHECK(nvs_flash_init());
     system_init();
+    esp_spiffs_init();
+    esp_tlmlog_init();
+    esp_tlmstats_init();
+    esp_uplink_init();
 
+    /* Wi-Fi, the web server and the BLE scanner come up in parallel: the server
+       starts listening once the station gets an address, beacons seen before
+       that are kept in the registry, the TLM log and the uplink backlog */
     esp_webserver_wifi_init();
-    esp_webserver_create_task(); 
-
-    while(!wifi_got_ip){ // wait for esp to connect to wifi and get ip
-        sys_delay_ms(100);
-    } 
-
+    esp_webserver_create_task();
     esp_eddystone_init();
 }
\ No newline at end of file
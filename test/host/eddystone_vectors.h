@@ -0,0 +1,168 @@
+/**
+ * @file eddystone_vectors.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Advertisements captured from Eddystone beacons, and broken variants of them.
+ *
+ *        Each vector is the advertising data of one report as the controller
+ *        hands it to the host (flags, UUID list, service data), the decoder
+ *        input. The unit tests check the decoded result, the fuzz harness
+ *        starts from them.
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __EDDYSTONE_VECTORS_H__
+#define __EDDYSTONE_VECTORS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    const char*     name;
+    const uint8_t*  data;
+    uint8_t         len;
+    int             ok;             /*<! 1 when esp_eddystone_decode() accepts it */
+    uint8_t         frame_type;     /*<! frame type reported, even for a rejected frame */
+} eddystone_vector_t;
+
+#define EDDY_VECTOR_HDR     0x02, 0x01, 0x06, 0x03, 0x03, 0xAA, 0xFE
+
+/* UID, ranging -21 dBm, namespace EDD1EBEAC04E5DEFA017, instance 0BDB87539B67, RFU bytes */
+static const uint8_t vec_uid[] = {
+    EDDY_VECTOR_HDR, 0x17, 0x16, 0xAA, 0xFE, 0x00, 0xEB,
+    0xED, 0xD1, 0xEB, 0xEA, 0xC0, 0x4E, 0x5D, 0xEF, 0xA0, 0x17,
+    0x0B, 0xDB, 0x87, 0x53, 0x9B, 0x67, 0x00, 0x00,
+};
+/* UID from a beacon that leaves the RFU bytes out */
+static const uint8_t vec_uid_no_rfu[] = {
+    EDDY_VECTOR_HDR, 0x15, 0x16, 0xAA, 0xFE, 0x00, 0xEB,
+    0xED, 0xD1, 0xEB, 0xEA, 0xC0, 0x4E, 0x5D, 0xEF, 0xA0, 0x17,
+    0x0B, 0xDB, 0x87, 0x53, 0x9B, 0x67,
+};
+/* URL, tx power -12 dBm, http://www.example.com */
+static const uint8_t vec_url[] = {
+    EDDY_VECTOR_HDR, 0x0E, 0x16, 0xAA, 0xFE, 0x10, 0xF4,
+    0x00, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x07,
+};
+/* URL, https://goo.gl/S6zT6P */
+static const uint8_t vec_url_short[] = {
+    EDDY_VECTOR_HDR, 0x13, 0x16, 0xAA, 0xFE, 0x10, 0xEE,
+    0x03, 'g', 'o', 'o', '.', 'g', 'l', '/', 'S', '6', 'z', 'T', '6', 'P',
+};
+/* TLM v0, 3000 mV, 23.5 C, 4660 advertisements, 12345.6 s */
+static const uint8_t vec_tlm[] = {
+    EDDY_VECTOR_HDR, 0x11, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0B, 0xB8, 0x17, 0x80, 0x00, 0x00, 0x12, 0x34, 0x00, 0x01, 0xE2, 0x40,
+};
+/* TLM, -0.5 C */
+static const uint8_t vec_tlm_negative[] = {
+    EDDY_VECTOR_HDR, 0x11, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0C, 0x1C, 0xFF, 0x80, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x64,
+};
+/* TLM, beacon without temperature sensor (0x8000) */
+static const uint8_t vec_tlm_no_sensor[] = {
+    EDDY_VECTOR_HDR, 0x11, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0B, 0xB8, 0x80, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+};
+/* Service data of another UUID ahead of the Eddystone one */
+static const uint8_t vec_tlm_after_other[] = {
+    0x02, 0x01, 0x06, 0x04, 0x16, 0x0F, 0x18, 0x64,
+    0x11, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0B, 0xB8, 0x17, 0x80, 0x00, 0x00, 0x12, 0x34, 0x00, 0x01, 0xE2, 0x40,
+};
+
+/* TLM cut short by the controller, the AD length runs past the packet */
+static const uint8_t vec_tlm_truncated[] = {
+    EDDY_VECTOR_HDR, 0x11, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0B, 0xB8, 0x17, 0x80, 0x00, 0x00,
+};
+/* TLM one byte short, AD length consistent */
+static const uint8_t vec_tlm_short[] = {
+    EDDY_VECTOR_HDR, 0x10, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0B, 0xB8, 0x17, 0x80, 0x00, 0x00, 0x12, 0x34, 0x00, 0x01, 0xE2,
+};
+/* TLM one byte long */
+static const uint8_t vec_tlm_long[] = {
+    EDDY_VECTOR_HDR, 0x12, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0B, 0xB8, 0x17, 0x80, 0x00, 0x00, 0x12, 0x34, 0x00, 0x01, 0xE2, 0x40, 0x00,
+};
+/* URL of a scheme byte and 18 characters, one over the limit */
+static const uint8_t vec_url_oversized[] = {
+    EDDY_VECTOR_HDR, 0x18, 0x16, 0xAA, 0xFE, 0x10, 0xF4,
+    0x02, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r',
+};
+/* URL with a scheme byte out of range */
+static const uint8_t vec_url_bad_scheme[] = {
+    EDDY_VECTOR_HDR, 0x0E, 0x16, 0xAA, 0xFE, 0x10, 0xF4,
+    0x04, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x07,
+};
+/* URL with a non printable character */
+static const uint8_t vec_url_bad_char[] = {
+    EDDY_VECTOR_HDR, 0x0E, 0x16, 0xAA, 0xFE, 0x10, 0xF4,
+    0x00, 'e', 'x', 'a', 0x7F, 'p', 'l', 'e', 0x07,
+};
+/* URL frame holding only the tx power */
+static const uint8_t vec_url_empty[] = {
+    EDDY_VECTOR_HDR, 0x05, 0x16, 0xAA, 0xFE, 0x10, 0xF4,
+};
+/* Encrypted EID frame, not decoded */
+static const uint8_t vec_eid[] = {
+    EDDY_VECTOR_HDR, 0x0D, 0x16, 0xAA, 0xFE, 0x30, 0xEB,
+    0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88,
+};
+/* Frame type with the low nibble set */
+static const uint8_t vec_bad_frame_type[] = {
+    EDDY_VECTOR_HDR, 0x11, 0x16, 0xAA, 0xFE, 0x21, 0x00,
+    0x0B, 0xB8, 0x17, 0x80, 0x00, 0x00, 0x12, 0x34, 0x00, 0x01, 0xE2, 0x40,
+};
+/* iBeacon, manufacturer data only */
+static const uint8_t vec_ibeacon[] = {
+    0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15,
+    0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0,
+    0x00, 0x01, 0x00, 0x02, 0xC5,
+};
+/* 16-bit UUID list without 0xFEAA */
+static const uint8_t vec_other_uuid[] = {
+    0x02, 0x01, 0x06, 0x03, 0x03, 0x0F, 0x18, 0x04, 0x16, 0x0F, 0x18, 0x64,
+};
+/* Zero length AD structure ahead of the frame */
+static const uint8_t vec_zero_ad[] = {
+    0x02, 0x01, 0x06, 0x00, 0x11, 0x16, 0xAA, 0xFE, 0x20, 0x00,
+    0x0B, 0xB8, 0x17, 0x80, 0x00, 0x00, 0x12, 0x34, 0x00, 0x01, 0xE2, 0x40,
+};
+/* Service data too short to hold a frame type */
+static const uint8_t vec_service_short[] = {
+    EDDY_VECTOR_HDR, 0x03, 0x16, 0xAA, 0xFE,
+};
+
+#define EDDY_VECTOR(v, ok, type) { #v, v, sizeof(v), ok, type }
+
+static const eddystone_vector_t eddystone_vectors[] = {
+    EDDY_VECTOR(vec_uid,               1, 0x00),
+    EDDY_VECTOR(vec_uid_no_rfu,        1, 0x00),
+    EDDY_VECTOR(vec_url,               1, 0x10),
+    EDDY_VECTOR(vec_url_short,         1, 0x10),
+    EDDY_VECTOR(vec_tlm,               1, 0x20),
+    EDDY_VECTOR(vec_tlm_negative,      1, 0x20),
+    EDDY_VECTOR(vec_tlm_no_sensor,     1, 0x20),
+    EDDY_VECTOR(vec_tlm_after_other,   1, 0x20),
+    EDDY_VECTOR(vec_tlm_truncated,     0, 0x00),
+    EDDY_VECTOR(vec_tlm_short,         0, 0x20),
+    EDDY_VECTOR(vec_tlm_long,          0, 0x20),
+    EDDY_VECTOR(vec_url_oversized,     0, 0x10),
+    EDDY_VECTOR(vec_url_bad_scheme,    0, 0x10),
+    EDDY_VECTOR(vec_url_bad_char,      0, 0x10),
+    EDDY_VECTOR(vec_url_empty,         0, 0x10),
+    EDDY_VECTOR(vec_eid,               0, 0x30),
+    EDDY_VECTOR(vec_bad_frame_type,    0, 0x21),
+    EDDY_VECTOR(vec_ibeacon,           0, 0x00),
+    EDDY_VECTOR(vec_other_uuid,        0, 0x00),
+    EDDY_VECTOR(vec_zero_ad,           0, 0x00),
+    EDDY_VECTOR(vec_service_short,     0, 0x00),
+};
+#define EDDY_VECTOR_COUNT (sizeof(eddystone_vectors) / sizeof(eddystone_vectors[0]))
+
+#endif /* __EDDYSTONE_VECTORS_H__ */
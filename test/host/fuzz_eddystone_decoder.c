@@ -0,0 +1,160 @@
+/**
+ * @file fuzz_eddystone_decoder.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief libFuzzer harness of the eddystone frame decoder.
+ *
+ *        Every input is decoded as an advertisement and, when accepted, its
+ *        URL is expanded, so the sanitizers see every read of the decoder.
+ *        With clang and -DEDDY_LIBFUZZER=ON the harness links libFuzzer:
+ *
+ *            ./fuzz_eddystone_decoder -max_len=31 corpus/
+ *
+ *        Otherwise (gcc) a small driver replaces it: it runs the files given
+ *        on the command line, or mutates the captured vectors for -runs=N
+ *        iterations, which is what ctest does.
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "eddystone_decoder.h"
+#include "eddystone_vectors.h"
+
+#define FUZZ_ADV_MAX_LEN 31     /* legacy advertising data */
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    esp_eddystone_result_t res;
+    char url[EDDYSTONE_URL_DECODED_MAX_LEN];
+    uint8_t len = size > 255 ? 255 : (uint8_t)size;
+
+    /* an exact size copy, so reading past the input is caught */
+    uint8_t* buf = malloc(len ? len : 1);
+    memcpy(buf, data, len);
+    memset(&res, 0, sizeof(res));
+    if (esp_eddystone_decode(buf, len, &res) == 0 &&
+        res.common.frame_type == EDDYSTONE_FRAME_TYPE_URL) {
+        if (res.inform.url.len > EDDYSTONE_URL_MAX_LEN) {
+            abort();
+        }
+        size_t n = esp_eddystone_url_expand(res.inform.url.encoded, res.inform.url.len, url);
+        if (n >= sizeof(url) || strlen(url) != n) {
+            abort();
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+#ifndef EDDY_LIBFUZZER
+
+/**
+ * @brief Run one file as an input
+ *
+ * @param path
+ * @return int - Non zero if the file cannot be read
+ */
+static int fuzz_run_file(const char* path)
+{
+    uint8_t data[256];
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+    size_t n = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    LLVMFuzzerTestOneInput(data, n);
+    return 0;
+}
+
+/**
+ * @brief Mutate a captured vector: flip, overwrite, insert or drop a few bytes
+ *
+ * @param out - FUZZ_ADV_MAX_LEN + 8 bytes
+ * @return size_t - Length of the mutated input
+ */
+static size_t fuzz_mutate(uint8_t* out)
+{
+    const eddystone_vector_t* v = &eddystone_vectors[rand() % EDDY_VECTOR_COUNT];
+    size_t len = v->len;
+    int edits = 1 + rand() % 4;
+
+    memcpy(out, v->data, len);
+    while (edits--) {
+        size_t pos = len ? rand() % len : 0;
+        switch (rand() % 5) {
+        case 0:
+            if (len) {
+                out[pos] ^= 1 << (rand() % 8);
+            }
+            break;
+        case 1:
+            if (len) {
+                out[pos] = rand();
+            }
+            break;
+        case 2:
+            /* AD lengths and frame types are the interesting bytes */
+            if (len) {
+                static const uint8_t specials[] = { 0x00, 0x01, 0x02, 0x03, 0x0F, 0x10, 0x11, 0x16, 0x20, 0x7F, 0x80, 0xFF };
+                out[pos] = specials[rand() % sizeof(specials)];
+            }
+            break;
+        case 3:
+            if (len < FUZZ_ADV_MAX_LEN + 8) {
+                memmove(out + pos + 1, out + pos, len - pos);
+                out[pos] = rand();
+                len++;
+            }
+            break;
+        default:
+            if (len) {
+                memmove(out + pos, out + pos + 1, len - pos - 1);
+                len--;
+            }
+            break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char** argv)
+{
+    uint8_t data[FUZZ_ADV_MAX_LEN + 8];
+    long runs = 100000;
+    int files = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "-runs=", 6)) {
+            runs = atol(argv[i] + 6);
+        } else if (argv[i][0] != '-') {
+            if (fuzz_run_file(argv[i])) {
+                return 1;
+            }
+            files++;
+        }
+    }
+    if (files) {
+        printf("%d inputs\n", files);
+        return 0;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < EDDY_VECTOR_COUNT; i++) {
+        LLVMFuzzerTestOneInput(eddystone_vectors[i].data, eddystone_vectors[i].len);
+    }
+    for (long i = 0; i < runs; i++) {
+        LLVMFuzzerTestOneInput(data, fuzz_mutate(data));
+    }
+    printf("%ld mutated inputs\n", runs);
+    return 0;
+}
+
+#endif /* EDDY_LIBFUZZER */
@@ -0,0 +1,191 @@
+/**
+ * @file test_eddystone_decoder.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Host unit tests of the eddystone frame decoder.
+ *
+ *        Feeds the captured advertisements of eddystone_vectors.h, and every
+ *        truncation of them, to esp_eddystone_decode() and checks the decoded
+ *        fields. Built and run by test/host/CMakeLists.txt.
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <stdio.h>
+
+#include "eddystone_decoder.h"
+#include "eddystone_vectors.h"
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Decode a vector into a zeroed result
+ *
+ * @param v
+ * @param res
+ * @return esp_err_t - Result of esp_eddystone_decode()
+ */
+static esp_err_t test_decode(const eddystone_vector_t* v, esp_eddystone_result_t* res)
+{
+    memset(res, 0, sizeof(*res));
+    return esp_eddystone_decode(v->data, v->len, res);
+}
+
+/**
+ * @brief Every vector is accepted or rejected as expected and reports its frame type
+ */
+static void test_vectors(void)
+{
+    esp_eddystone_result_t res;
+
+    for (size_t i = 0; i < EDDY_VECTOR_COUNT; i++) {
+        const eddystone_vector_t* v = &eddystone_vectors[i];
+        esp_err_t ret = test_decode(v, &res);
+        if ((ret == 0) != v->ok || res.common.frame_type != v->frame_type) {
+            printf("%s: returned %d, frame type 0x%02x\n", v->name, ret, res.common.frame_type);
+            test_failures++;
+        }
+    }
+}
+
+/**
+ * @brief Every truncation of a valid vector is rejected
+ */
+static void test_truncated(void)
+{
+    esp_eddystone_result_t res;
+
+    for (size_t i = 0; i < EDDY_VECTOR_COUNT; i++) {
+        const eddystone_vector_t* v = &eddystone_vectors[i];
+        if (!v->ok) {
+            continue;
+        }
+        for (uint8_t len = 0; len < v->len; len++) {
+            memset(&res, 0, sizeof(res));
+            if (esp_eddystone_decode(v->data, len, &res) == 0) {
+                printf("%s: accepted when cut to %u bytes\n", v->name, len);
+                test_failures++;
+            }
+        }
+    }
+}
+
+static void test_uid(void)
+{
+    static const uint8_t namespace_id[] = { 0xED, 0xD1, 0xEB, 0xEA, 0xC0, 0x4E, 0x5D, 0xEF, 0xA0, 0x17 };
+    static const uint8_t instance_id[] = { 0x0B, 0xDB, 0x87, 0x53, 0x9B, 0x67 };
+    const eddystone_vector_t v = EDDY_VECTOR(vec_uid, 1, 0x00);
+    const eddystone_vector_t v_no_rfu = EDDY_VECTOR(vec_uid_no_rfu, 1, 0x00);
+    esp_eddystone_result_t res;
+
+    CHECK(test_decode(&v, &res) == 0);
+    CHECK(res.common.flags == 0x06);
+    CHECK(res.common.srv_uuid == EDDYSTONE_SERVICE_UUID);
+    CHECK(res.common.srv_data_type == EDDYSTONE_SERVICE_UUID);
+    CHECK(res.inform.uid.ranging_data == -21);
+    CHECK(!memcmp(res.inform.uid.namespace_id, namespace_id, sizeof(namespace_id)));
+    CHECK(!memcmp(res.inform.uid.instance_id, instance_id, sizeof(instance_id)));
+
+    CHECK(test_decode(&v_no_rfu, &res) == 0);
+    CHECK(!memcmp(res.inform.uid.instance_id, instance_id, sizeof(instance_id)));
+}
+
+static void test_url(void)
+{
+    const eddystone_vector_t v = EDDY_VECTOR(vec_url, 1, 0x10);
+    const eddystone_vector_t v_short = EDDY_VECTOR(vec_url_short, 1, 0x10);
+    esp_eddystone_result_t res;
+    char url[EDDYSTONE_URL_DECODED_MAX_LEN];
+
+    CHECK(test_decode(&v, &res) == 0);
+    CHECK(res.inform.url.tx_power == -12);
+    CHECK(res.inform.url.len == 9);
+    CHECK(esp_eddystone_url_expand(res.inform.url.encoded, res.inform.url.len, url) == 22);
+    CHECK(!strcmp(url, "http://www.example.com"));
+
+    CHECK(test_decode(&v_short, &res) == 0);
+    CHECK(esp_eddystone_url_expand(res.inform.url.encoded, res.inform.url.len, url) == 21);
+    CHECK(!strcmp(url, "https://goo.gl/S6zT6P"));
+}
+
+static void test_url_expand(void)
+{
+    char url[EDDYSTONE_URL_DECODED_MAX_LEN];
+    uint8_t longest[EDDYSTONE_URL_MAX_LEN];
+    const uint8_t bad_scheme[] = { 0x04, 'a' };
+    const uint8_t bad_char[] = { 0x00, 'a', ' ', 'b' };
+
+    /* the longest prefix and the longest expansion in every byte */
+    longest[0] = 0x01;
+    memset(longest + 1, 0x04, sizeof(longest) - 1);
+    CHECK(esp_eddystone_url_expand(longest, sizeof(longest), url) == EDDYSTONE_URL_DECODED_MAX_LEN - 1);
+    CHECK(strlen(url) == EDDYSTONE_URL_DECODED_MAX_LEN - 1);
+
+    CHECK(esp_eddystone_url_expand(bad_scheme, sizeof(bad_scheme), url) == 0 && url[0] == '\0');
+    CHECK(esp_eddystone_url_expand(bad_char, sizeof(bad_char), url) == 0 && url[0] == '\0');
+    CHECK(esp_eddystone_url_expand(longest, 0, url) == 0);
+    CHECK(esp_eddystone_url_expand(longest, EDDYSTONE_URL_MAX_LEN + 1, url) == 0);
+}
+
+static void test_tlm(void)
+{
+    const eddystone_vector_t v = EDDY_VECTOR(vec_tlm, 1, 0x20);
+    const eddystone_vector_t v_negative = EDDY_VECTOR(vec_tlm_negative, 1, 0x20);
+    const eddystone_vector_t v_no_sensor = EDDY_VECTOR(vec_tlm_no_sensor, 1, 0x20);
+    const eddystone_vector_t v_after_other = EDDY_VECTOR(vec_tlm_after_other, 1, 0x20);
+    esp_eddystone_result_t res;
+
+    CHECK(test_decode(&v, &res) == 0);
+    CHECK(res.inform.tlm.version == 0);
+    CHECK(res.inform.tlm.battery_voltage == 3000);
+    CHECK(res.inform.tlm.temperature == 23 * 256 + 128);
+    CHECK(res.inform.tlm.adv_count == 0x1234);
+    CHECK(res.inform.tlm.time == 123456);
+
+    CHECK(test_decode(&v_negative, &res) == 0);
+    CHECK(res.inform.tlm.battery_voltage == 3100);
+    CHECK(res.inform.tlm.temperature == -128);
+
+    CHECK(test_decode(&v_no_sensor, &res) == 0);
+    CHECK(res.inform.tlm.temperature == EDDYSTONE_TLM_TEMP_UNSUPPORTED);
+
+    CHECK(test_decode(&v_after_other, &res) == 0);
+    CHECK(res.inform.tlm.temperature == 23 * 256 + 128);
+    CHECK(res.common.srv_uuid == 0);
+}
+
+static void test_arguments(void)
+{
+    esp_eddystone_result_t res;
+
+    CHECK(esp_eddystone_decode(NULL, 10, &res) != 0);
+    CHECK(esp_eddystone_decode(vec_tlm, 0, &res) != 0);
+    CHECK(esp_eddystone_decode(vec_tlm, sizeof(vec_tlm), NULL) != 0);
+}
+
+int main(void)
+{
+    test_vectors();
+    test_truncated();
+    test_uid();
+    test_url();
+    test_url_expand();
+    test_tlm();
+    test_arguments();
+
+    if (test_failures) {
+        printf("%d failures\n", test_failures);
+        return 1;
+    }
+    printf("%u vectors, all checks passed\n", (unsigned int)EDDY_VECTOR_COUNT);
+    return 0;
+}
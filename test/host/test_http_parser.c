@@ -0,0 +1,88 @@
+/**
+ * @file test_http_parser.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Host unit tests of the list header matching of the HTTP parser.
+ *
+ *        http_header_has_token() decides Content-Encoding: gzip from
+ *        Accept-Encoding, Connection: close and If-None-Match. Built and run
+ *        by test/host/CMakeLists.txt.
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <stdio.h>
+
+#include "http_parser.h"
+
+static int test_failures = 0;
+
+/**
+ * @brief Check the answer of http_header_has_token() for one header value
+ *
+ * @param value
+ * @param token
+ * @param expected
+ */
+static void test_token(const char* value, const char* token, bool expected)
+{
+    if (http_header_has_token(value, strlen(value), token) != expected) {
+        printf("\"%s\" %s \"%s\"\n", value, expected ? "does not list" : "lists", token);
+        test_failures++;
+    }
+}
+
+static void test_accept_encoding(void)
+{
+    test_token("gzip", "gzip", true);
+    test_token("gzip, deflate", "gzip", true);
+    test_token("deflate, gzip", "gzip", true);
+    test_token("deflate,gzip", "gzip", true);
+    test_token(" GZIP ", "gzip", true);
+    test_token("gzip;q=0.5", "gzip", true);
+    test_token("gzip ; q=1.0, identity", "gzip", true);
+    test_token("gzip;level=1;q=0.1", "gzip", true);
+
+    test_token("", "gzip", false);
+    test_token("identity", "gzip", false);
+    test_token("identity, x-gzip", "gzip", false);
+    test_token("gzipped", "gzip", false);
+    test_token("br, deflate", "gzip", false);
+    test_token("gzip;q=0", "gzip", false);
+    test_token("gzip; q=0.0", "gzip", false);
+    test_token("gzip;Q=0.000, deflate", "gzip", false);
+    test_token("deflate, gzip;q=0", "gzip", false);
+    test_token("gzip;q=0.001", "gzip", true);
+}
+
+static void test_connection(void)
+{
+    test_token("close", "close", true);
+    test_token("keep-alive, Close", "close", true);
+    test_token("keep-alive", "close", false);
+    test_token("closed", "close", false);
+}
+
+static void test_if_none_match(void)
+{
+    test_token("\"g0000000100000002\"", "\"g0000000100000002\"", true);
+    test_token("\"i0000000100000002\", \"g0000000100000002\"", "\"g0000000100000002\"", true);
+    test_token("W/\"g0000000100000002\"", "W/\"g0000000100000002\"", true);
+    test_token("\"g00000001000000023\"", "\"g0000000100000002\"", false);
+}
+
+int main(void)
+{
+    test_accept_encoding();
+    test_connection();
+    test_if_none_match();
+
+    if (test_failures) {
+        printf("%d failures\n", test_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
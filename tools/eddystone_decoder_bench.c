@@ -0,0 +1,387 @@
+/**
+ * @file eddystone_decoder_bench.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Host benchmark of the eddystone frame decoder.
+ *
+ *        Generates the advertisements a gateway hears in a room of beacons:
+ *        every device advertises each interval plus the 0 to 10 ms advDelay of
+ *        the BLE spec, Eddystone beacons send UID or URL frames with a TLM frame
+ *        every BENCH_TLM_EVERY advertisements, and other devices (iBeacons,
+ *        phones, other service data) are heard as well. The corpus is replayed
+ *        in time order through esp_eddystone_decode(), then through the decoder
+ *        and the formatting of esp_eddystone_show_inform() (EDDY_LOG_FRAMES
+ *        builds), with the log lines written to a buffer instead of the UART.
+ *        Reports ns/adv, advs/s against the rate of the modeled room, and the
+ *        allocations made while replaying, counted by wrapping malloc. Fails
+ *        when a frame is not decoded as it was generated.
+ *
+ *        gcc -O2 -Ilib/eddystone -Ilib/format tools/eddystone_decoder_bench.c lib/eddystone/eddystone_decoder.c \
+ *            lib/format/format.c -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free -o eddystone_decoder_bench
+ *        ./eddystone_decoder_bench [-beacons=500] [-others=250] [-interval=100] [-seconds=10]
+ *
+ *        test/host/CMakeLists.txt builds it too and runs a short corpus as a test.
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "eddystone_decoder.h"
+#include "format.h"
+
+#ifndef BENCH_PASSES
+#define BENCH_PASSES 20                 /* replays of the corpus per measure */
+#endif
+#define BENCH_ADV_DELAY_MS  10          /* advDelay, 0 to 10 ms added to every interval */
+#define BENCH_TLM_EVERY     10          /* eddystone advertisements per TLM frame */
+#define BENCH_OTHER         0xFF        /* expected frame type of a non eddystone advertisement */
+#define BENCH_LINE_MAX      128
+
+/* One received advertisement */
+typedef struct {
+    uint32_t  time_ms;
+    uint8_t   bda[6];
+    int8_t    rssi;
+    uint8_t   expected;                 /*<! frame type the decoder must report, BENCH_OTHER if rejected */
+    uint8_t   len;
+    uint8_t   data[31];
+} bench_adv_t;
+
+/* Allocations made by the decoder and the formatting, see the --wrap link options */
+static size_t bench_allocs;
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+void __real_free(void* p);
+
+void* __wrap_malloc(size_t size)
+{
+    bench_allocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    bench_allocs++;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size)
+{
+    bench_allocs++;
+    return __real_realloc(p, size);
+}
+
+void __wrap_free(void* p)
+{
+    __real_free(p);
+}
+
+static const uint8_t bench_namespace[10] = { 0xED, 0xD1, 0xEB, 0xEA, 0xC0, 0x4E, 0x5D, 0xEF, 0xA0, 0x17 };
+static size_t bench_logged;             /*<! bytes of log lines, keeps the formatting from being optimized out */
+
+/**
+ * @brief Advertising data of the next advertisement of an eddystone beacon
+ *
+ * @param adv
+ * @param beacon - Beacon number, also its instance ID and URL
+ * @param seq - Advertisements sent so far by the beacon
+ * @param time_ms
+ */
+static void bench_eddystone_adv(bench_adv_t* adv, uint32_t beacon, uint32_t seq, uint32_t time_ms)
+{
+    static const uint8_t hdr[] = { 0x02, 0x01, 0x06, 0x03, 0x03, 0xAA, 0xFE };
+    uint8_t* p = adv->data + sizeof(hdr);
+
+    memcpy(adv->data, hdr, sizeof(hdr));
+    if (seq % BENCH_TLM_EVERY == BENCH_TLM_EVERY - 1) {
+        int16_t temp = (int16_t)((20 << 8) + (int)(beacon % 40) * 32 + (int)(seq % 64) - 32);
+        uint16_t batt = 3000 - beacon % 300;
+        uint32_t time = time_ms / 100;
+        const uint8_t tlm[] = {
+            0x11, 0x16, 0xAA, 0xFE, EDDYSTONE_FRAME_TYPE_TLM, 0x00,
+            batt >> 8, batt & 0xFF, (uint16_t)temp >> 8, temp & 0xFF,
+            seq >> 24, (seq >> 16) & 0xFF, (seq >> 8) & 0xFF, seq & 0xFF,
+            time >> 24, (time >> 16) & 0xFF, (time >> 8) & 0xFF, time & 0xFF,
+        };
+        memcpy(p, tlm, sizeof(tlm));
+        adv->len = sizeof(hdr) + sizeof(tlm);
+        adv->expected = EDDYSTONE_FRAME_TYPE_TLM;
+    } else if (beacon % 3 == 0) {
+        /* https://www.trixlog.com/b1f4 */
+        static const char hex[] = "0123456789abcdef";
+        const uint8_t url[] = {
+            0x13, 0x16, 0xAA, 0xFE, EDDYSTONE_FRAME_TYPE_URL, 0xEE,
+            0x01, 't', 'r', 'i', 'x', 'l', 'o', 'g', 0x00, 'b',
+            hex[(beacon >> 12) & 0xF], hex[(beacon >> 8) & 0xF], hex[(beacon >> 4) & 0xF], hex[beacon & 0xF],
+        };
+        memcpy(p, url, sizeof(url));
+        adv->len = sizeof(hdr) + sizeof(url);
+        adv->expected = EDDYSTONE_FRAME_TYPE_URL;
+    } else {
+        const uint8_t uid[] = { 0x17, 0x16, 0xAA, 0xFE, EDDYSTONE_FRAME_TYPE_UID, 0xEB };
+        memcpy(p, uid, sizeof(uid));
+        p += sizeof(uid);
+        memcpy(p, bench_namespace, sizeof(bench_namespace));
+        p += sizeof(bench_namespace);
+        memset(p, 0, 8);        /* instance ID, then the RFU bytes */
+        p[2] = beacon >> 24;
+        p[3] = (beacon >> 16) & 0xFF;
+        p[4] = (beacon >> 8) & 0xFF;
+        p[5] = beacon & 0xFF;
+        adv->len = sizeof(hdr) + sizeof(uid) + sizeof(bench_namespace) + 8;
+        adv->expected = EDDYSTONE_FRAME_TYPE_UID;
+    }
+}
+
+/**
+ * @brief Advertising data of another device: an iBeacon, a phone or a beacon
+ *        of another service
+ *
+ * @param adv
+ * @param device
+ */
+static void bench_other_adv(bench_adv_t* adv, uint32_t device)
+{
+    static const uint8_t ibeacon[] = {
+        0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15,
+        0xF7, 0x82, 0x6D, 0xA6, 0x4F, 0xA2, 0x4E, 0x98, 0x80, 0x24, 0xBC, 0x5B, 0x71, 0xE0, 0x89, 0x3E,
+        0x00, 0x01, 0x00, 0x02, 0xC5,
+    };
+    static const uint8_t phone[] = {
+        0x02, 0x01, 0x1A, 0x0B, 0xFF, 0x4C, 0x00, 0x10, 0x07, 0x3B, 0x1F, 0x4A, 0x91, 0x2C, 0x58,
+    };
+    static const uint8_t service[] = {
+        0x02, 0x01, 0x06, 0x03, 0x03, 0x9F, 0xFE, 0x17, 0x16, 0x9F, 0xFE,
+        0x02, 0x01, 0x4A, 0x1E, 0x33, 0x7C, 0x60, 0x5B, 0x0D, 0x11, 0x82, 0xA9, 0x64, 0x3F, 0x20, 0x08, 0xE1, 0x55, 0x00, 0x00,
+    };
+    static const struct {
+        const uint8_t*  data;
+        uint8_t         len;
+    } kinds[] = {
+        { ibeacon, sizeof(ibeacon) }, { phone, sizeof(phone) }, { service, sizeof(service) },
+    };
+
+    memcpy(adv->data, kinds[device % 3].data, kinds[device % 3].len);
+    adv->len = kinds[device % 3].len;
+    adv->expected = BENCH_OTHER;
+}
+
+static int bench_adv_cmp(const void* a, const void* b)
+{
+    const bench_adv_t* x = a;
+    const bench_adv_t* y = b;
+    return (x->time_ms > y->time_ms) - (x->time_ms < y->time_ms);
+}
+
+/**
+ * @brief Every advertisement heard during seconds, in time order
+ *
+ * @param beacons - Eddystone beacons
+ * @param others - Other advertisers
+ * @param interval_ms - Advertising interval of every device
+ * @param seconds
+ * @param count - Number of advertisements
+ * @return bench_adv_t* - malloc'd corpus
+ */
+static bench_adv_t* bench_corpus(uint32_t beacons, uint32_t others, uint32_t interval_ms, uint32_t seconds, size_t* count)
+{
+    size_t max = (size_t)(beacons + others) * (seconds * 1000 / interval_ms + 1);
+    bench_adv_t* corpus = malloc(max * sizeof(bench_adv_t));
+    size_t n = 0;
+
+    if (corpus == NULL) {
+        return NULL;
+    }
+    for (uint32_t dev = 0; dev < beacons + others; dev++) {
+        uint32_t t = rand() % interval_ms;          /* devices are not in phase */
+        int8_t rssi = -40 - rand() % 55;
+        for (uint32_t seq = 0; t < seconds * 1000; seq++) {
+            bench_adv_t* adv = &corpus[n++];
+            adv->time_ms = t;
+            adv->bda[0] = 0xAC;
+            adv->bda[1] = 0x23;
+            adv->bda[2] = dev >> 24;
+            adv->bda[3] = (dev >> 16) & 0xFF;
+            adv->bda[4] = (dev >> 8) & 0xFF;
+            adv->bda[5] = dev & 0xFF;
+            adv->rssi = rssi + rand() % 7 - 3;
+            if (dev < beacons) {
+                bench_eddystone_adv(adv, dev, seq, t);
+            } else {
+                bench_other_adv(adv, dev);
+            }
+            t += interval_ms + rand() % (BENCH_ADV_DELAY_MS + 1);
+        }
+    }
+    qsort(corpus, n, sizeof(bench_adv_t), bench_adv_cmp);
+    *count = n;
+    return corpus;
+}
+
+/**
+ * @brief The log lines of one frame, as esp_eddystone_process_adv() and
+ *        esp_eddystone_show_inform() print them, into a buffer
+ *
+ * @param adv
+ * @param res
+ */
+static void bench_show_inform(const bench_adv_t* adv, const esp_eddystone_result_t* res)
+{
+    char line[BENCH_LINE_MAX];
+    char bda[3 * sizeof(adv->bda)];
+
+    fmt_hex(bda, adv->bda, sizeof(adv->bda), ':');
+    bench_logged += snprintf(line, sizeof(line), "--------Eddystone Found----------");
+    bench_logged += snprintf(line, sizeof(line), "Device address: %s", bda);
+    bench_logged += snprintf(line, sizeof(line), "RSSI of packet:%d dbm", adv->rssi);
+    switch (res->common.frame_type) {
+        case EDDYSTONE_FRAME_TYPE_UID: {
+            char namespace_id[3 * sizeof(res->inform.uid.namespace_id)];
+            char instance_id[3 * sizeof(res->inform.uid.instance_id)];
+            fmt_hex(namespace_id, res->inform.uid.namespace_id, sizeof(res->inform.uid.namespace_id), ':');
+            fmt_hex(instance_id, res->inform.uid.instance_id, sizeof(res->inform.uid.instance_id), ':');
+            bench_logged += snprintf(line, sizeof(line), "Eddystone UID inform:");
+            bench_logged += snprintf(line, sizeof(line), "Measured power(RSSI at 0m distance):%d dbm", res->inform.uid.ranging_data);
+            bench_logged += snprintf(line, sizeof(line), "Namespace ID: %s", namespace_id);
+            bench_logged += snprintf(line, sizeof(line), "Instance ID: %s", instance_id);
+            break;
+        }
+        case EDDYSTONE_FRAME_TYPE_URL: {
+            char url[EDDYSTONE_URL_DECODED_MAX_LEN];
+            esp_eddystone_url_expand(res->inform.url.encoded, res->inform.url.len, url);
+            bench_logged += snprintf(line, sizeof(line), "Eddystone URL inform:");
+            bench_logged += snprintf(line, sizeof(line), "Measured power(RSSI at 0m distance):%d dbm", res->inform.url.tx_power);
+            bench_logged += snprintf(line, sizeof(line), "URL: %s", url);
+            break;
+        }
+        case EDDYSTONE_FRAME_TYPE_TLM: {
+            char temperature[FMT_FIXED_MAX_LEN];
+            fmt_fixed(temperature, res->inform.tlm.temperature, 8);
+            bench_logged += snprintf(line, sizeof(line), "Eddystone TLM inform:");
+            bench_logged += snprintf(line, sizeof(line), "version: %d", res->inform.tlm.version);
+            bench_logged += snprintf(line, sizeof(line), "battery voltage: %d mV", res->inform.tlm.battery_voltage);
+            bench_logged += snprintf(line, sizeof(line), "beacon temperature in degrees Celsius: %s C", temperature);
+            bench_logged += snprintf(line, sizeof(line), "adv pdu count since power-up: %d", (int)res->inform.tlm.adv_count);
+            bench_logged += snprintf(line, sizeof(line), "time since power-up: %d s", (int)(res->inform.tlm.time / 10));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Replay the corpus once
+ *
+ * @param corpus
+ * @param count
+ * @param format - Also format the log lines of every frame
+ * @return size_t - Advertisements not decoded as they were generated
+ */
+static size_t bench_replay(const bench_adv_t* corpus, size_t count, bool format)
+{
+    esp_eddystone_result_t res;
+    size_t errors = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const bench_adv_t* adv = &corpus[i];
+        memset(&res, 0, sizeof(res));
+        if (esp_eddystone_decode(adv->data, adv->len, &res)) {
+            errors += adv->expected != BENCH_OTHER;
+            continue;
+        }
+        errors += adv->expected != res.common.frame_type;
+        if (format) {
+            bench_show_inform(adv, &res);
+        }
+    }
+    return errors;
+}
+
+/**
+ * @brief Time BENCH_PASSES replays and print the cost per advertisement
+ *
+ * @param name
+ * @param corpus
+ * @param count
+ * @param format
+ * @param rate - Advertisements per second of the modeled room
+ * @return size_t - Decoding errors
+ */
+static size_t bench_measure(const char* name, const bench_adv_t* corpus, size_t count, bool format, double rate)
+{
+    struct timespec start, end;
+    size_t errors = 0;
+
+    bench_allocs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        errors += bench_replay(corpus, count, format);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ((double)count * BENCH_PASSES);
+    printf("%-14s %8.1f ns/adv  %10.0f advs/s  %5.2f allocations/adv  %6.3f%% of one core at the modeled rate\n",
+           name, ns, 1e9 / ns, (double)bench_allocs / ((double)count * BENCH_PASSES), rate * ns / 1e7);
+    return errors;
+}
+
+/**
+ * @brief Value of a -name=value argument
+ *
+ * @param arg
+ * @param name - "-name="
+ * @param value
+ */
+static void bench_arg(const char* arg, const char* name, uint32_t* value)
+{
+    if (!strncmp(arg, name, strlen(name))) {
+        *value = strtoul(arg + strlen(name), NULL, 10);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t beacons = 500, others = 250, interval_ms = 100, seconds = 10;
+    size_t count, types[4] = { 0 };
+
+    for (int i = 1; i < argc; i++) {
+        bench_arg(argv[i], "-beacons=", &beacons);
+        bench_arg(argv[i], "-others=", &others);
+        bench_arg(argv[i], "-interval=", &interval_ms);
+        bench_arg(argv[i], "-seconds=", &seconds);
+    }
+    if (beacons + others == 0 || interval_ms == 0 || seconds == 0) {
+        printf("usage: %s [-beacons=500] [-others=250] [-interval=100] [-seconds=10]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    bench_adv_t* corpus = bench_corpus(beacons, others, interval_ms, seconds, &count);
+    if (corpus == NULL) {
+        printf("no memory for the corpus\n");
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        types[corpus[i].expected == BENCH_OTHER ? 3 : corpus[i].expected >> 4]++;
+    }
+    double rate = (double)count / seconds;
+    printf("corpus: %u eddystone + %u other devices every %u ms + 0-%d ms, %u s: %zu advs (%.0f advs/s), "
+           "%zu uid, %zu url, %zu tlm, %zu other\n",
+           beacons, others, interval_ms, BENCH_ADV_DELAY_MS, seconds, count, rate,
+           types[0], types[1], types[2], types[3]);
+
+    size_t errors = bench_measure("decode", corpus, count, false, rate);
+    errors += bench_measure("decode+format", corpus, count, true, rate);
+    free(corpus);
+    if (errors) {
+        printf("%zu advertisements not decoded as generated\n", errors / 2 / BENCH_PASSES);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,330 @@
+/**
+ * @file eddystone_registry_stress.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Host stress test of the beacon registry seqlock.
+ *
+ *        Writer threads merge frames into the registry while reader threads
+ *        copy entries with esp_eddystone_registry_read(), read_bda(),
+ *        read_latest() and foreach(), as the HTTP and uplink tasks do. The
+ *        registry has a single writer by design, so the writers take turns
+ *        through a mutex the way every scan result is funneled into the decoder
+ *        task; readers take no lock.
+ *
+ *        Every field a frame sets is derived from the beacon number and a
+ *        per beacon update counter, so a copy can be checked on its own: the
+ *        BDA and every section seen must name the same beacon, each section
+ *        must hold one update, sections not seen must be zero and the RSSI must
+ *        come from the newest section. More beacons than registry entries are
+ *        used, so entries are also evicted and reused under the readers.
+ *        Exits non zero on the first torn copy.
+ *
+ *        gcc -O2 -pthread -Itools/host -Ilib/eddystone tools/eddystone_registry_stress.c \
+ *            lib/eddystone/eddystone_registry.c lib/eddystone/eddystone_rssi.c -o eddystone_registry_stress
+ *        ./eddystone_registry_stress [-writers=2] [-readers=4] [-seconds=5]
+ *
+ *        test/host/CMakeLists.txt builds it too and runs it as a test.
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "eddystone_registry.h"
+
+#define STRESS_BEACONS      (EDDY_REGISTRY_SIZE + EDDY_REGISTRY_SIZE / 2)
+#define STRESS_THREADS_MAX  16
+
+static pthread_mutex_t stress_writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t stress_updates[STRESS_BEACONS];     /*<! per beacon update counter, under stress_writer_lock */
+static int stress_stop;
+static int stress_torn;
+static struct timespec stress_start;
+
+/* Shim of the ESP-IDF timer used by esp_eddystone_registry_now() */
+int64_t esp_timer_get_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - stress_start.tv_sec) * 1000000LL + (now.tv_nsec - stress_start.tv_nsec) / 1000;
+}
+
+static inline int8_t stress_rssi(uint32_t c)
+{
+    return (int8_t)(-20 - (int)(c % 100));
+}
+
+static inline void stress_put_32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static inline uint32_t stress_get_32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline bool stress_is_zero(const void* p, size_t len)
+{
+    const uint8_t* b = p;
+    for (size_t i = 0; i < len; i++) {
+        if (b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Frame of update c of beacon k: UID, URL and TLM in turn
+ *
+ * @param k
+ * @param c
+ * @param res
+ */
+static void stress_frame(uint16_t k, uint32_t c, esp_eddystone_result_t* res)
+{
+    memset(res, 0, sizeof(*res));
+    switch (c % 3) {
+        case 0:
+            res->common.frame_type = EDDYSTONE_FRAME_TYPE_UID;
+            res->inform.uid.ranging_data = (int8_t)(-10 - (int)(c % 64));
+            stress_put_32(res->inform.uid.namespace_id, c);
+            res->inform.uid.namespace_id[4] = k >> 8;
+            res->inform.uid.namespace_id[5] = k & 0xFF;
+            stress_put_32(res->inform.uid.namespace_id + 6, ~c);
+            stress_put_32(res->inform.uid.instance_id, c ^ 0xA5A5A5A5);
+            res->inform.uid.instance_id[4] = k >> 8;
+            res->inform.uid.instance_id[5] = k & 0xFF;
+            break;
+        case 1:
+            res->common.frame_type = EDDYSTONE_FRAME_TYPE_URL;
+            res->inform.url.tx_power = (int8_t)(-10 - (int)(c % 64));
+            res->inform.url.len = 7 + c % (EDDYSTONE_URL_MAX_LEN - 6);
+            stress_put_32(res->inform.url.encoded, c);
+            res->inform.url.encoded[4] = k >> 8;
+            res->inform.url.encoded[5] = k & 0xFF;
+            for (int i = 6; i < res->inform.url.len; i++) {
+                res->inform.url.encoded[i] = (uint8_t)(c + i);
+            }
+            break;
+        default:
+            res->common.frame_type = EDDYSTONE_FRAME_TYPE_TLM;
+            res->inform.tlm.version = 0;
+            res->inform.tlm.battery_voltage = c & 0xFFFF;
+            res->inform.tlm.temperature = (int16_t)(c >> 16);
+            res->inform.tlm.adv_count = c;
+            res->inform.tlm.time = c ^ k;
+            break;
+    }
+}
+
+/**
+ * @brief Check a copy holds whole updates of a single beacon
+ *
+ * @param b
+ * @return bool - false if the copy is torn
+ */
+static bool stress_check(const esp_eddystone_beacon_t* b)
+{
+    static const uint8_t bda_prefix[] = { 0xAC, 0x23, 0x00, 0x00 };
+    uint16_t k = (b->bda[4] << 8) | b->bda[5];
+    uint32_t newest = 0;
+
+    if (memcmp(b->bda, bda_prefix, sizeof(bda_prefix)) || k >= STRESS_BEACONS || b->frames == 0) {
+        return false;
+    }
+    if (b->frames & EDDY_FRAME_UID_SEEN) {
+        uint32_t c = stress_get_32(b->uid.namespace_id);
+        esp_eddystone_result_t res;
+        stress_frame(k, c, &res);
+        if (c % 3 != 0 || b->uid.ranging_data != res.inform.uid.ranging_data ||
+            memcmp(b->uid.namespace_id, res.inform.uid.namespace_id, sizeof(b->uid.namespace_id)) ||
+            memcmp(b->uid.instance_id, res.inform.uid.instance_id, sizeof(b->uid.instance_id))) {
+            return false;
+        }
+        newest = c > newest ? c : newest;
+    } else if (!stress_is_zero(&b->uid, sizeof(b->uid))) {
+        return false;
+    }
+    if (b->frames & EDDY_FRAME_URL_SEEN) {
+        uint32_t c = stress_get_32(b->url.encoded);
+        esp_eddystone_result_t res;
+        stress_frame(k, c, &res);
+        if (c % 3 != 1 || b->url.tx_power != res.inform.url.tx_power || b->url.len != res.inform.url.len ||
+            memcmp(b->url.encoded, res.inform.url.encoded, b->url.len)) {
+            return false;
+        }
+        newest = c > newest ? c : newest;
+    } else if (!stress_is_zero(&b->url, sizeof(b->url))) {
+        return false;
+    }
+    if (b->frames & EDDY_FRAME_TLM_SEEN) {
+        uint32_t c = b->tlm.adv_count;
+        if (c % 3 != 2 || b->tlm.version != 0 || b->tlm.battery_voltage != (c & 0xFFFF) ||
+            b->tlm.temperature != (int16_t)(c >> 16) || b->tlm.time != (c ^ k)) {
+            return false;
+        }
+        newest = c > newest ? c : newest;
+    } else if (!stress_is_zero(&b->tlm, sizeof(b->tlm))) {
+        return false;
+    }
+    return b->rssi == stress_rssi(newest) && b->frame_count != 0 && b->last_seen >= b->first_seen;
+}
+
+/**
+ * @brief Report a torn copy once and stop every thread
+ *
+ * @param how - Reader function that returned it
+ * @param b
+ */
+static void stress_fail(const char* how, const esp_eddystone_beacon_t* b)
+{
+    if (__atomic_exchange_n(&stress_torn, 1, __ATOMIC_SEQ_CST) == 0) {
+        printf("torn copy from %s: bda %02X:%02X:%02X:%02X:%02X:%02X frames 0x%x rssi %d count %u\n",
+               how, b->bda[0], b->bda[1], b->bda[2], b->bda[3], b->bda[4], b->bda[5],
+               b->frames, b->rssi, b->frame_count);
+    }
+    __atomic_store_n(&stress_stop, 1, __ATOMIC_RELEASE);
+}
+
+static void* stress_writer(void* arg)
+{
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    uint8_t bda[ESP_BD_ADDR_LEN] = { 0xAC, 0x23, 0x00, 0x00 };
+    esp_eddystone_result_t res;
+    size_t updates = 0;
+
+    while (!__atomic_load_n(&stress_stop, __ATOMIC_ACQUIRE)) {
+        uint16_t k = rand_r(&seed) % STRESS_BEACONS;
+        bda[4] = k >> 8;
+        bda[5] = k & 0xFF;
+
+        pthread_mutex_lock(&stress_writer_lock);
+        uint32_t c = ++stress_updates[k];
+        stress_frame(k, c, &res);
+        esp_eddystone_registry_update(bda, stress_rssi(c), &res);
+        pthread_mutex_unlock(&stress_writer_lock);
+        updates++;
+    }
+    return (void*)updates;
+}
+
+static void stress_foreach_cb(const esp_eddystone_beacon_t* beacon, void* ctx)
+{
+    if (!stress_check(beacon)) {
+        stress_fail("foreach", beacon);
+    }
+    (*(size_t*)ctx)++;
+}
+
+static void* stress_reader(void* arg)
+{
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    uint8_t bda[ESP_BD_ADDR_LEN] = { 0xAC, 0x23, 0x00, 0x00 };
+    esp_eddystone_beacon_t copy;
+    size_t reads = 0;
+
+    for (uint32_t i = 0; !__atomic_load_n(&stress_stop, __ATOMIC_ACQUIRE); i++) {
+        switch (i % 64) {
+            case 0:
+                esp_eddystone_registry_foreach(stress_foreach_cb, &reads);
+                break;
+            case 1: {
+                uint16_t k = rand_r(&seed) % STRESS_BEACONS;
+                bda[4] = k >> 8;
+                bda[5] = k & 0xFF;
+                if (esp_eddystone_registry_read_bda(bda, &copy)) {
+                    if (!stress_check(&copy) || memcmp(copy.bda, bda, sizeof(bda))) {
+                        stress_fail("read_bda", &copy);
+                    }
+                    reads++;
+                }
+                break;
+            }
+            case 2:
+                if (esp_eddystone_registry_read_latest(&copy)) {
+                    if (!stress_check(&copy)) {
+                        stress_fail("read_latest", &copy);
+                    }
+                    reads++;
+                }
+                break;
+            default:
+                if (esp_eddystone_registry_read(rand_r(&seed) % EDDY_REGISTRY_SIZE, &copy)) {
+                    if (!stress_check(&copy)) {
+                        stress_fail("read", &copy);
+                    }
+                    reads++;
+                }
+                break;
+        }
+    }
+    return (void*)reads;
+}
+
+/**
+ * @brief Value of a -name=value argument
+ *
+ * @param arg
+ * @param name - "-name="
+ * @param value
+ */
+static void stress_arg(const char* arg, const char* name, uint32_t* value)
+{
+    if (!strncmp(arg, name, strlen(name))) {
+        *value = strtoul(arg + strlen(name), NULL, 10);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t writers = 2, readers = 4, seconds = 5;
+    pthread_t threads[STRESS_THREADS_MAX];
+    size_t updates = 0, reads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        stress_arg(argv[i], "-writers=", &writers);
+        stress_arg(argv[i], "-readers=", &readers);
+        stress_arg(argv[i], "-seconds=", &seconds);
+    }
+    if (writers == 0 || readers == 0 || writers + readers > STRESS_THREADS_MAX) {
+        printf("usage: %s [-writers=2] [-readers=4] [-seconds=5], at most %d threads\n", argv[0], STRESS_THREADS_MAX);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &stress_start);
+    esp_eddystone_registry_init();
+    for (uint32_t i = 0; i < writers + readers; i++) {
+        pthread_create(&threads[i], NULL, i < writers ? stress_writer : stress_reader, (void*)(uintptr_t)(i + 1));
+    }
+    for (int64_t end = esp_timer_get_time() + seconds * 1000000LL;
+         esp_timer_get_time() < end && !__atomic_load_n(&stress_stop, __ATOMIC_ACQUIRE); ) {
+        struct timespec tick = { 0, 10 * 1000 * 1000 };
+        nanosleep(&tick, NULL);
+    }
+    __atomic_store_n(&stress_stop, 1, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < writers + readers; i++) {
+        void* n;
+        pthread_join(threads[i], &n);
+        *(i < writers ? &updates : &reads) += (size_t)n;
+    }
+
+    printf("%u writers, %u readers, %u s: %zu updates, %zu copies checked, %u beacons tracked\n",
+           writers, readers, seconds, updates, reads, esp_eddystone_registry_count());
+    if (stress_torn) {
+        return 1;
+    }
+    if (updates == 0 || reads == 0) {
+        printf("no concurrent updates and reads\n");
+        return 1;
+    }
+    return 0;
+}
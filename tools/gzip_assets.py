@@ -0,0 +1,34 @@
+"""
+PlatformIO extra script: gzip the static web assets before the SPIFFS image is built.
+
+Every file of the data folder gets a <name>.gz sibling, served to clients that send
+Accept-Encoding: gzip. index.html is skipped, the device fills its placeholders at
+runtime. The gzip header carries no name or time so unchanged files produce the same
+bytes (and the same ETag on the device).
+"""
+
+import gzip
+import os
+
+Import("env")
+
+SKIP = {"index.html", "tlm.log"}
+
+
+def gzip_assets(source, target, env):
+    data_dir = env.subst("$PROJECTDATA_DIR")
+    for name in sorted(os.listdir(data_dir)):
+        path = os.path.join(data_dir, name)
+        if name in SKIP or name.endswith(".gz") or not os.path.isfile(path):
+            continue
+        with open(path, "rb") as f:
+            raw = f.read()
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        if len(packed) >= len(raw):
+            continue
+        with open(path + ".gz", "wb") as f:
+            f.write(packed)
+        print("gzip_assets: %s %d -> %d bytes" % (name, len(raw), len(packed)))
+
+
+env.AddPreAction("$BUILD_DIR/spiffs.bin", gzip_assets)
@@ -0,0 +1,18 @@
+/**
+ * @file esp_bt_defs.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Host stand-in of the ESP-IDF esp_bt_defs.h, for the tools that build
+ *        firmware modules on Linux.
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __HOST_ESP_BT_DEFS_H__
+#define __HOST_ESP_BT_DEFS_H__
+
+#define ESP_BD_ADDR_LEN     6
+
+#endif /* __HOST_ESP_BT_DEFS_H__ */
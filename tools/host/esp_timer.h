@@ -0,0 +1,21 @@
+/**
+ * @file esp_timer.h
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Host stand-in of the ESP-IDF esp_timer.h, for the tools that build
+ *        firmware modules on Linux. The tool defines esp_timer_get_time().
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#ifndef __HOST_ESP_TIMER_H__
+#define __HOST_ESP_TIMER_H__
+
+#include <stdint.h>
+
+/* Microseconds since the tool started */
+int64_t esp_timer_get_time(void);
+
+#endif /* __HOST_ESP_TIMER_H__ */
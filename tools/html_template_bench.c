@@ -0,0 +1,220 @@
+/**
+ * @file html_template_bench.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Host benchmark of the page renderer.
+ *
+ *        Renders data/index.html with the pre-parsed template (html_template.h)
+ *        and with the replace function it superseded, one rescan and malloc'd
+ *        copy of the page per placeholder, checks both give the same page and
+ *        reports the time per page, the bytes copied in RAM and the allocations.
+ *        The template renderer sends the literal spans straight from the
+ *        template text, only the formatted values are copied.
+ *
+ *        gcc -O2 -Ilib/webserver tools/html_template_bench.c lib/webserver/html_template.c -o html_template_bench
+ *        ./html_template_bench [data/index.html]
+ * @version 1.0
+ * @date 2020-04-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "html_template.h"
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 100000
+#endif
+#define BENCH_PAGE_MAX 8192
+
+/* Placeholders and the values of a beacon that sent every frame type */
+static const char* const bench_placeholders[] = {
+    "%MAC%", "%NAME%", "%INSTANCE%", "%RSSI%", "%URL%", "%VER%",
+    "%BAT%", "%TEMP%", "%ADV%", "%TIME%", "%DIST%",
+};
+static const char* const bench_values[] = {
+    "AC:23:3F:A1:B2:C3", "EDD1EBEAC04E5DEFA017", "0BDB87539B67", "-20 dbm",
+    "https://www.example.com/", "0", "3012 mV", "23.50 C", "120394", "86400 s", "1.84 m",
+};
+#define BENCH_SLOT_COUNT (sizeof(bench_placeholders) / sizeof(bench_placeholders[0]))
+
+static size_t bench_copied;         /*<! bytes copied in RAM by the current renderer */
+static size_t bench_allocs;
+
+/**
+ * @brief The replace function of the first version of the server, without its
+ *        log line
+ *
+ * @param buffer - The html string
+ * @param placeholder - The existing placeholder on the html string
+ * @param value - The value that will replace the placeholder
+ * @return char* - A malloc'd copy of buffer with placeholder replaced
+ */
+static char* bench_format_html(const char* buffer, const char* placeholder, const char* value)
+{
+    char *result;
+    int i, cnt = 0;
+    int value_len = strlen(value);
+    int placeholder_len = strlen(placeholder);
+
+    for (i = 0; buffer[i] != '\0'; i++) {
+        if (strstr(&buffer[i], placeholder) == &buffer[i]) {
+            cnt++;
+            i += placeholder_len - 1;
+        }
+    }
+
+    result = (char *)malloc(i + cnt * (value_len - placeholder_len) + 1);
+    bench_allocs++;
+
+    i = 0;
+    while (*buffer) {
+        if (strstr(buffer, placeholder) == buffer) {
+            strcpy(&result[i], value);
+            i += value_len;
+            buffer += placeholder_len;
+        } else {
+            result[i++] = *buffer++;
+        }
+    }
+    result[i] = '\0';
+    bench_copied += i;
+
+    return result;
+}
+
+/**
+ * @brief Old renderer: one pass over the whole page per placeholder. The
+ *        server leaked the intermediate copies, they are freed here.
+ *
+ * @param page - NUL terminated template
+ * @param out - Rendered page
+ * @return size_t - Length of the page
+ */
+static size_t bench_render_replace(const char* page, char* out)
+{
+    char* html = (char*)page;
+
+    for (size_t slot = 0; slot < BENCH_SLOT_COUNT; slot++) {
+        char* next = bench_format_html(html, bench_placeholders[slot], bench_values[slot]);
+        if (html != page) {
+            free(html);
+        }
+        html = next;
+    }
+    size_t len = strlen(html);
+    if (out) {
+        memcpy(out, html, len);
+    }
+    free(html);
+    return len;
+}
+
+/**
+ * @brief New renderer, as esp_webserver_render_page(): values are formatted into
+ *        a stack buffer, literal spans are handed to netconn_write() with
+ *        NETCONN_NOCOPY. out stands in for the connection.
+ *
+ * @param tpl
+ * @param out - Rendered page, NULL to only count what is sent
+ * @return size_t - Length of the page
+ */
+static size_t bench_render_template(const html_template_t* tpl, char* out)
+{
+    char values[BENCH_SLOT_COUNT][64];
+    size_t lens[BENCH_SLOT_COUNT];
+    size_t len = 0;
+
+    for (size_t slot = 0; slot < BENCH_SLOT_COUNT; slot++) {
+        lens[slot] = snprintf(values[slot], sizeof(values[slot]), "%s", bench_values[slot]);
+        bench_copied += lens[slot];
+    }
+    for (int i = 0; i < tpl->span_count; i++) {
+        const html_template_span_t* span = &tpl->spans[i];
+        const char* data = (span->slot == TEMPLATE_LITERAL) ? tpl->text + span->offset : values[span->slot];
+        size_t n = (span->slot == TEMPLATE_LITERAL) ? span->len : lens[span->slot];
+        if (out) {
+            memcpy(out + len, data, n);
+        }
+        len += n;
+    }
+    return len;
+}
+
+/**
+ * @brief Print the cost per page of the last BENCH_ITERATIONS renders
+ *
+ * @param name
+ * @param page_len
+ * @param ns - Time per page
+ */
+static void bench_report(const char* name, size_t page_len, double ns)
+{
+    printf("%-9s %9.1f ns/page  %7zu bytes copied/page  %4zu allocations/page  (%zu byte page)\n",
+           name, ns, bench_copied / BENCH_ITERATIONS, bench_allocs / BENCH_ITERATIONS, page_len);
+}
+
+/**
+ * @brief Time per iteration since start
+ *
+ * @param start
+ * @return double - ns
+ */
+static double bench_elapsed_ns(const struct timespec* start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec)) / BENCH_ITERATIONS;
+}
+
+int main(int argc, char** argv)
+{
+    static char page[BENCH_PAGE_MAX];
+    static char old_out[BENCH_PAGE_MAX];
+    static char new_out[BENCH_PAGE_MAX];
+    static html_template_t tpl;
+    const char* path = argc > 1 ? argv[1] : "data/index.html";
+    struct timespec start;
+    size_t old_len, new_len;
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+    size_t page_len = fread(page, 1, sizeof(page) - 1, f);
+    fclose(f);
+    page[page_len] = '\0';
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        html_template_parse(&tpl, page, page_len, bench_placeholders, BENCH_SLOT_COUNT);
+    }
+    printf("parse     %9.1f ns, once at boot, %u spans\n", bench_elapsed_ns(&start), tpl.span_count);
+
+    /* both renderers must give the same page, values longer than their placeholder included */
+    old_len = bench_render_replace(page, old_out);
+    new_len = bench_render_template(&tpl, new_out);
+    if (old_len != new_len || memcmp(old_out, new_out, old_len)) {
+        printf("the renderers disagree\n");
+        return 1;
+    }
+
+    bench_copied = bench_allocs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        old_len = bench_render_replace(page, NULL);
+    }
+    bench_report("replace", old_len, bench_elapsed_ns(&start));
+
+    bench_copied = bench_allocs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        new_len = bench_render_template(&tpl, NULL);
+    }
+    bench_report("template", new_len, bench_elapsed_ns(&start));
+    return 0;
+}
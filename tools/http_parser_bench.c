@@ -0,0 +1,85 @@
+/**
+ * @file http_parser_bench.c
+ * @author Raquel Teixeira (raquelteixeira@trixlog.com)
+ * @brief Host benchmark of the HTTP request parser.
+ *
+ *        Parses a typical browser request whole and split in small segments,
+ *        as lwIP hands them over, and checks both give the same result.
+ *
+ *        gcc -O2 -Ilib/webserver tools/http_parser_bench.c lib/webserver/http_parser.c -o http_parser_bench
+ * @version 1.0
+ * @date 2020-04-06
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "http_parser.h"
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 1000000
+#endif
+
+static const char bench_request[] =
+    "GET /api/beacons?since=1234 HTTP/1.1\r\n"
+    "Host: 192.168.0.10\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/80.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9,pt;q=0.8\r\n"
+    "If-None-Match: \"p0000000100000002\"\r\n"
+    "\r\n";
+
+/**
+ * @brief Parse the request fed in segments of at most step bytes
+ *
+ * @param parser
+ * @param step
+ * @return int - Non zero when the request was not parsed as expected
+ */
+static int bench_parse(http_parser_t* parser, size_t step)
+{
+    size_t len = sizeof(bench_request) - 1;
+    size_t used = 0;
+
+    http_parser_init(parser);
+    while (used < len && parser->state < HTTP_STATE_DONE) {
+        size_t n = len - used < step ? len - used : step;
+        used += http_parser_feed(parser, bench_request + used, n);
+    }
+
+    size_t value_len;
+    const char* value = http_parser_header(parser, "accept-encoding", &value_len);
+    return parser->state != HTTP_STATE_DONE || parser->method != HTTP_METHOD_GET ||
+           parser->path_len != 12 || strcmp(http_parser_target(parser), "/api/beacons?since=1234") ||
+           value == NULL || strcmp(value, "gzip, deflate") || used != len;
+}
+
+int main(void)
+{
+    static http_parser_t parser;
+    static const size_t steps[] = { sizeof(bench_request), 536, 64, 7, 1 };
+
+    for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+        if (bench_parse(&parser, steps[s])) {
+            printf("segments of %zu bytes: parse error, status %u\n", steps[s], parser.status);
+            return 1;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < BENCH_ITERATIONS; i++) {
+            bench_parse(&parser, steps[s]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_ITERATIONS;
+        printf("segments of %4zu bytes: %7.1f ns/request, %6.1f MB/s\n",
+               steps[s], ns, (sizeof(bench_request) - 1) / ns * 1e3);
+    }
+    return 0;
+}
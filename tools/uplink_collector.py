@@ -0,0 +1,246 @@
+"""
+Linux stand-in for the collector of the receiver uplink (lib/uplink).
+
+Listens for uplink frames on a TCP and a UDP port, decodes them and prints the
+throughput every few seconds, with the frames lost (gaps in the sequence numbers)
+and the records the receiver dropped from its backlog:
+
+    python3 tools/uplink_collector.py --port 5515 [-v]
+
+--load emulates receivers sending frames, to load-test a collector without hardware:
+
+    python3 tools/uplink_collector.py --load 127.0.0.1 --rate 5000 --beacons 200 [--udp]
+
+The wire format is documented in lib/uplink/uplink.h.
+"""
+
+import argparse
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+MAGIC = 0x31505545
+FRAME_HDR = struct.Struct("<IHHIII6sH")
+RECORD_HDR = struct.Struct("<BBb6sI")
+FRAME_SIZE = 1400
+
+FRAME_UID, FRAME_URL, FRAME_TLM = 0x00, 0x10, 0x20
+URL_PREFIX = ["http://www.", "https://www.", "http://", "https://"]
+URL_ENCODING = [".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/",
+                ".com", ".org", ".edu", ".net", ".info", ".biz", ".gov"]
+
+
+def mac(raw):
+    return ":".join("%02X" % b for b in raw)
+
+
+def url_expand(encoded):
+    if not encoded or encoded[0] >= len(URL_PREFIX):
+        return ""
+    out = URL_PREFIX[encoded[0]]
+    for b in encoded[1:]:
+        out += URL_ENCODING[b] if b < len(URL_ENCODING) else chr(b)
+    return out
+
+
+def record_text(frame_type, rssi, bda, time_ms, data):
+    head = "%10u %s %4d " % (time_ms, mac(bda), rssi)
+    if frame_type == FRAME_UID and len(data) == 17:
+        return head + "uid ranging=%d namespace=%s instance=%s" % (
+            struct.unpack_from("<b", data)[0], data[1:11].hex(), data[11:17].hex())
+    if frame_type == FRAME_URL and len(data) >= 2:
+        return head + "url tx_power=%d %s" % (struct.unpack_from("<b", data)[0], url_expand(data[1:]))
+    if frame_type == FRAME_TLM and len(data) == 13:
+        version, batt, temp, adv, uptime = struct.unpack("<BHhII", data)
+        return head + "tlm v%u battery=%umV temperature=%.2fC adv_count=%u uptime=%.1fs" % (
+            version, batt, temp / 256.0, adv, uptime / 10.0)
+    return head + "type=0x%02x %s" % (frame_type, data.hex())
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.frames = 0
+        self.records = 0
+        self.bytes = 0
+        self.errors = 0
+        self.devices = {}           # device -> [next seq, frames lost, records dropped]
+
+    def frame(self, device, seq, count, dropped, size):
+        with self.lock:
+            self.frames += 1
+            self.records += count
+            self.bytes += size
+            state = self.devices.setdefault(device, [seq, 0, 0])
+            if seq > state[0]:
+                state[1] += seq - state[0]
+            elif seq < state[0]:
+                state[1] = 0        # the receiver rebooted
+            state[0] = seq + 1
+            state[2] = dropped
+
+    def error(self):
+        with self.lock:
+            self.errors += 1
+
+    def take(self):
+        with self.lock:
+            out = (self.frames, self.records, self.bytes, self.errors,
+                   {d: tuple(s[1:]) for d, s in self.devices.items()})
+            self.frames = self.records = self.bytes = self.errors = 0
+            return out
+
+
+def parse_frame(frame, stats, verbose):
+    """Decode one complete frame, returns False when it is malformed."""
+    if len(frame) < FRAME_HDR.size:
+        return False
+    magic, length, count, seq, sent_ms, dropped, device, _ = FRAME_HDR.unpack_from(frame)
+    if magic != MAGIC or length != len(frame):
+        return False
+    pos = FRAME_HDR.size
+    lines = []
+    for _ in range(count):
+        if pos + RECORD_HDR.size > length:
+            return False
+        frame_type, size, rssi, bda, time_ms = RECORD_HDR.unpack_from(frame, pos)
+        pos += RECORD_HDR.size
+        if pos + size > length:
+            return False
+        if verbose:
+            lines.append("%s " % mac(device) + record_text(frame_type, rssi, bda, time_ms, frame[pos:pos + size]))
+        pos += size
+    if pos != length:
+        return False
+    stats.frame(mac(device), seq, count, dropped, length)
+    if lines:
+        print("\n".join(lines))
+    return True
+
+
+def serve_tcp_client(conn, addr, stats, verbose):
+    buf = b""
+    with conn:
+        while True:
+            data = conn.recv(65536)
+            if not data:
+                break
+            buf += data
+            while len(buf) >= 6:
+                magic, length = struct.unpack_from("<IH", buf)
+                if magic != MAGIC or length < FRAME_HDR.size:
+                    print("%s:%d: lost framing, closing" % addr, file=sys.stderr)
+                    stats.error()
+                    return
+                if len(buf) < length:
+                    break
+                if not parse_frame(buf[:length], stats, verbose):
+                    stats.error()
+                buf = buf[length:]
+    if buf:
+        stats.error()               # truncated frame, the connection broke while it was sent
+
+
+def serve_tcp(port, stats, verbose):
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("", port))
+    server.listen(16)
+    while True:
+        conn, addr = server.accept()
+        print("%s:%d connected" % addr)
+        threading.Thread(target=serve_tcp_client, args=(conn, addr, stats, verbose), daemon=True).start()
+
+
+def serve_udp(port, stats, verbose):
+    server = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    server.bind(("", port))
+    while True:
+        frame, _ = server.recvfrom(65536)
+        if not parse_frame(frame, stats, verbose):
+            stats.error()
+
+
+def collect(args):
+    stats = Stats()
+    threading.Thread(target=serve_tcp, args=(args.port, stats, args.verbose), daemon=True).start()
+    threading.Thread(target=serve_udp, args=(args.port, stats, args.verbose), daemon=True).start()
+    print("Collecting on TCP and UDP port %d" % args.port)
+    while True:
+        time.sleep(args.interval)
+        frames, records, size, errors, devices = stats.take()
+        print("%d frames, %d records (%.0f/s), %.1f kB/s, %d malformed" % (
+            frames, records, records / args.interval, size / args.interval / 1000.0, errors))
+        for device, (lost, dropped) in sorted(devices.items()):
+            print("  %s: %d frames lost, %d records dropped by the receiver" % (device, lost, dropped))
+
+
+def random_record(beacon, now_ms):
+    bda = struct.pack(">IH", 0xAC233F00, beacon)
+    kind = random.choice((FRAME_UID, FRAME_URL, FRAME_TLM))
+    if kind == FRAME_UID:
+        data = struct.pack("<b", -20) + bytes(10) + struct.pack(">IH", 0, beacon)
+    elif kind == FRAME_URL:
+        data = struct.pack("<bB", -20, 2) + b"example" + bytes([7])
+    else:
+        data = struct.pack("<BHhII", 0, 3000, 23 * 256, now_ms // 100, now_ms // 100)
+    return RECORD_HDR.pack(kind, len(data), random.randint(-95, -40), bda, now_ms & 0xFFFFFFFF) + data
+
+
+def load(args):
+    """Send generated frames like a receiver decoding --rate frames per second from --beacons beacons."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM if args.udp else socket.SOCK_STREAM)
+    sock.connect((args.load, args.port))
+    device = bytes([0x24, 0x0A, 0xC4, 0, 0, random.randint(0, 255)])
+    start = time.monotonic()
+    seq = sent = 0
+    pending = []
+    while time.monotonic() - start < args.duration:
+        now_ms = int((time.monotonic() - start) * 1000)
+        due = int((time.monotonic() - start) * args.rate)
+        while sent + len(pending) < due:
+            pending.append(random_record(random.randrange(args.beacons), now_ms))
+        i = 0
+        while i < len(pending):
+            body = b""
+            count = 0
+            while i < len(pending) and FRAME_HDR.size + len(body) + len(pending[i]) <= FRAME_SIZE:
+                body += pending[i]
+                count += 1
+                i += 1
+            hdr = FRAME_HDR.pack(MAGIC, FRAME_HDR.size + len(body), count, seq, now_ms, 0, device, 0)
+            sock.sendall(hdr + body)
+            seq += 1
+            sent += count
+        pending = []
+        time.sleep(args.batch_ms / 1000.0)
+    print("%d records in %d frames" % (sent, seq))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=5515)
+    parser.add_argument("--interval", type=float, default=5.0, help="seconds between summaries")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print every record")
+    parser.add_argument("--load", metavar="HOST", help="send generated frames to a collector instead")
+    parser.add_argument("--udp", action="store_true", help="--load over UDP")
+    parser.add_argument("--rate", type=int, default=1000, help="--load records per second")
+    parser.add_argument("--beacons", type=int, default=100, help="--load distinct beacons")
+    parser.add_argument("--batch-ms", type=int, default=1000, help="--load batching window")
+    parser.add_argument("--duration", type=float, default=10.0, help="--load seconds")
+    args = parser.parse_args()
+    try:
+        if args.load:
+            load(args)
+        else:
+            collect(args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()